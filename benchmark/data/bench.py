@@ -11,6 +11,7 @@ Example of usage :
 bench.py 0 /abs/path/to/dir/cipher   merge all csv in cipher in a unique file 
 becnh.py 1 /abs/path/to/dir/         plot a bar chart with cpu and mem usage
 becnh.py 2 /abs/path/to/file         plot bar chart for battery
+bench.py 3 /abs/path/to/file.csv     plot cycles per byte and setup cost from utils/cipher_bench -o
 
 TODO handle params
 """
@@ -108,6 +109,51 @@ def battery_plot(file_path):
 
     fig_bat.write_image("{}/result/bat.png".format(file_path.rsplit("/",1)[0]))
 
+def cpb_plot(file_path):
+    df = pd.read_csv(file_path,sep=",",header=0,encoding='utf-8')
+    df = df[df['bytes'] > 0]
+    names = list(dict.fromkeys(df['cipher']))
+
+    fig_cpb = go.Figure()
+    for idx,name in enumerate(names):
+        cipher = df[df['cipher'] == name]
+        fig_cpb.add_trace(go.Scatter(name='{} single'.format(name),x=cipher['bytes'],y=cipher['single_cpb'],mode='lines',line=dict(color=colors[idx % len(colors)])))
+        fig_cpb.add_trace(go.Scatter(name='{} batched'.format(name),x=cipher['bytes'],y=cipher['batched_cpb'],mode='lines',line=dict(color=colors[idx % len(colors)],dash='dash')))
+    fig_cpb.update_layout(
+            title="Cycles per byte",
+            xaxis_title="payload bytes",
+            yaxis_title="cycles/byte",
+            yaxis_type="log",
+           font=dict(
+               family="Courier New, monospace",
+               size=18,
+               color="#7f7f7f"
+    ))
+    fig_cpb.show()
+
+    setup = df.groupby('cipher',sort=False).first()
+    fig_setup = go.Figure(data=[
+        go.Bar(name='key setup',x=names,y=[round(setup['key_setup_cycles'][name]) for name in names],marker_color=colors[0],text=[round(setup['key_setup_cycles'][name]) for name in names],textposition='outside'),
+        go.Bar(name='iv setup',x=names,y=[round(setup['iv_setup_cycles'][name]) for name in names],marker_color=colors[1],text=[round(setup['iv_setup_cycles'][name]) for name in names],textposition='outside')
+        ])
+    fig_setup.update_layout(
+            barmode='group',
+            title="Setup cost",
+            xaxis_title="algorithms",
+            yaxis_title="cycles",
+           font=dict(
+               family="Courier New, monospace",
+               size=18,
+               color="#7f7f7f"
+    ))
+    fig_setup.show()
+
+    if not os.path.exists("{}/result".format(file_path.rsplit("/",1)[0])):
+        os.mkdir("{}/result".format(file_path.rsplit("/",1)[0]))
+
+    fig_cpb.write_image("{}/result/cpb.png".format(file_path.rsplit("/",1)[0]),width=1200,height=800)
+    fig_setup.write_image("{}/result/setup.png".format(file_path.rsplit("/",1)[0]),width=1200,height=800)
+
 
 if __name__ == "__main__":
     if sys.argv[1] == '0':
@@ -119,3 +165,6 @@ if __name__ == "__main__":
     elif sys.argv[1] == '2':
         print("Battery plot")
         battery_plot(sys.argv[2])
+    elif sys.argv[1] == '3':
+        print("Cycles per byte plot")
+        cpb_plot(sys.argv[2])
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifndef _BENCH_H
+#define _BENCH_H
+/***********************************************************************************
+ * Helpers shared by the benchmark tools
+ *
+ * Clocks (Bench_Now in nanoseconds, Bench_Cycles from the TSC, 0 where there is
+ * none), qsort comparators, nearest-rank percentiles of sorted samples and CPU
+ * pinning (Bench_PinCpu, which needs _GNU_SOURCE defined before any include).
+ ***********************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Current time of "clock" (CLOCK_MONOTONIC, CLOCK_THREAD_CPUTIME_ID...) in nanoseconds
+uint64_t Bench_Now(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Time stamp counter, constant rate on current x86 CPUs (0 elsewhere)
+uint64_t Bench_Cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// qsort comparators
+int Bench_CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int Bench_CompareU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Index of the nearest-rank "p"th percentile in n > 0 sorted samples
+size_t Bench_Rank(size_t n, unsigned int p)
+{
+    size_t rank = (n * p + 99) / 100;
+
+    return rank > 0 ? rank - 1 : 0;
+}
+
+// Nearest-rank percentile of sorted nanosecond samples, in microseconds (0 without samples)
+double Bench_PercentileUs(const uint64_t *sorted, size_t n, unsigned int p)
+{
+    if (n == 0)
+        return 0.0;
+    return sorted[Bench_Rank(n, p)] / 1e3;
+}
+
+// Pin the calling process to "cpu", nothing if cpu < 0
+void Bench_PinCpu(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        perror("sched_setaffinity");
+}
+#endif
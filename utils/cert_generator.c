@@ -1,10 +1,22 @@
-#include "fourq.h"
+#ifndef FOURQ_THREADS
+#define FOURQ_THREADS
+#endif
+#include "certificate.h"
+#include "certstore.h"
+#include "revocation.h"
+#include "seqalloc.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <inttypes.h>
 
-#define member_size(type, member) sizeof(((type *)0)->member)
+#define SEQ_NUMBER_FILE "seq_number.gen"
+
+static const char *authority_file = "authority.cert"; // Authority that signs device certificates
+static uint8_t cert_format = CERT_FORMAT_VERSION;     // Format of the issued certificates
 
 void hex_print(uint8_t *pv, uint16_t s, uint16_t len)
 {
@@ -20,39 +32,110 @@ void hex_print(uint8_t *pv, uint16_t s, uint16_t len)
     printf("\n\n");
 }
 
-typedef struct info_s
-{
-    uint8_t seq_number;
-    uint8_t device_id;
-    char device_name[20];
-    char subject[20];
-    char issuer[20];
-    uint8_t public_key[32];
-    float start_time;
-    float end_time;
-} info_t;
-
-typedef struct mavlink_device_certificate
+typedef struct bulk_job
 {
-    info_t info;
-    uint8_t public_key_auth[32];
-    uint8_t secret_key[32];
-    uint8_t sign[64];
-} mavlink_device_certificate_t;
+    mavlink_device_certificate_t *certs;
+    unsigned int count;
+    const mavlink_device_certificate_t *authority;
+    seqalloc_t *sequence;
+    unsigned int failed;
+} bulk_job_t;
 
 void authorityCertGen(void);
+void subAuthorityCertGen(void);
 void uavCertGen(void);
+void bulkCertGen(const char *manifest, const char *outdir, const char *database, unsigned int threads);
+void revokeCertificates(const char *path, const uint64_t *seq_numbers, unsigned int count);
 void signCertificate(mavlink_device_certificate_t *cert, uint8_t *sk, uint8_t *pk);
-uint8_t counter(bool init);
+void openSequence(seqalloc_t *sequence);
+void loadAuthority(mavlink_device_certificate_t *authority_certificate);
+
+void usage(const char *name)
+{
+    printf("Usage: %s [-a authority.cert]                 interactive mode\n", name);
+    printf("       %s -b manifest.csv [-o dir | -d db] [-j n]   bulk mode\n", name);
+    printf("  manifest.csv: one device per line as device_id,device_name,subject,days\n");
+    printf("  -o: output directory for the certificates (default: current directory)\n");
+    printf("  -d: append the certificates to a fleet certificate store instead of writing files\n");
+    printf("  -j: number of signing threads (default: number of online CPUs)\n");
+    printf("  -a: certificate of the signing authority, root or sub-authority (default: authority.cert)\n");
+    printf("  -L: issue certificates in the legacy format of the MAVLink library (sequence numbers up to 255)\n");
+    printf("       %s -R revocation.bin -r seq [-r seq ...]   revoke certificates of the authority\n", name);
+}
 
-int main()
+int main(int argc, char **argv)
 {
+    const char *manifest = NULL, *outdir = ".", *database = NULL, *revocation = NULL;
+    uint64_t *revoked = NULL, *grown;
+    unsigned int nrevoked = 0, capacity = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:b:o:d:j:R:r:Lh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            authority_file = optarg;
+            break;
+        case 'b':
+            manifest = optarg;
+            break;
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'd':
+            database = optarg;
+            break;
+        case 'j':
+            threads = atol(optarg);
+            break;
+        case 'R':
+            revocation = optarg;
+            break;
+        case 'L':
+            cert_format = CERT_FORMAT_LEGACY;
+            break;
+        case 'r':
+            if (nrevoked == capacity)
+            {
+                capacity = capacity ? 2 * capacity : 256;
+                grown = (uint64_t *)realloc(revoked, capacity * sizeof(uint64_t));
+                if (grown == NULL)
+                {
+                    printf("Out of memory for %u revoked certificates\n", capacity);
+                    free(revoked);
+                    return 1;
+                }
+                revoked = grown;
+            }
+            revoked[nrevoked++] = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (revocation != NULL)
+    {
+        revokeCertificates(revocation, revoked, nrevoked);
+        free(revoked);
+        return 0;
+    }
+
+    if (manifest != NULL)
+    {
+        bulkCertGen(manifest, outdir, database, threads > 0 ? (unsigned int)threads : 1);
+        return 0;
+    }
 
     printf("1 - Generate auth cert\n");
     printf("2 - Generate uav cert\n");
+    printf("3 - Generate sub-authority cert\n");
 
     int option = 0;
-    while (option == 0 || option > 2)
+    while (option == 0 || option > 3)
     {
         printf("Choose a one option\n");
 
@@ -67,32 +150,35 @@ int main()
     {
         uavCertGen();
     }
+    else if (option == 3)
+    {
+        subAuthorityCertGen();
+    }
 
     return 0;
 }
 
-uint8_t counter(bool init)
+void openSequence(seqalloc_t *sequence)
 {
-    FILE *fp;
+    if (SeqAlloc_Open(sequence, SEQ_NUMBER_FILE) != ECCRYPTO_SUCCESS)
+    {
+        printf("Unable to open %s\n", SEQ_NUMBER_FILE);
+        exit(1);
+    }
+}
 
-    if (init)
+void loadAuthority(mavlink_device_certificate_t *authority_certificate)
+{
+    if (CertLoad(authority_file, authority_certificate) != ECCRYPTO_SUCCESS)
     {
-        int seq_number = 0;
-        fp = fopen("seq_number.gen", "w+");
-        fprintf(fp, "%d", seq_number);
-        fclose(fp);
-        return seq_number;
+        printf("Unable to load %s\n", authority_file);
+        exit(1);
     }
-    else
+    // A legacy certificate has no type: the authority of the MAVLink library is only known by its file
+    if (authority_certificate->info.version == CERT_FORMAT_VERSION && authority_certificate->info.type != CERT_TYPE_AUTHORITY)
     {
-        int seq_number;
-        fp = fopen("seq_number.gen", "r");
-        fscanf(fp, "%d", &seq_number);
-        fclose(fp);
-        fp = fopen("seq_number.gen", "w");
-        fprintf(fp, "%d", ++seq_number);
-        fclose(fp);
-        return seq_number;
+        printf("%s is not an authority certificate\n", authority_file);
+        exit(1);
     }
 }
 
@@ -102,6 +188,8 @@ void authorityCertGen(void)
     static mavlink_device_certificate_t cert;
 
     printf("Generation of authority certificate\n");
+    cert.info.version = cert_format;
+    cert.info.type = cert_format == CERT_FORMAT_VERSION ? CERT_TYPE_AUTHORITY : CERT_TYPE_DEVICE;
 
     CompressedKeyGeneration(cert.secret_key, cert.info.public_key);
 
@@ -121,6 +209,14 @@ void authorityCertGen(void)
     scanf("%d", &value);
     cert.info.device_id = value;
 
+    if (cert.info.type == CERT_TYPE_AUTHORITY)
+    {
+        int levels = 0;
+        printf("Enter sub-authority levels allowed below it: ");
+        scanf("%d", &levels);
+        cert.info.path_len = levels < 0 ? 0 : levels > UINT8_MAX ? UINT8_MAX : levels;
+    }
+
     int days = 0;
     time_t start;
     printf("Enter data range(Number of days):\n");
@@ -131,7 +227,7 @@ void authorityCertGen(void)
     tm->tm_mday += days;
     time_t end = mktime(tm);
 
-    cert.info.start_time = start;
+    cert.info.start_time = CertStartTime((uint64_t)start);
     cert.info.end_time = end;
 
     printf("Public_key:");
@@ -143,53 +239,132 @@ void authorityCertGen(void)
     SchnorrQ_KeyGeneration(cert.secret_key, cert.public_key_auth);
     printf("Public_key_auth:");
     hex_print(cert.public_key_auth, 0, 32);
+    if (cert.info.version == CERT_FORMAT_VERSION)
+    { // An authority signs certificates with public_key_auth
+        memcpy(cert.info.signing_key, cert.public_key_auth, 32);
+        memcpy(cert.signing_secret_key, cert.secret_key, 32);
+    }
 
-    cert.info.seq_number = counter(true);
-    printf("Sequent number: 0x%x\n", cert.info.seq_number);
-
-    uint8_t certificate[sizeof(info_t)];
+    seqalloc_t sequence;
+    openSequence(&sequence);
+    SeqAlloc_Reset(&sequence, 0);
+    SeqAlloc_Close(&sequence);
+    cert.info.seq_number = 0;
+    printf("Sequent number: 0x%" PRIx64 "\n", cert.info.seq_number);
 
-    memcpy(&certificate[0], &cert.info.seq_number, member_size(info_t, seq_number));
-    memcpy(&certificate[member_size(info_t, seq_number)], &cert.info.device_id, member_size(info_t, device_id));
-    memcpy(&certificate[member_size(info_t, seq_number) + member_size(info_t, device_id)], cert.info.device_name, member_size(info_t, device_name));
-    memcpy(&certificate[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name)], cert.info.subject, member_size(info_t, subject));
-    memcpy(&certificate[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject)], cert.info.issuer, member_size(info_t, issuer));
-    memcpy(&certificate[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject) + member_size(info_t, issuer)], cert.info.public_key, member_size(info_t, public_key));
-    memcpy(&certificate[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject) + member_size(info_t, issuer) + member_size(info_t, public_key)], &cert.info.start_time, member_size(info_t, start_time));
-    memcpy(&certificate[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject) + member_size(info_t, issuer) + member_size(info_t, public_key) + member_size(info_t, start_time)], &cert.info.end_time, member_size(info_t, end_time));
+    uint8_t certificate[CERT_MAX_SIGNED];
+    unsigned int length = serializeInfo(&cert.info, certificate);
 
-    SchnorrQ_Sign(cert.secret_key, cert.public_key_auth, certificate, sizeof(info_t), cert.sign);
+    SchnorrQ_Sign(cert.secret_key, cert.public_key_auth, certificate, length, cert.sign);
     unsigned int valid;
-    SchnorrQ_Verify(cert.public_key_auth, certificate, sizeof(info_t), cert.sign, &valid);
+    SchnorrQ_Verify(cert.public_key_auth, certificate, length, cert.sign, &valid);
 
-    if (valid)
+    if (valid && CertSave("authority.cert", &cert) != ECCRYPTO_SUCCESS)
     {
-        FILE *fp;
-        fp = fopen("authority.cert", "wb");
-        fwrite(&cert, sizeof(cert), 1, fp);
-        fclose(fp);
+        printf("Unable to write authority.cert\n");
+        exit(1);
     }
 
     return;
 }
 
+void subAuthorityCertGen(void)
+{
+    static mavlink_device_certificate_t authority_certificate;
+    static mavlink_device_certificate_t cert;
+    seqalloc_t sequence;
+
+    loadAuthority(&authority_certificate);
+
+    printf("Generation of sub-authority certificate issued by %s\n", authority_certificate.info.subject);
+    if (cert_format != CERT_FORMAT_VERSION || authority_certificate.info.version != CERT_FORMAT_VERSION)
+    { // Only version 2 certificates have a type
+        printf("Sub-authorities need version 2 certificates, without -L\n");
+        exit(1);
+    }
+    if (authority_certificate.info.path_len == 0)
+    {
+        printf("%s does not allow sub-authorities below it\n", authority_certificate.info.subject);
+        exit(1);
+    }
+    cert.info.version = cert_format;
+    cert.info.type = CERT_TYPE_AUTHORITY;
+
+    // The certified key of a sub-authority is its signing key, so the certificate can be used with -a
+    SchnorrQ_FullKeyGeneration(cert.secret_key, cert.public_key_auth);
+    memcpy(cert.info.public_key, cert.public_key_auth, 32);
+    memcpy(cert.info.signing_key, cert.public_key_auth, 32);
+    memcpy(cert.signing_secret_key, cert.secret_key, 32);
+
+    printf("Enter sub-authority name: ");
+    scanf("%19s", cert.info.subject);
+    strcpy(cert.info.device_name, cert.info.subject);
+    strcpy(cert.info.issuer, authority_certificate.info.subject);
+
+    int levels = 0;
+    printf("Enter sub-authority levels allowed below it (at most %u): ", authority_certificate.info.path_len - 1);
+    scanf("%d", &levels);
+    cert.info.path_len = levels < 0 ? 0 : levels > authority_certificate.info.path_len - 1 ? authority_certificate.info.path_len - 1 : levels;
+
+    int days = 0;
+    time_t start;
+    printf("Enter data range(Number of days):\n");
+    scanf("%d", &days);
+
+    time(&start);
+    struct tm *tm = localtime(&start);
+    tm->tm_mday += days;
+    time_t end = mktime(tm);
+
+    cert.info.start_time = CertStartTime((uint64_t)start);
+    cert.info.end_time = end;
+
+    openSequence(&sequence);
+    cert.info.seq_number = SeqAlloc_Reserve(&sequence, 1);
+    SeqAlloc_Close(&sequence);
+    printf("Sequent number: %" PRIu64 "\n", cert.info.seq_number);
+    printf("Public_key_auth:");
+    hex_print(cert.public_key_auth, 0, 32);
+
+    uint8_t certificate[CERT_MAX_SIGNED];
+    unsigned int length = serializeInfo(&cert.info, certificate);
+    if (length == 0)
+    {
+        printf("Sequence number %" PRIu64 " does not fit in a legacy certificate\n", cert.info.seq_number);
+        exit(1);
+    }
+
+    SchnorrQ_Sign(authority_certificate.secret_key, authority_certificate.public_key_auth, certificate, length, cert.sign);
+    unsigned int valid;
+    SchnorrQ_Verify(authority_certificate.public_key_auth, certificate, length, cert.sign, &valid);
+
+    if (valid && CertSave("subauthority.cert", &cert) == ECCRYPTO_SUCCESS)
+    {
+        printf("Written subauthority.cert\n");
+        return;
+    }
+    exit(1);
+}
+
 void uavCertGen()
 {
     static mavlink_device_certificate_t authority_certificate;
     static mavlink_device_certificate_t device_certificate;
 
-    FILE *fp;
-    fp = fopen("authority.cert", "rb+");
-    fread(&authority_certificate, sizeof(mavlink_device_certificate_t), 1, fp);
-    fclose(fp);
+    loadAuthority(&authority_certificate);
+    device_certificate.info.version = cert_format;
+    device_certificate.info.type = CERT_TYPE_DEVICE;
 
-    device_certificate.info.seq_number = counter(false);
+    seqalloc_t sequence;
+    openSequence(&sequence);
+    device_certificate.info.seq_number = SeqAlloc_Reserve(&sequence, 1);
+    SeqAlloc_Close(&sequence);
 
     printf("Loaded authority certificate \n");
     printf("issuer: %s\n", authority_certificate.info.issuer);
     printf("Subject: %s\n", authority_certificate.info.subject);
     printf("Device: %s\n", authority_certificate.info.device_name);
-    printf("Current sequent number %d\n", device_certificate.info.seq_number);
+    printf("Current sequent number %" PRIu64 "\n", device_certificate.info.seq_number);
     printf("Public_key:");
     hex_print(authority_certificate.info.public_key, 0, 32);
     printf("Public_key_auth:");
@@ -220,13 +395,19 @@ void uavCertGen()
     tm->tm_mday += days;
     time_t end = mktime(tm);
 
-    device_certificate.info.start_time = start;
+    device_certificate.info.start_time = CertStartTime((uint64_t)start);
     device_certificate.info.end_time = end;
-    strcpy(device_certificate.info.issuer, authority_certificate.info.issuer);
+    strcpy(device_certificate.info.issuer, authority_certificate.info.subject);
 
     CompressedKeyGeneration(device_certificate.secret_key, device_certificate.info.public_key);
+    if (device_certificate.info.version == CERT_FORMAT_VERSION)
+    { // Separate key for the handshake signatures, the ECDH secret never signs
+        SchnorrQ_FullKeyGeneration(device_certificate.signing_secret_key, device_certificate.info.signing_key);
+        printf("Signing_key:");
+        hex_print(device_certificate.info.signing_key, 0, 32);
+    }
 
-    printf("Sequent number: %d\n", device_certificate.info.seq_number);
+    printf("Sequent number: %" PRIu64 "\n", device_certificate.info.seq_number);
     printf("Pubic_key:");
     hex_print(device_certificate.info.public_key, 0, 32);
 
@@ -234,33 +415,284 @@ void uavCertGen()
     hex_print(device_certificate.secret_key, 0, 32);
     memcpy(device_certificate.public_key_auth, authority_certificate.public_key_auth, 32);
 
-    uint8_t cert[sizeof(info_t)];
+    uint8_t cert[CERT_MAX_SIGNED];
 
     /**
      * wrong order on time
     memcpy(cert, &device_certificate, sizeof(info_t));
     hex_print(cert,0,sizeof(info_t));
     */
-    memcpy(&cert[0], &device_certificate.info.seq_number, member_size(info_t, seq_number));
-    memcpy(&cert[member_size(info_t, seq_number)], &device_certificate.info.device_id, member_size(info_t, device_id));
-    memcpy(&cert[member_size(info_t, seq_number) + member_size(info_t, device_id)], device_certificate.info.device_name, member_size(info_t, device_name));
-    memcpy(&cert[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name)], device_certificate.info.subject, member_size(info_t, subject));
-    memcpy(&cert[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject)], device_certificate.info.issuer, member_size(info_t, issuer));
-    memcpy(&cert[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject) + member_size(info_t, issuer)], device_certificate.info.public_key, member_size(info_t, public_key));
-    memcpy(&cert[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject) + member_size(info_t, issuer) + member_size(info_t, public_key)], &device_certificate.info.start_time, member_size(info_t, start_time));
-    memcpy(&cert[member_size(info_t, seq_number) + member_size(info_t, device_id) + member_size(info_t, device_name) + member_size(info_t, subject) + member_size(info_t, issuer) + member_size(info_t, public_key) + member_size(info_t, start_time)], &device_certificate.info.end_time, member_size(info_t, end_time));
-
-    SchnorrQ_Sign(authority_certificate.secret_key, authority_certificate.public_key_auth, cert, sizeof(info_t), device_certificate.sign);
+    unsigned int length = serializeInfo(&device_certificate.info, cert);
+    if (length == 0)
+    {
+        printf("Sequence number %" PRIu64 " does not fit in a legacy certificate\n", device_certificate.info.seq_number);
+        exit(1);
+    }
+
+    SchnorrQ_Sign(authority_certificate.secret_key, authority_certificate.public_key_auth, cert, length, device_certificate.sign);
     unsigned int valid;
-    SchnorrQ_Verify(authority_certificate.public_key_auth, cert, sizeof(info_t), device_certificate.sign, &valid);
+    SchnorrQ_Verify(authority_certificate.public_key_auth, cert, length, device_certificate.sign, &valid);
 
-    if (valid)
+    if (valid && CertSave("device.cert", &device_certificate) == ECCRYPTO_SUCCESS)
     {
-        fp = fopen("device.cert", "wb");
-        fwrite(&device_certificate, sizeof(mavlink_device_certificate_t), 1, fp);
-        fclose(fp);
         printf("Valid from %s to %s\n", asctime(localtime(&start)), asctime(localtime(&end)));
+        uint8_t encoded[CERT_MAX_ENCODED];
+        printf("Wire size: %u bytes (%zu bytes stored)\n", CertEncode(&device_certificate, encoded), sizeof(mavlink_device_certificate_t));
         return;
     }
     exit(1);
-}
\ No newline at end of file
+}
+
+void *bulkSignWorker(void *arg)
+{
+    bulk_job_t *job = (bulk_job_t *)arg;
+    uint8_t cert[CERT_MAX_SIGNED];
+    unsigned int i, length, valid;
+    uint64_t first = SeqAlloc_Reserve(job->sequence, job->count); // One block of sequence numbers per worker
+
+    for (i = 0; i < job->count; i++)
+    {
+        job->certs[i].info.seq_number = first + i;
+        valid = false;
+        length = 0;
+        if (job->certs[i].info.version != CERT_FORMAT_VERSION ||
+            SchnorrQ_FullKeyGeneration(job->certs[i].signing_secret_key, job->certs[i].info.signing_key) == ECCRYPTO_SUCCESS)
+        { // Version 2: separate key for the handshake signatures
+            length = serializeInfo(&job->certs[i].info, cert); // 0 for a legacy certificate past sequence number 255
+        }
+        if (length != 0)
+        {
+            SchnorrQ_Sign(job->authority->secret_key, job->authority->public_key_auth, cert, length, job->certs[i].sign);
+            SchnorrQ_Verify(job->authority->public_key_auth, cert, length, job->certs[i].sign, &valid);
+        }
+        if (!valid)
+        {
+            job->certs[i].info.device_name[0] = 0; // Marked as failed, not written
+            job->failed++;
+        }
+    }
+    return NULL;
+}
+
+void bulkCertGen(const char *manifest, const char *outdir, const char *database, unsigned int threads)
+{
+    static mavlink_device_certificate_t authority_certificate;
+    mavlink_device_certificate_t *certs = NULL;
+    uint8_t *secret_keys = NULL, *public_keys = NULL;
+    pthread_t *workers = NULL;
+    bulk_job_t *jobs = NULL;
+    unsigned int n = 0, capacity = 1024, i, offset, written = 0, failed = 0;
+    struct timespec begin, finish;
+    ECCRYPTO_STATUS status;
+    int error;
+    certstore_t store;
+    seqalloc_t sequence;
+    char line[256], path[1024];
+    FILE *fp;
+
+    loadAuthority(&authority_certificate);
+
+    fp = fopen(manifest, "r");
+    if (fp == NULL)
+    {
+        printf("Unable to open %s\n", manifest);
+        exit(1);
+    }
+
+    certs = calloc(capacity, sizeof(mavlink_device_certificate_t));
+    while (certs != NULL && fgets(line, sizeof(line), fp) != NULL)
+    {
+        int device_id, days;
+        time_t start, end;
+        struct tm *tm;
+        mavlink_device_certificate_t *cert;
+
+        if (n == capacity)
+        {
+            capacity *= 2;
+            cert = realloc(certs, capacity * sizeof(mavlink_device_certificate_t));
+            if (cert == NULL)
+            {
+                free(certs);
+                certs = NULL;
+                break;
+            }
+            certs = cert;
+        }
+        cert = &certs[n];
+        memset(cert, 0, sizeof(mavlink_device_certificate_t));
+
+        // device_id,device_name,subject,days (header and comment lines are skipped)
+        if (sscanf(line, "%d,%19[^,],%19[^,],%d", &device_id, cert->info.device_name, cert->info.subject, &days) != 4)
+        {
+            continue;
+        }
+
+        time(&start);
+        tm = localtime(&start);
+        tm->tm_mday += days;
+        end = mktime(tm);
+
+        cert->info.version = cert_format;
+        cert->info.type = CERT_TYPE_DEVICE;
+        cert->info.device_id = device_id;
+        cert->info.start_time = CertStartTime((uint64_t)start);
+        cert->info.end_time = end;
+        strcpy(cert->info.issuer, authority_certificate.info.subject);
+        memcpy(cert->public_key_auth, authority_certificate.public_key_auth, 32);
+        n++;
+    }
+    fclose(fp);
+
+    secret_keys = malloc(32 * (size_t)n + 1);
+    public_keys = malloc(32 * (size_t)n + 1);
+    workers = calloc(threads, sizeof(pthread_t));
+    jobs = calloc(threads, sizeof(bulk_job_t));
+    if (certs == NULL || secret_keys == NULL || public_keys == NULL || workers == NULL || jobs == NULL)
+    {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    printf("Loaded %u devices from %s\n", n, manifest);
+
+    openSequence(&sequence);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    status = n == 0 ? ECCRYPTO_SUCCESS : CompressedKeyGenerationBatchParallel(n, secret_keys, public_keys, threads);
+    if (status != ECCRYPTO_SUCCESS)
+    {
+        printf("Key generation failed: %s\n", FourQ_get_error_message(status));
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+    {
+        memcpy(certs[i].secret_key, &secret_keys[32 * i], 32);
+        memcpy(certs[i].info.public_key, &public_keys[32 * i], 32);
+    }
+
+    for (i = 0, offset = 0; i < threads; i++)
+    {
+        jobs[i].certs = &certs[offset];
+        jobs[i].count = n / threads + (i < n % threads ? 1 : 0);
+        jobs[i].authority = &authority_certificate;
+        jobs[i].sequence = &sequence;
+        offset += jobs[i].count;
+        error = pthread_create(&workers[i], NULL, bulkSignWorker, &jobs[i]);
+        if (error != 0)
+        { // Wait for the workers already started, their sequence numbers are spent
+            printf("Unable to start worker %u: %s\n", i, strerror(error));
+            while (i-- > 0)
+                pthread_join(workers[i], NULL);
+            SeqAlloc_Close(&sequence);
+            exit(1);
+        }
+    }
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+        failed += jobs[i].failed;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    SeqAlloc_Close(&sequence);
+
+    if (database != NULL && CertStore_Open(database, n, &store) != ECCRYPTO_SUCCESS)
+    {
+        printf("Unable to open certificate store %s\n", database);
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (certs[i].info.device_name[0] == 0)
+        {
+            continue;
+        }
+        if (database != NULL)
+        {
+            if (CertStore_Append(&store, &certs[i]) != ECCRYPTO_SUCCESS)
+            {
+                printf("Unable to store certificate %" PRIu64 "\n", certs[i].info.seq_number);
+                continue;
+            }
+            written++;
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/device_%" PRIu64 ".cert", outdir, certs[i].info.seq_number);
+        if (CertSave(path, &certs[i]) != ECCRYPTO_SUCCESS)
+        {
+            printf("Unable to write %s\n", path);
+            continue;
+        }
+        written++;
+    }
+
+    double elapsed = (finish.tv_sec - begin.tv_sec) + (finish.tv_nsec - begin.tv_nsec) / 1e9;
+    printf("Generated %u certificates (%u failed) with %u threads in %.3f s: %.0f certificates/s\n",
+           n - failed, failed, threads, elapsed, elapsed > 0 ? (n - failed) / elapsed : 0.0);
+    if (database != NULL)
+    {
+        printf("Stored %u certificates in %s (%llu total)\n", written, database, (unsigned long long)CertStore_Count(&store));
+        CertStore_Close(&store);
+    }
+    else
+    {
+        printf("Written %u certificates to %s\n", written, outdir);
+    }
+
+    clear_words(secret_keys, 32 * n / sizeof(unsigned int));
+    clear_words(certs, n * sizeof(mavlink_device_certificate_t) / sizeof(unsigned int));
+    free(secret_keys);
+    free(public_keys);
+    free(certs);
+    free(workers);
+    free(jobs);
+}
+
+void revokeCertificates(const char *path, const uint64_t *seq_numbers, unsigned int count)
+{
+    static mavlink_device_certificate_t authority_certificate;
+    revocation_filter_t filter;
+    revocation_entry_t *entries;
+    unsigned int i, previous = 0;
+
+    loadAuthority(&authority_certificate);
+
+    // Entries already revoked are kept, a list that does not verify is not overwritten
+    if (Revocation_Load(&filter, path, authority_certificate.public_key_auth) == ECCRYPTO_SUCCESS)
+    {
+        previous = filter.count;
+    }
+    else if (access(path, F_OK) == 0)
+    {
+        printf("%s is not a revocation list signed by %s\n", path, authority_certificate.info.subject);
+        exit(1);
+    }
+    entries = malloc((previous + count + 1) * sizeof(revocation_entry_t));
+    if (entries == NULL)
+    {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    if (previous > 0)
+    {
+        memcpy(entries, filter.entries, previous * sizeof(revocation_entry_t));
+        Revocation_Free(&filter);
+    }
+    for (i = 0; i < count; i++)
+    {
+        memset(&entries[previous + i], 0, sizeof(revocation_entry_t));
+        memcpy(entries[previous + i].issuer, authority_certificate.info.subject, member_size(info_t, subject));
+        entries[previous + i].seq_number = seq_numbers[i];
+    }
+
+    if (Revocation_Build(&filter, entries, previous + count) != ECCRYPTO_SUCCESS || Revocation_Save(&filter, path, authority_certificate.secret_key, authority_certificate.public_key_auth) != ECCRYPTO_SUCCESS)
+    {
+        printf("Unable to write %s\n", path);
+        exit(1);
+    }
+    printf("%u certificates of %s revoked (%u bytes of filter)\n", filter.count, authority_certificate.info.subject, 3 * filter.block_length);
+
+    Revocation_Free(&filter);
+    free(entries);
+}
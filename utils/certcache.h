@@ -0,0 +1,352 @@
+#pragma once
+
+#ifndef _CERTCACHE_H
+#define _CERTCACHE_H
+/***********************************************************************************
+ * Verified-certificate cache
+ *
+ * Remembers certificates whose signature was already verified, so a vehicle that
+ * reconnects with a byte-identical certificate costs one SHA-512 instead of a
+ * signature verification and a point decompression.
+ *
+ * key = SHA-512(public_key_auth || serialized info || sign), truncated to
+ * CERTCACHE_KEY_BYTES, where public_key_auth is the signing key of the issuer.
+ * Only certificates with a valid signature are cached: a failure is never
+ * remembered, so it cannot hide a later valid certificate or keep a forged one
+ * around. Each entry keeps start_time, end_time and the decoded device public
+ * key, and a hit is only valid within [start_time, end_time). Entries are evicted
+ * in LRU order; the cache can be saved to and reloaded from disk so a restarted
+ * GCS starts warm.
+ *
+ * CertCache_VerifyChain checks a device certificate against a certchain_t: the
+ * issuer and its authorities are checked on every call, only the signature of
+ * the certificate is taken from the cache. The handshake uses it when it is given
+ * a cache (Handshake_Init).
+ *
+ * A cache is not thread safe: use one per thread or an external lock. The
+ * persistence file is trusted as it is, keep it writable by the GCS only.
+ ***********************************************************************************/
+#include "certchain.h"
+
+#define CERTCACHE_KEY_BYTES 32
+#define CERTCACHE_MAGIC "UAVCCACH"
+#define CERTCACHE_VERSION 2
+
+typedef struct
+{
+    unsigned char key[CERTCACHE_KEY_BYTES];
+    uint64_t start_time;
+    uint64_t end_time;
+    unsigned char public_key[32]; // Compressed device public key
+    point_affine decoded;         // Decoded device public key
+    int32_t next;                 // Next entry in the same bucket
+    int32_t prev_lru, next_lru;   // LRU list, head is the most recently used
+} certcache_entry_t;
+
+typedef struct
+{
+    unsigned int capacity;
+    unsigned int count;
+    unsigned int buckets_mask;
+    int32_t *buckets;
+    certcache_entry_t *entries;
+    int32_t head, tail;
+    uint64_t hits, misses;
+} certcache_t;
+
+static void certcache_key(const unsigned char *public_key_auth, const unsigned char *certificate, unsigned int length, const unsigned char *sign, unsigned char *key)
+{ // certificate is the serialized info, its version and length tell the formats apart
+    unsigned char message[32 + CERT_MAX_SIGNED + 64], h[64];
+
+    memcpy(message, public_key_auth, 32);
+    memcpy(&message[32], certificate, length);
+    memcpy(&message[32 + length], sign, 64);
+    CryptoHashFunction(message, 32 + length + 64, h);
+    memcpy(key, h, CERTCACHE_KEY_BYTES);
+}
+
+static unsigned int certcache_bucket(const certcache_t *cache, const unsigned char *key)
+{
+    uint64_t h;
+
+    memcpy(&h, key, sizeof(h));
+    return (unsigned int)h & cache->buckets_mask;
+}
+
+static void certcache_unlink_lru(certcache_t *cache, int32_t e)
+{
+    certcache_entry_t *entry = &cache->entries[e];
+
+    if (entry->prev_lru >= 0)
+        cache->entries[entry->prev_lru].next_lru = entry->next_lru;
+    else
+        cache->head = entry->next_lru;
+    if (entry->next_lru >= 0)
+        cache->entries[entry->next_lru].prev_lru = entry->prev_lru;
+    else
+        cache->tail = entry->prev_lru;
+}
+
+static void certcache_push_lru(certcache_t *cache, int32_t e)
+{
+    certcache_entry_t *entry = &cache->entries[e];
+
+    entry->prev_lru = -1;
+    entry->next_lru = cache->head;
+    if (cache->head >= 0)
+        cache->entries[cache->head].prev_lru = e;
+    cache->head = e;
+    if (cache->tail < 0)
+        cache->tail = e;
+}
+
+static int32_t certcache_find(const certcache_t *cache, const unsigned char *key)
+{
+    int32_t e;
+
+    for (e = cache->buckets[certcache_bucket(cache, key)]; e >= 0; e = cache->entries[e].next)
+    {
+        if (memcmp(cache->entries[e].key, key, CERTCACHE_KEY_BYTES) == 0)
+            return e;
+    }
+    return -1;
+}
+
+static certcache_entry_t *certcache_insert(certcache_t *cache, const unsigned char *key)
+{ // New most recently used entry, evicting the least recently used one if the cache is full
+    int32_t e, *link;
+
+    if (cache->count < cache->capacity)
+    {
+        e = (int32_t)cache->count++;
+    }
+    else
+    {
+        e = cache->tail;
+        certcache_unlink_lru(cache, e);
+        for (link = &cache->buckets[certcache_bucket(cache, cache->entries[e].key)]; *link != e; link = &cache->entries[*link].next)
+            ;
+        *link = cache->entries[e].next;
+    }
+
+    memset(&cache->entries[e], 0, sizeof(certcache_entry_t));
+    memcpy(cache->entries[e].key, key, CERTCACHE_KEY_BYTES);
+    cache->entries[e].next = cache->buckets[certcache_bucket(cache, key)];
+    cache->buckets[certcache_bucket(cache, key)] = e;
+    certcache_push_lru(cache, e);
+
+    return &cache->entries[e];
+}
+
+// Create a cache holding up to "capacity" certificates
+ECCRYPTO_STATUS CertCache_Init(certcache_t *cache, unsigned int capacity)
+{
+    unsigned int buckets = 1, i;
+
+    memset(cache, 0, sizeof(certcache_t));
+    if (capacity == 0 || capacity > INT32_MAX / 2)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    while (buckets < capacity)
+        buckets <<= 1;
+
+    cache->buckets = (int32_t *)malloc(buckets * sizeof(int32_t));
+    cache->entries = (certcache_entry_t *)calloc(capacity, sizeof(certcache_entry_t));
+    if (cache->buckets == NULL || cache->entries == NULL)
+    {
+        free(cache->buckets);
+        free(cache->entries);
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+    for (i = 0; i < buckets; i++)
+        cache->buckets[i] = -1;
+    cache->capacity = capacity;
+    cache->buckets_mask = buckets - 1;
+    cache->head = cache->tail = -1;
+
+    return ECCRYPTO_SUCCESS;
+}
+
+void CertCache_Free(certcache_t *cache)
+{
+    free(cache->buckets);
+    free(cache->entries);
+    memset(cache, 0, sizeof(certcache_t));
+}
+
+static ECCRYPTO_STATUS certcache_verify(certcache_t *cache, const unsigned char *public_key_auth, const schnorrq_prepared_key_t *prepared, const info_t *info, const unsigned char *sign, certcache_entry_t **found)
+{ // Entry of a certificate with a valid signature (NULL if it is not), verified with "prepared" if given
+    unsigned char key[CERTCACHE_KEY_BYTES], certificate[CERT_MAX_SIGNED];
+    unsigned int length, valid = false;
+    point_affine decoded;
+    certcache_entry_t *entry;
+    ECCRYPTO_STATUS Status;
+    int32_t e;
+
+    *found = NULL;
+    length = serializeInfo(info, certificate);
+    if (length == 0)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    certcache_key(public_key_auth, certificate, length, sign, key);
+
+    e = certcache_find(cache, key);
+    if (e >= 0)
+    {
+        cache->hits++;
+        certcache_unlink_lru(cache, e);
+        certcache_push_lru(cache, e);
+        *found = &cache->entries[e];
+        return ECCRYPTO_SUCCESS;
+    }
+
+    cache->misses++;
+    if (prepared != NULL)
+        Status = SchnorrQ_VerifyPrepared(prepared, certificate, length, sign, &valid);
+    else
+        Status = SchnorrQ_Verify(public_key_auth, certificate, length, sign, &valid);
+    if (Status != ECCRYPTO_SUCCESS || !valid || decode(info->public_key, &decoded) != ECCRYPTO_SUCCESS)
+    { // Failures are not cached
+        return Status;
+    }
+
+    entry = certcache_insert(cache, key);
+    entry->start_time = (uint64_t)info->start_time;
+    entry->end_time = (uint64_t)info->end_time;
+    memcpy(entry->public_key, info->public_key, sizeof(entry->public_key));
+    memcpy(&entry->decoded, &decoded, sizeof(point_affine));
+    *found = entry;
+    return ECCRYPTO_SUCCESS;
+}
+
+// Certificate verification through the cache
+// Inputs: 32-byte public_key_auth, info and 64-byte sign of the certificate, current time "now" (seconds)
+// Outputs: valid (signature is valid and now is within the validity period), PublicKey (decoded device public key
+//          if valid, can be NULL)
+ECCRYPTO_STATUS CertCache_Verify(certcache_t *cache, const unsigned char *public_key_auth, const info_t *info, const unsigned char *sign, uint64_t now, unsigned int *valid, point_t PublicKey)
+{
+    certcache_entry_t *entry;
+    ECCRYPTO_STATUS Status;
+
+    *valid = false;
+    Status = certcache_verify(cache, public_key_auth, NULL, info, sign, &entry);
+    if (Status != ECCRYPTO_SUCCESS || entry == NULL)
+    {
+        return Status;
+    }
+
+    *valid = now >= entry->start_time && now < entry->end_time;
+    if (*valid && PublicKey != NULL)
+    {
+        memcpy(PublicKey, &entry->decoded, sizeof(point_affine));
+    }
+    return ECCRYPTO_SUCCESS;
+}
+
+// Device certificate verification against a chain, as CertChain_Verify, with the signature check through the cache
+// Inputs: info and 64-byte sign of the certificate, current time "now" (seconds)
+// Output: valid (same result as CertChain_Verify)
+ECCRYPTO_STATUS CertCache_VerifyChain(certcache_t *cache, const certchain_t *chain, const info_t *info, const unsigned char *sign, uint64_t now, unsigned int *valid)
+{
+    const certchain_authority_t *issuer;
+    certcache_entry_t *entry;
+    ECCRYPTO_STATUS Status;
+
+    *valid = false;
+    if (!certchain_check(chain, info, CERT_TYPE_DEVICE, now, &issuer))
+    {
+        return ECCRYPTO_SUCCESS;
+    }
+    Status = certcache_verify(cache, issuer->key.PublicKey, &issuer->key, info, sign, &entry);
+    if (Status == ECCRYPTO_ERROR_INVALID_PARAMETER)
+    { // Unrepresentable info, as in CertChain_Verify
+        return ECCRYPTO_SUCCESS;
+    }
+    *valid = Status == ECCRYPTO_SUCCESS && entry != NULL;
+    return Status;
+}
+
+// Save the cache, entries are written from the least to the most recently used
+ECCRYPTO_STATUS CertCache_Save(const certcache_t *cache, const char *path)
+{
+    uint32_t header[2] = {CERTCACHE_VERSION, cache->count};
+    int32_t e;
+    FILE *fp;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    fwrite(CERTCACHE_MAGIC, 8, 1, fp);
+    fwrite(header, sizeof(header), 1, fp);
+    for (e = cache->tail; e >= 0; e = cache->entries[e].prev_lru)
+    {
+        const certcache_entry_t *entry = &cache->entries[e];
+
+        fwrite(entry->key, CERTCACHE_KEY_BYTES, 1, fp);
+        fwrite(&entry->start_time, sizeof(entry->start_time), 1, fp);
+        fwrite(&entry->end_time, sizeof(entry->end_time), 1, fp);
+        fwrite(entry->public_key, sizeof(entry->public_key), 1, fp);
+    }
+    if (fclose(fp) != 0)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    return ECCRYPTO_SUCCESS;
+}
+
+// Warm up a cache from a file written by CertCache_Save, public keys are decoded again
+// Entries that do not fit in the cache are evicted in LRU order
+ECCRYPTO_STATUS CertCache_Load(certcache_t *cache, const char *path)
+{
+    char magic[8];
+    uint32_t header[2], i;
+    ECCRYPTO_STATUS Status = ECCRYPTO_SUCCESS;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, CERTCACHE_MAGIC, sizeof(magic)) != 0 ||
+        fread(header, sizeof(header), 1, fp) != 1 || header[0] != CERTCACHE_VERSION)
+    {
+        Status = ECCRYPTO_ERROR;
+        goto cleanup;
+    }
+
+    for (i = 0; i < header[1]; i++)
+    {
+        certcache_entry_t entry;
+
+        if (fread(entry.key, CERTCACHE_KEY_BYTES, 1, fp) != 1 || fread(&entry.start_time, sizeof(entry.start_time), 1, fp) != 1 ||
+            fread(&entry.end_time, sizeof(entry.end_time), 1, fp) != 1 || fread(entry.public_key, sizeof(entry.public_key), 1, fp) != 1)
+        {
+            Status = ECCRYPTO_ERROR;
+            goto cleanup;
+        }
+        if (certcache_find(cache, entry.key) >= 0)
+        {
+            continue;
+        }
+        if (decode(entry.public_key, &entry.decoded) != ECCRYPTO_SUCCESS)
+        {
+            continue;
+        }
+
+        certcache_entry_t *inserted = certcache_insert(cache, entry.key);
+        inserted->start_time = entry.start_time;
+        inserted->end_time = entry.end_time;
+        memcpy(inserted->public_key, entry.public_key, sizeof(entry.public_key));
+        memcpy(&inserted->decoded, &entry.decoded, sizeof(point_affine));
+    }
+
+cleanup:
+    fclose(fp);
+    return Status;
+}
+#endif
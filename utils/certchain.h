@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef _CERTCHAIN_H
+#define _CERTCHAIN_H
+/***********************************************************************************
+ * Certificate chains: authority -> sub-authorities -> devices
+ *
+ * A sub-authority certificate has the same layout as a device certificate; its
+ * signed info.signing_key is the SchnorrQ public key it signs certificates with
+ * (a device signs handshake flights with it). It is signed by its issuer, the root authority or
+ * another sub-authority, so chains can have any depth within the signed path_len.
+ *
+ * Only version 2 certificates of type CERT_TYPE_AUTHORITY can be the root or an
+ * intermediate, and an issuer must allow at least one more level below it (its
+ * path_len, lowered along the chain). Chain verification only accepts device
+ * certificates issued by an authority of the chain, so a device cannot issue.
+ *
+ * Each intermediate certificate is verified once, when it is added to the chain,
+ * and kept as a prepared key (SchnorrQ_PrepareKey). A device certificate is then
+ * checked with exactly one SchnorrQ_VerifyPrepared against the key of its issuer,
+ * found by name.
+ ***********************************************************************************/
+#include "certificate.h"
+
+typedef struct
+{
+    char subject[member_size(info_t, subject)];
+    uint64_t seq_number;
+    uint64_t start_time;
+    uint64_t end_time;
+    unsigned int depth;    // 0 for the root authority
+    unsigned int parent;   // Index of the issuer in the chain
+    unsigned int path_len; // Sub-authority levels still allowed below, the lowest along the chain
+    schnorrq_prepared_key_t key;
+} certchain_authority_t;
+
+typedef struct
+{
+    unsigned int count;
+    unsigned int capacity;
+    certchain_authority_t *authorities; // authorities[0] is the root
+} certchain_t;
+
+static certchain_authority_t *certchain_find(const certchain_t *chain, const char *name)
+{ // Authority with subject "name"; a few authorities per fleet, a linear scan is enough
+    unsigned int i;
+
+    for (i = chain->count; i-- > 0;)
+    {
+        if (strncmp(chain->authorities[i].subject, name, member_size(info_t, subject)) == 0)
+            return &chain->authorities[i];
+    }
+    return NULL;
+}
+
+static bool certchain_check(const certchain_t *chain, const info_t *info, uint8_t type, uint64_t now, const certchain_authority_t **issuer)
+{ // Everything but the signature: a version 2 certificate of "type", issued by an authority of the chain,
+  // with the certificate and every authority up to the root within their validity period
+    const certchain_authority_t *authority;
+
+    *issuer = certchain_find(chain, info->issuer);
+    if (*issuer == NULL || info->version != CERT_FORMAT_VERSION || info->type != type)
+    {
+        return false;
+    }
+    if (now < (uint64_t)info->start_time || now >= (uint64_t)info->end_time)
+    {
+        return false;
+    }
+    for (authority = *issuer;; authority = &chain->authorities[authority->parent])
+    {
+        if (now < authority->start_time || now >= authority->end_time)
+            return false;
+        if (authority->depth == 0)
+            return true;
+    }
+}
+
+static ECCRYPTO_STATUS certchain_verify(const certchain_t *chain, const info_t *info, uint8_t type, const unsigned char *sign, uint64_t now, unsigned int *valid, const certchain_authority_t **issuer)
+{ // The certificate must be of "type", issued by an authority of the chain
+    uint8_t certificate[CERT_MAX_SIGNED];
+    unsigned int length;
+
+    *valid = false;
+    if (!certchain_check(chain, info, type, now, issuer))
+    {
+        return ECCRYPTO_SUCCESS;
+    }
+    length = serializeInfo(info, certificate);
+    if (length == 0)
+    {
+        return ECCRYPTO_SUCCESS;
+    }
+    return SchnorrQ_VerifyPrepared(&(*issuer)->key, certificate, length, sign, valid);
+}
+
+// Create a chain trusting the root authority certificate (as written by authorityCertGen)
+// Inputs: root (version 2 authority), room for "capacity" authorities including the root
+ECCRYPTO_STATUS CertChain_Init(certchain_t *chain, const mavlink_device_certificate_t *root, unsigned int capacity)
+{
+    certchain_authority_t *authority;
+    ECCRYPTO_STATUS Status;
+
+    memset(chain, 0, sizeof(certchain_t));
+    if (capacity == 0 || root->info.version != CERT_FORMAT_VERSION || root->info.type != CERT_TYPE_AUTHORITY)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    chain->authorities = (certchain_authority_t *)calloc(capacity, sizeof(certchain_authority_t));
+    if (chain->authorities == NULL)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+    chain->capacity = capacity;
+
+    authority = &chain->authorities[0];
+    Status = SchnorrQ_PrepareKey(root->public_key_auth, &authority->key);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        free(chain->authorities);
+        memset(chain, 0, sizeof(certchain_t));
+        return Status;
+    }
+    memcpy(authority->subject, root->info.subject, sizeof(authority->subject));
+    authority->seq_number = root->info.seq_number;
+    authority->start_time = (uint64_t)root->info.start_time;
+    authority->end_time = (uint64_t)root->info.end_time;
+    authority->path_len = root->info.path_len;
+    chain->count = 1;
+
+    return ECCRYPTO_SUCCESS;
+}
+
+void CertChain_Free(certchain_t *chain)
+{
+    free(chain->authorities);
+    memset(chain, 0, sizeof(certchain_t));
+}
+
+// Verify a sub-authority certificate against its issuer (already in the chain) and add its prepared key
+// Inputs: info and 64-byte sign of the sub-authority certificate, current time "now" (seconds)
+// Output: valid (an authority certificate, its issuer allows one more level, the certificate was verified and added)
+ECCRYPTO_STATUS CertChain_AddIntermediate(certchain_t *chain, const info_t *info, const unsigned char *sign, uint64_t now, unsigned int *valid)
+{
+    const certchain_authority_t *issuer;
+    certchain_authority_t *authority;
+    ECCRYPTO_STATUS Status;
+
+    if (chain->count == chain->capacity)
+    {
+        *valid = false;
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+    if (certchain_find(chain, info->subject) != NULL)
+    { // Subjects name the authorities, they must be unique
+        *valid = false;
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    Status = certchain_verify(chain, info, CERT_TYPE_AUTHORITY, sign, now, valid, &issuer);
+    if (Status != ECCRYPTO_SUCCESS || !*valid)
+    {
+        return Status;
+    }
+    if (issuer->path_len == 0)
+    {
+        *valid = false;
+        return ECCRYPTO_SUCCESS;
+    }
+
+    authority = &chain->authorities[chain->count];
+    Status = SchnorrQ_PrepareKey(info->signing_key, &authority->key);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        *valid = false;
+        return Status;
+    }
+    memcpy(authority->subject, info->subject, sizeof(authority->subject));
+    authority->seq_number = info->seq_number;
+    authority->start_time = (uint64_t)info->start_time;
+    authority->end_time = (uint64_t)info->end_time;
+    authority->path_len = info->path_len < issuer->path_len - 1 ? info->path_len : issuer->path_len - 1;
+    authority->depth = issuer->depth + 1;
+    authority->parent = (unsigned int)(issuer - chain->authorities);
+    chain->count++;
+
+    return ECCRYPTO_SUCCESS;
+}
+
+// Verify a device certificate issued by any authority of the chain
+// Inputs: info and 64-byte sign of the certificate, current time "now" (seconds)
+// Output: valid (a version 2 device certificate, signature of the issuer is valid, the certificate and its issuer
+//         are within their validity period)
+ECCRYPTO_STATUS CertChain_Verify(const certchain_t *chain, const info_t *info, const unsigned char *sign, uint64_t now, unsigned int *valid)
+{
+    const certchain_authority_t *issuer;
+
+    return certchain_verify(chain, info, CERT_TYPE_DEVICE, sign, now, valid, &issuer);
+}
+#endif
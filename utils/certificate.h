@@ -0,0 +1,557 @@
+#pragma once
+
+#ifndef _CERTIFICATE_H
+#define _CERTIFICATE_H
+/***********************************************************************************
+ * MAVLink device certificate
+ *
+ * info_t is the signed part of the certificate: it is serialized field by field
+ * with serializeInfo() (no struct padding) and signed by the authority with
+ * SchnorrQ_Sign. Two formats are signed:
+ *
+ *   CERT_FORMAT_LEGACY  (1): 8-bit seq_number, the 104-byte info_t of the MAVLink
+ *                            library (ArduPilotCustom, QGroundControlCustom), with
+ *                            its two bytes of trailing padding signed as zeros
+ *   CERT_FORMAT_VERSION (2): version byte, 64-bit seq_number, device_id, type and
+ *                            path_len, then the same fields with signing_key after
+ *                            public_key
+ *
+ * The type tells an authority (CERT_TYPE_AUTHORITY), which may issue certificates,
+ * from a device (CERT_TYPE_DEVICE); path_len is the number of sub-authority levels
+ * an authority may have below it. A legacy certificate has neither and is a device
+ * certificate: chains of authorities (certchain.h) are built from version 2 only.
+ *
+ * public_key is the static ECDH key of the holder. signing_key (version 2) is a
+ * separate SchnorrQ key the holder signs with: handshake flights for a device,
+ * certificates for an authority (then equal to its public_key_auth). Its secret is
+ * signing_secret_key, kept next to secret_key and never encoded.
+ *
+ * The version is part of the signed bytes of version 2, so a certificate cannot be
+ * presented as the other format. Certificate files written by CertSave() start
+ * with a small header (magic, format version); a legacy certificate is written as
+ * the raw 232-byte structure of the MAVLink library, and CertLoad() reads both.
+ *
+ * On the wire a certificate uses a canonical compact encoding (CertEncode) without
+ * the secret key and without the authority public key, which the receiver already
+ * knows from the issuer:
+ *
+ *   version (1) | varint seq_number | varint device_id | [type (1) | path_len (1)] |
+ *   len (1) device_name | len (1) subject | len (1) issuer |
+ *   public_key (32) | [signing_key (32)] | varint start_time | varint validity (end_time - start_time) |
+ *   sign (64)
+ *
+ * The wire version is the format version of the certificate, type, path_len and
+ * signing_key are only present in version 2 (path_len is 0 for a device). Strings are stored
+ * without the zero padding and times as whole seconds, so the receiver can rebuild
+ * the exact info_t that was signed. A received buffer is read in place through a
+ * cert_view_t.
+ ***********************************************************************************/
+#include "fourq.h"
+#include <stdio.h>
+
+#define member_size(type, member) sizeof(((type *)0)->member)
+
+#define CERT_FORMAT_LEGACY 1
+#define CERT_FORMAT_VERSION 2
+#define CERT_LEGACY_SIGNED_BYTES 104 // sizeof(info_t) of the MAVLink library
+#define CERT_MAX_SIGNED (1 + 8 + 1 + 2 + 3 * 20 + 32 + 32 + 4 + 4) // Signed bytes of a version 2 certificate
+#define CERT_FILE_MAGIC "UAVCERTF"
+#define CERT_TYPE_DEVICE 0
+#define CERT_TYPE_AUTHORITY 1
+#define CERT_MAX_ENCODED (1 + 10 + 10 + 2 + 3 * 20 + 32 + 32 + 10 + 10 + 64) // 231 bytes, fits in one MAVLink 2 payload
+#define CERT_MAX_TIME (1ULL << 40) // Bound of start_time and validity, keeps the float round trip defined
+
+typedef struct info_s
+{
+    uint8_t version; // CERT_FORMAT_LEGACY or CERT_FORMAT_VERSION
+    uint64_t seq_number; // Below 256 in a legacy certificate
+    uint8_t device_id;
+    uint8_t type;     // CERT_TYPE_DEVICE or CERT_TYPE_AUTHORITY, always a device in a legacy certificate
+    uint8_t path_len; // Authority: sub-authority levels allowed below it
+    char device_name[20];
+    char subject[20];
+    char issuer[20];
+    uint8_t public_key[32];
+    uint8_t signing_key[32]; // Version 2 only
+    float start_time;
+    float end_time;
+} info_t;
+
+typedef struct mavlink_device_certificate
+{
+    info_t info;
+    uint8_t public_key_auth[32];
+    uint8_t secret_key[32];
+    uint8_t signing_secret_key[32]; // Version 2 only
+    uint8_t sign[64];
+} mavlink_device_certificate_t;
+
+// Layout of the MAVLink library, read and written as is
+typedef struct legacy_info_s
+{
+    uint8_t seq_number;
+    uint8_t device_id;
+    char device_name[20];
+    char subject[20];
+    char issuer[20];
+    uint8_t public_key[32];
+    float start_time;
+    float end_time;
+} legacy_info_t;
+
+typedef struct legacy_device_certificate
+{
+    legacy_info_t info;
+    uint8_t public_key_auth[32];
+    uint8_t secret_key[32];
+    uint8_t sign[64];
+} legacy_device_certificate_t;
+
+typedef char legacy_info_size[(sizeof(legacy_info_t) == CERT_LEGACY_SIGNED_BYTES) ? 1 : -1];
+typedef char legacy_certificate_size[(sizeof(legacy_device_certificate_t) == 232) ? 1 : -1];
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} cert_file_header_t;
+
+// Start of validity as stored in info_t: the nearest float not after "seconds"
+// A float holds multiples of 128 s at current times; rounding up would issue a certificate that is not valid yet
+float CertStartTime(uint64_t seconds)
+{
+    float start = (float)seconds;
+    uint32_t bits;
+
+    if ((double)start > (double)seconds)
+    { // Next float toward zero
+        memcpy(&bits, &start, sizeof(bits));
+        bits--;
+        memcpy(&start, &bits, sizeof(start));
+    }
+    return start;
+}
+
+// Serialization of the signed part of a certificate, in the format of info->version
+// Input: info
+// Output: certificate, at least CERT_MAX_SIGNED bytes. Returns the signed length, or 0 if the info cannot be
+//         represented in its format (unknown version or type, legacy seq_number above 255, legacy authority)
+unsigned int serializeInfo(const info_t *info, uint8_t *certificate)
+{
+    unsigned int pos = 0;
+
+    if (info->version == CERT_FORMAT_LEGACY)
+    {
+        if (info->seq_number > UINT8_MAX || info->type != CERT_TYPE_DEVICE || info->path_len != 0)
+        {
+            return 0;
+        }
+        certificate[pos++] = (uint8_t)info->seq_number;
+        certificate[pos++] = info->device_id;
+    }
+    else if (info->version == CERT_FORMAT_VERSION)
+    {
+        if (info->type != CERT_TYPE_DEVICE && info->type != CERT_TYPE_AUTHORITY)
+        {
+            return 0;
+        }
+        certificate[pos++] = info->version;
+        memcpy(&certificate[pos], &info->seq_number, member_size(info_t, seq_number));
+        pos += member_size(info_t, seq_number);
+        certificate[pos++] = info->device_id;
+        certificate[pos++] = info->type;
+        certificate[pos++] = info->path_len;
+    }
+    else
+    {
+        return 0;
+    }
+    memcpy(&certificate[pos], info->device_name, member_size(info_t, device_name));
+    pos += member_size(info_t, device_name);
+    memcpy(&certificate[pos], info->subject, member_size(info_t, subject));
+    pos += member_size(info_t, subject);
+    memcpy(&certificate[pos], info->issuer, member_size(info_t, issuer));
+    pos += member_size(info_t, issuer);
+    memcpy(&certificate[pos], info->public_key, member_size(info_t, public_key));
+    pos += member_size(info_t, public_key);
+    if (info->version == CERT_FORMAT_VERSION)
+    {
+        memcpy(&certificate[pos], info->signing_key, member_size(info_t, signing_key));
+        pos += member_size(info_t, signing_key);
+    }
+    memcpy(&certificate[pos], &info->start_time, member_size(info_t, start_time));
+    pos += member_size(info_t, start_time);
+    memcpy(&certificate[pos], &info->end_time, member_size(info_t, end_time));
+    pos += member_size(info_t, end_time);
+
+    if (info->version == CERT_FORMAT_LEGACY)
+    { // The trailing struct padding of the legacy info_t is signed, as zeros
+        memset(&certificate[pos], 0, CERT_LEGACY_SIGNED_BYTES - pos);
+        pos = CERT_LEGACY_SIGNED_BYTES;
+    }
+    return pos;
+}
+
+// Read a certificate file, versioned or in the raw legacy layout
+ECCRYPTO_STATUS CertLoad(const char *path, mavlink_device_certificate_t *cert)
+{
+    cert_file_header_t header;
+    legacy_device_certificate_t legacy;
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR;
+    FILE *fp = fopen(path, "rb");
+    long size;
+
+    if (fp == NULL)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    memset(cert, 0, sizeof(mavlink_device_certificate_t));
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        goto cleanup;
+    }
+
+    if (size == sizeof(legacy_device_certificate_t))
+    {
+        if (fread(&legacy, sizeof(legacy), 1, fp) != 1)
+        {
+            goto cleanup;
+        }
+        cert->info.version = CERT_FORMAT_LEGACY;
+        cert->info.seq_number = legacy.info.seq_number;
+        cert->info.device_id = legacy.info.device_id;
+        memcpy(cert->info.device_name, legacy.info.device_name, member_size(info_t, device_name));
+        memcpy(cert->info.subject, legacy.info.subject, member_size(info_t, subject));
+        memcpy(cert->info.issuer, legacy.info.issuer, member_size(info_t, issuer));
+        memcpy(cert->info.public_key, legacy.info.public_key, member_size(info_t, public_key));
+        cert->info.start_time = legacy.info.start_time;
+        cert->info.end_time = legacy.info.end_time;
+        memcpy(cert->public_key_auth, legacy.public_key_auth, sizeof(cert->public_key_auth));
+        memcpy(cert->secret_key, legacy.secret_key, sizeof(cert->secret_key));
+        memcpy(cert->sign, legacy.sign, sizeof(cert->sign));
+        clear_words((unsigned int *)&legacy, sizeof(legacy) / sizeof(unsigned int));
+        Status = ECCRYPTO_SUCCESS;
+    }
+    else if (size == sizeof(header) + sizeof(mavlink_device_certificate_t) && fread(&header, sizeof(header), 1, fp) == 1 &&
+             memcmp(header.magic, CERT_FILE_MAGIC, sizeof(header.magic)) == 0 && header.version == CERT_FORMAT_VERSION &&
+             fread(cert, sizeof(mavlink_device_certificate_t), 1, fp) == 1 && cert->info.version == CERT_FORMAT_VERSION)
+    {
+        Status = ECCRYPTO_SUCCESS;
+    }
+
+cleanup:
+    fclose(fp);
+    if (Status != ECCRYPTO_SUCCESS)
+        memset(cert, 0, sizeof(mavlink_device_certificate_t));
+    return Status;
+}
+
+// Write a certificate file in the format of cert->info.version
+ECCRYPTO_STATUS CertSave(const char *path, const mavlink_device_certificate_t *cert)
+{
+    cert_file_header_t header;
+    legacy_device_certificate_t legacy;
+    bool ok;
+    FILE *fp;
+
+    if (cert->info.version == CERT_FORMAT_LEGACY)
+    {
+        if (cert->info.seq_number > UINT8_MAX)
+        {
+            return ECCRYPTO_ERROR_INVALID_PARAMETER;
+        }
+        memset(&legacy, 0, sizeof(legacy));
+        legacy.info.seq_number = (uint8_t)cert->info.seq_number;
+        legacy.info.device_id = cert->info.device_id;
+        memcpy(legacy.info.device_name, cert->info.device_name, member_size(info_t, device_name));
+        memcpy(legacy.info.subject, cert->info.subject, member_size(info_t, subject));
+        memcpy(legacy.info.issuer, cert->info.issuer, member_size(info_t, issuer));
+        memcpy(legacy.info.public_key, cert->info.public_key, member_size(info_t, public_key));
+        legacy.info.start_time = cert->info.start_time;
+        legacy.info.end_time = cert->info.end_time;
+        memcpy(legacy.public_key_auth, cert->public_key_auth, sizeof(legacy.public_key_auth));
+        memcpy(legacy.secret_key, cert->secret_key, sizeof(legacy.secret_key));
+        memcpy(legacy.sign, cert->sign, sizeof(legacy.sign));
+    }
+    else if (cert->info.version != CERT_FORMAT_VERSION)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        if (cert->info.version == CERT_FORMAT_LEGACY)
+            clear_words((unsigned int *)&legacy, sizeof(legacy) / sizeof(unsigned int));
+        return ECCRYPTO_ERROR;
+    }
+    if (cert->info.version == CERT_FORMAT_LEGACY)
+    {
+        ok = fwrite(&legacy, sizeof(legacy), 1, fp) == 1;
+        clear_words((unsigned int *)&legacy, sizeof(legacy) / sizeof(unsigned int));
+    }
+    else
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CERT_FILE_MAGIC, sizeof(header.magic));
+        header.version = CERT_FORMAT_VERSION;
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(cert, sizeof(mavlink_device_certificate_t), 1, fp) == 1;
+    }
+    ok = fclose(fp) == 0 && ok;
+
+    return ok ? ECCRYPTO_SUCCESS : ECCRYPTO_ERROR;
+}
+
+typedef struct cert_view
+{
+    uint8_t version;
+    uint64_t seq_number;
+    uint64_t device_id;
+    uint8_t type; // CERT_TYPE_DEVICE for a legacy certificate
+    uint8_t path_len;
+    const char *device_name; // Not null terminated
+    const char *subject;
+    const char *issuer;
+    uint8_t device_name_len;
+    uint8_t subject_len;
+    uint8_t issuer_len;
+    const uint8_t *public_key;
+    const uint8_t *signing_key; // NULL for a legacy certificate
+    uint64_t start_time;
+    uint64_t end_time;
+    const uint8_t *sign;
+} cert_view_t;
+
+static unsigned int cert_put_varint(uint8_t *out, uint64_t value)
+{ // LEB128
+    unsigned int i = 0;
+
+    while (value >= 0x80)
+    {
+        out[i++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[i++] = (uint8_t)value;
+    return i;
+}
+
+static bool cert_get_varint(const uint8_t *in, unsigned int len, unsigned int *pos, uint64_t *value)
+{ // Only the shortest encoding is accepted
+    unsigned int shift = 0;
+
+    *value = 0;
+    while (*pos < len && shift < 64)
+    {
+        uint8_t byte = in[(*pos)++];
+
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return !(byte == 0 && shift != 0) && !(shift == 63 && byte > 1);
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+static bool cert_put_string(uint8_t *out, unsigned int *pos, const char *string, unsigned int size)
+{ // Length-prefixed string, the zero padding of the field must be canonical
+    unsigned int len = 0, i;
+
+    while (len < size && string[len] != 0)
+        len++;
+    if (len == size)
+    {
+        return false;
+    }
+    for (i = len; i < size; i++)
+    {
+        if (string[i] != 0)
+            return false;
+    }
+    out[(*pos)++] = (uint8_t)len;
+    memcpy(&out[*pos], string, len);
+    *pos += len;
+    return true;
+}
+
+static bool cert_get_string(const uint8_t *in, unsigned int len, unsigned int *pos, unsigned int size, const char **string, uint8_t *string_len)
+{
+    if (*pos >= len || in[*pos] >= size || len - *pos - 1 < in[*pos])
+    {
+        return false;
+    }
+    *string_len = in[(*pos)++];
+    *string = (const char *)&in[*pos];
+    if (memchr(*string, 0, *string_len) != NULL)
+    {
+        return false;
+    }
+    *pos += *string_len;
+    return true;
+}
+
+// Canonical compact encoding of a certificate (secret key and authority public key are not encoded)
+// Input: cert
+// Output: out, at least CERT_MAX_ENCODED bytes. Returns the encoded size, or 0 if the certificate has no canonical encoding
+unsigned int CertEncode(const mavlink_device_certificate_t *cert, uint8_t *out)
+{
+    unsigned int pos = 0;
+    uint64_t start, end;
+
+    if (!(cert->info.start_time >= 0 && cert->info.start_time < (float)CERT_MAX_TIME) || !(cert->info.end_time >= cert->info.start_time && cert->info.end_time < (float)(2 * CERT_MAX_TIME)))
+    {
+        return 0;
+    }
+    start = (uint64_t)cert->info.start_time;
+    end = (uint64_t)cert->info.end_time;
+    if ((float)start != cert->info.start_time || (float)end != cert->info.end_time || end - start >= CERT_MAX_TIME)
+    {
+        return 0;
+    }
+
+    if (cert->info.version == CERT_FORMAT_LEGACY)
+    {
+        if (cert->info.seq_number > UINT8_MAX || cert->info.type != CERT_TYPE_DEVICE || cert->info.path_len != 0)
+        {
+            return 0;
+        }
+    }
+    else if (cert->info.version != CERT_FORMAT_VERSION || (cert->info.type != CERT_TYPE_DEVICE && cert->info.type != CERT_TYPE_AUTHORITY) ||
+             (cert->info.type == CERT_TYPE_DEVICE && cert->info.path_len != 0))
+    {
+        return 0;
+    }
+    out[pos++] = cert->info.version;
+    pos += cert_put_varint(&out[pos], cert->info.seq_number);
+    pos += cert_put_varint(&out[pos], cert->info.device_id);
+    if (cert->info.version == CERT_FORMAT_VERSION)
+    {
+        out[pos++] = cert->info.type;
+        out[pos++] = cert->info.path_len;
+    }
+    if (!cert_put_string(out, &pos, cert->info.device_name, member_size(info_t, device_name)) ||
+        !cert_put_string(out, &pos, cert->info.subject, member_size(info_t, subject)) ||
+        !cert_put_string(out, &pos, cert->info.issuer, member_size(info_t, issuer)))
+    {
+        return 0;
+    }
+    memcpy(&out[pos], cert->info.public_key, member_size(info_t, public_key));
+    pos += member_size(info_t, public_key);
+    if (cert->info.version == CERT_FORMAT_VERSION)
+    {
+        memcpy(&out[pos], cert->info.signing_key, member_size(info_t, signing_key));
+        pos += member_size(info_t, signing_key);
+    }
+    pos += cert_put_varint(&out[pos], start);
+    pos += cert_put_varint(&out[pos], end - start);
+    memcpy(&out[pos], cert->sign, member_size(mavlink_device_certificate_t, sign));
+    pos += member_size(mavlink_device_certificate_t, sign);
+
+    return pos;
+}
+
+// Zero-copy parsing of an encoded certificate, the view points into "in"
+// Inputs: in, len (exact size of the encoding)
+// Output: view. Returns false if the encoding is malformed or not canonical
+bool CertView_Parse(const uint8_t *in, unsigned int len, cert_view_t *view)
+{
+    unsigned int pos = 0;
+    uint64_t validity;
+
+    if (len < 1 || (in[pos] != CERT_FORMAT_LEGACY && in[pos] != CERT_FORMAT_VERSION))
+    {
+        return false;
+    }
+    view->version = in[pos++];
+    if (!cert_get_varint(in, len, &pos, &view->seq_number) || (view->version == CERT_FORMAT_LEGACY && view->seq_number > UINT8_MAX) ||
+        !cert_get_varint(in, len, &pos, &view->device_id) || view->device_id > UINT8_MAX)
+    {
+        return false;
+    }
+    view->type = CERT_TYPE_DEVICE;
+    view->path_len = 0;
+    if (view->version == CERT_FORMAT_VERSION)
+    {
+        if (len - pos < 2)
+        {
+            return false;
+        }
+        view->type = in[pos++];
+        view->path_len = in[pos++];
+        if ((view->type != CERT_TYPE_DEVICE && view->type != CERT_TYPE_AUTHORITY) || (view->type == CERT_TYPE_DEVICE && view->path_len != 0))
+        { // path_len 0 for a device keeps the encoding canonical
+            return false;
+        }
+    }
+    if (!cert_get_string(in, len, &pos, member_size(info_t, device_name), &view->device_name, &view->device_name_len) ||
+        !cert_get_string(in, len, &pos, member_size(info_t, subject), &view->subject, &view->subject_len) ||
+        !cert_get_string(in, len, &pos, member_size(info_t, issuer), &view->issuer, &view->issuer_len))
+    {
+        return false;
+    }
+    if (len - pos < member_size(info_t, public_key))
+    {
+        return false;
+    }
+    view->public_key = &in[pos];
+    pos += member_size(info_t, public_key);
+    view->signing_key = NULL;
+    if (view->version == CERT_FORMAT_VERSION)
+    {
+        if (len - pos < member_size(info_t, signing_key))
+        {
+            return false;
+        }
+        view->signing_key = &in[pos];
+        pos += member_size(info_t, signing_key);
+    }
+    if (!cert_get_varint(in, len, &pos, &view->start_time) || !cert_get_varint(in, len, &pos, &validity) || view->start_time >= CERT_MAX_TIME || validity >= CERT_MAX_TIME)
+    {
+        return false;
+    }
+    view->end_time = view->start_time + validity;
+    if ((uint64_t)(float)view->start_time != view->start_time || (uint64_t)(float)view->end_time != view->end_time)
+    {
+        return false;
+    }
+    if (len - pos != member_size(mavlink_device_certificate_t, sign))
+    {
+        return false;
+    }
+    view->sign = &in[pos];
+
+    return true;
+}
+
+// Rebuild the signed info_t of a parsed certificate
+void CertView_ToInfo(const cert_view_t *view, info_t *info)
+{
+    memset(info, 0, sizeof(info_t));
+    info->version = view->version;
+    info->seq_number = view->seq_number;
+    info->device_id = (uint8_t)view->device_id;
+    info->type = view->type;
+    info->path_len = view->path_len;
+    memcpy(info->device_name, view->device_name, view->device_name_len);
+    memcpy(info->subject, view->subject, view->subject_len);
+    memcpy(info->issuer, view->issuer, view->issuer_len);
+    memcpy(info->public_key, view->public_key, member_size(info_t, public_key));
+    if (view->signing_key != NULL)
+        memcpy(info->signing_key, view->signing_key, member_size(info_t, signing_key));
+    info->start_time = (float)view->start_time;
+    info->end_time = (float)view->end_time;
+}
+
+// Verification of a parsed certificate against the authority public key
+// Output: true (valid certificate) or false (invalid certificate)
+ECCRYPTO_STATUS CertView_Verify(const cert_view_t *view, const uint8_t *public_key_auth, unsigned int *valid)
+{
+    info_t info;
+    uint8_t certificate[CERT_MAX_SIGNED];
+
+    CertView_ToInfo(view, &info);
+    return SchnorrQ_Verify(public_key_auth, certificate, serializeInfo(&info, certificate), view->sign, valid);
+}
+#endif
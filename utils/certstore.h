@@ -0,0 +1,370 @@
+#pragma once
+
+#ifndef _CERTSTORE_H
+#define _CERTSTORE_H
+/***********************************************************************************
+ * Memory-mapped fleet certificate store
+ *
+ * One file holds the certificates of the whole fleet:
+ *
+ *   [ header | records (fixed stride) | index by device_id | index by seq_number ]
+ *
+ * Records are appended and never modified. Both indexes are open-addressing hash
+ * tables of record numbers (0 = empty slot), so a lookup is a hash plus a pointer
+ * into the mapping, with no parsing or per-file I/O. A device that is issued a new
+ * certificate keeps its older records; the device_id index points to the latest one.
+ *
+ * Creation and appends hold an exclusive flock on the file, so several processes
+ * (cert_generator -d runs) can share a store. The lock belongs to the open file:
+ * within one process a store is appended by one thread at a time.
+ *
+ * A full store doubles its capacity on append: the file is extended, both indexes are
+ * rebuilt past the new records area and the header is updated last. Records never
+ * move. Other processes see the new capacity in the shared header and remap before
+ * their next append or lookup.
+ *
+ * Secret keys are never written to the store.
+ ***********************************************************************************/
+#include "certificate.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define CERTSTORE_MAGIC "UAVCERTS"
+#define CERTSTORE_VERSION 3 // 2: 64-bit seq_number, 3: format version, type and path_len in info_t
+#define CERTSTORE_HEADER_SIZE 4096
+#define CERTSTORE_RECORD_SIZE 256 // Fixed stride, leaves room for new fields without changing the layout
+#define CERTSTORE_MIN_CAPACITY 1024
+#define CERTSTORE_MAX_CAPACITY (UINT32_MAX / 2 - 1) // Record numbers + 1 are stored in uint32_t slots
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;    // Records that fit before the store grows
+    uint64_t index_slots; // Slots of each index, a power of two >= 2*capacity, updated before capacity
+    uint64_t count;       // Number of records, updated after the record and its index entries
+} certstore_header_t;
+
+typedef struct
+{
+    info_t info;
+    uint8_t public_key_auth[32];
+    uint8_t sign[64];
+} certstore_record_t;
+
+typedef char certstore_record_fits[(sizeof(certstore_record_t) <= CERTSTORE_RECORD_SIZE) ? 1 : -1];
+
+typedef struct
+{
+    int fd;
+    size_t size;
+    uint64_t capacity, index_slots; // Layout of the current mapping
+    certstore_header_t *header;
+    unsigned char *records;
+    uint32_t *device_index;
+    uint32_t *seq_index;
+} certstore_t;
+
+static uint64_t certstore_hash(uint64_t key, uint64_t slots)
+{
+    return (key * 0x9E3779B97F4A7C15ULL) >> 17 & (slots - 1);
+}
+
+static size_t certstore_file_size(uint64_t capacity, uint64_t slots)
+{
+    return CERTSTORE_HEADER_SIZE + capacity * CERTSTORE_RECORD_SIZE + 2 * slots * sizeof(uint32_t);
+}
+
+static uint64_t certstore_slots(uint64_t capacity)
+{
+    uint64_t slots = 1;
+
+    while (slots < 2 * capacity)
+        slots <<= 1;
+    return slots;
+}
+
+static void certstore_layout(certstore_t *store)
+{
+    store->records = (unsigned char *)store->header + CERTSTORE_HEADER_SIZE;
+    store->device_index = (uint32_t *)(store->records + store->capacity * CERTSTORE_RECORD_SIZE);
+    store->seq_index = store->device_index + store->index_slots;
+}
+
+static uint32_t *certstore_slot(const certstore_t *store, uint32_t *index, uint64_t key, bool by_device)
+{ // Slot holding the record with the given key, or the empty slot where it would be inserted
+  // NULL if the index is full of entries that are not record numbers, read while another process grows the store
+    uint64_t slots = store->index_slots, i, probes;
+
+    for (i = certstore_hash(key, slots), probes = 0; probes < slots; i = (i + 1) & (slots - 1), probes++)
+    {
+        const certstore_record_t *record;
+
+        if (index[i] == 0)
+        {
+            return &index[i];
+        }
+        if (index[i] > store->capacity)
+        {
+            continue;
+        }
+        record = (const certstore_record_t *)(store->records + (uint64_t)(index[i] - 1) * CERTSTORE_RECORD_SIZE);
+        if ((by_device ? record->info.device_id : record->info.seq_number) == key)
+        {
+            return &index[i];
+        }
+    }
+    return NULL;
+}
+
+static ECCRYPTO_STATUS certstore_map(certstore_t *store)
+{ // Map the file with the layout of its header, the caller holds the file lock
+    certstore_header_t header;
+    struct stat st;
+    void *map;
+
+    if (fstat(store->fd, &st) != 0 || pread(store->fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, CERTSTORE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CERTSTORE_VERSION || header.record_size != CERTSTORE_RECORD_SIZE || header.capacity == 0 || header.capacity > CERTSTORE_MAX_CAPACITY ||
+        header.index_slots != certstore_slots(header.capacity) || header.count > header.capacity)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    // An interrupted growth leaves the file longer than its header says
+    if ((uint64_t)st.st_size < certstore_file_size(header.capacity, header.index_slots))
+    {
+        return ECCRYPTO_ERROR;
+    }
+
+    map = mmap(NULL, certstore_file_size(header.capacity, header.index_slots), PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    if (store->header != NULL)
+    {
+        munmap(store->header, store->size);
+    }
+    store->header = (certstore_header_t *)map;
+    store->size = certstore_file_size(header.capacity, header.index_slots);
+    store->capacity = header.capacity;
+    store->index_slots = header.index_slots;
+    certstore_layout(store);
+    return ECCRYPTO_SUCCESS;
+}
+
+static bool certstore_stale(const certstore_t *store)
+{ // Has another process grown the store since it was mapped?
+    return __atomic_load_n(&store->header->capacity, __ATOMIC_ACQUIRE) != store->capacity;
+}
+
+static ECCRYPTO_STATUS certstore_refresh(certstore_t *store)
+{ // Remap a store grown by another process, waiting for the growth to complete
+    ECCRYPTO_STATUS status;
+
+    if (!certstore_stale(store))
+    {
+        return ECCRYPTO_SUCCESS;
+    }
+    if (flock(store->fd, LOCK_SH) != 0)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    status = certstore_map(store);
+    flock(store->fd, LOCK_UN);
+    return status;
+}
+
+static ECCRYPTO_STATUS certstore_grow(certstore_t *store)
+{ // Double the capacity, the caller holds the exclusive file lock
+  // The new indexes lie past the end of the old file, so the old ones stay valid for readers until the header changes
+    uint64_t capacity, slots, i, count = store->header->count;
+    certstore_t grown;
+
+    if (store->capacity >= CERTSTORE_MAX_CAPACITY)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+    capacity = store->capacity * 2 < CERTSTORE_MAX_CAPACITY ? store->capacity * 2 : CERTSTORE_MAX_CAPACITY;
+    slots = certstore_slots(capacity);
+    if (ftruncate(store->fd, certstore_file_size(capacity, slots)) != 0)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+
+    grown = *store;
+    grown.header = (certstore_header_t *)mmap(NULL, certstore_file_size(capacity, slots), PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    if (grown.header == MAP_FAILED)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+    grown.size = certstore_file_size(capacity, slots);
+    grown.capacity = capacity;
+    grown.index_slots = slots;
+    certstore_layout(&grown);
+    memset(grown.device_index, 0, 2 * slots * sizeof(uint32_t)); // Left by an interrupted growth
+
+    for (i = 0; i < count; i++)
+    { // In append order, so the device index ends on the latest record of each device
+        const certstore_record_t *record = (const certstore_record_t *)(grown.records + i * CERTSTORE_RECORD_SIZE);
+
+        *certstore_slot(&grown, grown.seq_index, record->info.seq_number, false) = (uint32_t)(i + 1);
+        *certstore_slot(&grown, grown.device_index, record->info.device_id, true) = (uint32_t)(i + 1);
+    }
+    msync(grown.header, grown.size, MS_SYNC);
+
+    grown.header->index_slots = slots;
+    __atomic_store_n(&grown.header->capacity, capacity, __ATOMIC_RELEASE);
+    munmap(store->header, store->size);
+    *store = grown;
+    return ECCRYPTO_SUCCESS;
+}
+
+// Open a certificate store, creating it with room for "capacity" records if it does not exist
+// (at least CERTSTORE_MIN_CAPACITY); the store grows when it is full
+// Unused records and index slots are sparse in the file until they are written
+ECCRYPTO_STATUS CertStore_Open(const char *path, uint64_t capacity, certstore_t *store)
+{
+    struct stat st;
+    certstore_header_t header;
+    uint64_t slots;
+
+    memset(store, 0, sizeof(certstore_t));
+    store->fd = open(path, O_RDWR | O_CREAT, 0600);
+    // Held until the store is initialized and mapped: another process may be creating it
+    if (store->fd < 0 || flock(store->fd, LOCK_EX) != 0 || fstat(store->fd, &st) != 0)
+    {
+        goto error;
+    }
+
+    if (st.st_size == 0)
+    { // New store
+        capacity = capacity < CERTSTORE_MIN_CAPACITY ? CERTSTORE_MIN_CAPACITY : capacity;
+        if (capacity > CERTSTORE_MAX_CAPACITY)
+        {
+            goto error;
+        }
+        slots = certstore_slots(capacity);
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CERTSTORE_MAGIC, sizeof(header.magic));
+        header.version = CERTSTORE_VERSION;
+        header.record_size = CERTSTORE_RECORD_SIZE;
+        header.capacity = capacity;
+        header.index_slots = slots;
+        if (ftruncate(store->fd, certstore_file_size(capacity, slots)) != 0 || pwrite(store->fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            goto error;
+        }
+    }
+
+    if (certstore_map(store) != ECCRYPTO_SUCCESS)
+    {
+        goto error;
+    }
+    flock(store->fd, LOCK_UN);
+    return ECCRYPTO_SUCCESS;
+
+error:
+    if (store->fd >= 0)
+        close(store->fd); // Also releases the lock
+    store->fd = -1;
+    return ECCRYPTO_ERROR;
+}
+
+// Unmap and close a certificate store
+void CertStore_Close(certstore_t *store)
+{
+    if (store->header != NULL)
+    {
+        msync(store->header, store->size, MS_SYNC);
+        munmap(store->header, store->size);
+    }
+    if (store->fd >= 0)
+        close(store->fd);
+    memset(store, 0, sizeof(certstore_t));
+    store->fd = -1;
+}
+
+// Number of certificates in the store
+uint64_t CertStore_Count(const certstore_t *store)
+{
+    return __atomic_load_n(&store->header->count, __ATOMIC_ACQUIRE);
+}
+
+// Append a certificate (the secret key is not stored)
+// Writers of other processes wait on the file lock; readers mapping the same file see the record once count is updated
+ECCRYPTO_STATUS CertStore_Append(certstore_t *store, const mavlink_device_certificate_t *cert)
+{
+    uint64_t count;
+    certstore_record_t *record;
+    uint32_t *slot;
+    ECCRYPTO_STATUS status = ECCRYPTO_SUCCESS;
+
+    if (flock(store->fd, LOCK_EX) != 0)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    if (certstore_stale(store))
+    {
+        status = certstore_map(store);
+    }
+    if (status == ECCRYPTO_SUCCESS && store->header->count >= store->capacity)
+    {
+        status = certstore_grow(store);
+    }
+    if (status != ECCRYPTO_SUCCESS)
+    {
+        flock(store->fd, LOCK_UN);
+        return status;
+    }
+    count = store->header->count;
+    slot = certstore_slot(store, store->seq_index, cert->info.seq_number, false);
+    if (*slot != 0)
+    { // Sequence numbers are unique
+        flock(store->fd, LOCK_UN);
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    // The stride past the record may hold the indexes of the store before it grew
+    record = (certstore_record_t *)(store->records + count * CERTSTORE_RECORD_SIZE);
+    memset(record, 0, CERTSTORE_RECORD_SIZE);
+    memcpy(&record->info, &cert->info, sizeof(info_t));
+    memcpy(record->public_key_auth, cert->public_key_auth, sizeof(record->public_key_auth));
+    memcpy(record->sign, cert->sign, sizeof(record->sign));
+
+    *slot = (uint32_t)(count + 1);
+    *certstore_slot(store, store->device_index, cert->info.device_id, true) = (uint32_t)(count + 1);
+    __atomic_store_n(&store->header->count, count + 1, __ATOMIC_RELEASE);
+    flock(store->fd, LOCK_UN);
+
+    return ECCRYPTO_SUCCESS;
+}
+
+static const certstore_record_t *certstore_find(certstore_t *store, uint64_t key, bool by_device)
+{
+    uint32_t *slot;
+
+    if (certstore_refresh(store) != ECCRYPTO_SUCCESS)
+    {
+        return NULL;
+    }
+    slot = certstore_slot(store, by_device ? store->device_index : store->seq_index, key, by_device);
+    return slot == NULL || *slot == 0 ? NULL : (const certstore_record_t *)(store->records + (uint64_t)(*slot - 1) * CERTSTORE_RECORD_SIZE);
+}
+
+// Latest certificate of a device, or NULL if the device is not in the store
+// Returned records stay valid until the next call on the store, which may remap it
+const certstore_record_t *CertStore_FindByDevice(certstore_t *store, uint64_t device_id)
+{
+    return certstore_find(store, device_id, true);
+}
+
+// Certificate with a given sequence number, or NULL if it is not in the store
+const certstore_record_t *CertStore_FindBySeq(certstore_t *store, uint64_t seq_number)
+{
+    return certstore_find(store, seq_number, false);
+}
+#endif
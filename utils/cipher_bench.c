@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include "linkcipher.h"
+#include "bench.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+// Per-message cost of the link ciphers at every MAVLink payload length
+// Each cipher is measured in three parts: key setup, IV load, and encryption of one payload
+// of 0..255 bytes. "single" reloads the IV and encrypts the message from the start of the
+// keystream, as the link does for each frame; "batched" encrypts the messages back to back on
+// one running keystream.
+// Results are the p50 over the samples of cycles (TSC) and nanoseconds per message, and
+// cycles per payload byte. The ciphers are the entries of link_ciphers (linkcipher.h).
+
+typedef struct
+{
+    double key_setup[2]; // cycles, ns (p50)
+    double iv_setup[2];
+    double single[MAVLINK_MAX_PAYLOAD + 1][2];
+    double batched[MAVLINK_MAX_PAYLOAD + 1][2];
+} cipher_result_t;
+
+static unsigned char bench_key[LINK_MAX_KEY], bench_iv[LINK_MAX_IV], plaintext[MAVLINK_MAX_PAYLOAD], ciphertext[MAVLINK_MAX_PAYLOAD + 64];
+
+static double median(double *values, unsigned int n)
+{
+    qsort(values, n, sizeof(double), Bench_CompareDouble);
+    return values[Bench_Rank(n, 50)];
+}
+
+// What one timed call does
+#define OP_KEY_SETUP 0
+#define OP_IV_SETUP 1
+#define OP_SINGLE 2
+#define OP_BATCHED 3
+
+static void measure(const cipher_t *cipher, cipher_ctx_t *ctx, int op, unsigned int length, unsigned int inner, unsigned int warmup, unsigned int samples, double *cycles, double *ns, double *out)
+{ // p50 per call of cycles and nanoseconds over the samples, inner calls each
+    unsigned int i, j;
+    uint64_t c0, c1, t0, t1;
+
+    cipher->keysetup(ctx, bench_key);
+    cipher->ivsetup(ctx, bench_iv);
+    for (i = 0; i < warmup + samples; i++)
+    {
+        t0 = Bench_Now(CLOCK_MONOTONIC);
+        c0 = Bench_Cycles();
+        for (j = 0; j < inner; j++)
+        {
+            switch (op)
+            {
+            case OP_KEY_SETUP:
+                cipher->keysetup(ctx, bench_key);
+                break;
+            case OP_IV_SETUP:
+                cipher->ivsetup(ctx, bench_iv);
+                break;
+            case OP_SINGLE:
+                cipher->ivsetup(ctx, bench_iv);
+                cipher->encrypt(ctx, plaintext, ciphertext, length);
+                break;
+            default:
+                cipher->encrypt(ctx, plaintext, ciphertext, length);
+            }
+        }
+        c1 = Bench_Cycles();
+        t1 = Bench_Now(CLOCK_MONOTONIC);
+        if (i >= warmup)
+        {
+            cycles[i - warmup] = (double)(c1 - c0) / inner;
+            ns[i - warmup] = (double)(t1 - t0) / inner;
+        }
+    }
+    out[0] = median(cycles, samples);
+    out[1] = median(ns, samples);
+}
+
+static void cipher_run(const cipher_t *cipher, unsigned int inner, unsigned int warmup, unsigned int samples, unsigned int step, cipher_result_t *result)
+{
+    static cipher_ctx_t ctx;
+    double *cycles = malloc(samples * sizeof(double)), *ns = malloc(samples * sizeof(double));
+    unsigned int length;
+
+    measure(cipher, &ctx, OP_KEY_SETUP, 0, inner, warmup, samples, cycles, ns, result->key_setup);
+    measure(cipher, &ctx, OP_IV_SETUP, 0, inner, warmup, samples, cycles, ns, result->iv_setup);
+    for (length = 0; length <= MAVLINK_MAX_PAYLOAD; length += step)
+    {
+        measure(cipher, &ctx, OP_SINGLE, length, inner, warmup, samples, cycles, ns, result->single[length]);
+        measure(cipher, &ctx, OP_BATCHED, length, inner, warmup, samples, cycles, ns, result->batched[length]);
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    free(cycles);
+    free(ns);
+}
+
+static void print_cpb(double cycles, unsigned int length)
+{
+    if (length > 0)
+        printf(" %9.2f", cycles / length);
+    else
+        printf(" %9s", "-");
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s [-w warmup] [-n samples] [-i inner] [-s step] [-f filter] [-c cpu] [-o results.csv]\n", name);
+    printf("  -w: untimed samples before measuring (default: 5)\n");
+    printf("  -n: timed samples per measurement (default: 51)\n");
+    printf("  -i: messages per sample, single or batched (default: 16)\n");
+    printf("  -s: payload length step from 0 to %u bytes (default: 1)\n", MAVLINK_MAX_PAYLOAD);
+    printf("  -f: only run ciphers whose name contains the filter\n");
+    printf("  -c: pin the process to one CPU\n");
+    printf("  -o: write every payload length as CSV (plot with benchmark/data/bench.py 3)\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int shown[] = {0, 16, 32, 64, 128, MAVLINK_MAX_PAYLOAD};
+    unsigned int warmup = 5, samples = 51, inner = 16, step = 1, i, j, length;
+    const char *filter = NULL, *csv_path = NULL;
+    static cipher_result_t result;
+    FILE *csv = NULL;
+    int opt, cpu = -1;
+
+    while ((opt = getopt(argc, argv, "w:n:i:s:f:c:o:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            warmup = (unsigned int)atoi(optarg);
+            break;
+        case 'n':
+            samples = (unsigned int)atoi(optarg);
+            break;
+        case 'i':
+            inner = (unsigned int)atoi(optarg);
+            break;
+        case 's':
+            step = (unsigned int)atoi(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (samples == 0 || inner == 0 || step == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    Bench_PinCpu(cpu);
+    if (csv_path != NULL)
+    {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL)
+        {
+            perror(csv_path);
+            return 1;
+        }
+        fprintf(csv, "cipher,bytes,key_setup_cycles,key_setup_ns,iv_setup_cycles,iv_setup_ns,single_cycles,single_ns,single_cpb,batched_cycles,batched_ns,batched_cpb\n");
+    }
+
+    random_bytes(bench_key, sizeof(bench_key));
+    random_bytes(bench_iv, sizeof(bench_iv));
+    random_bytes(plaintext, sizeof(plaintext));
+    printf("%-16s %6s %10s %10s %12s %9s %12s %9s\n", "cipher", "bytes", "key setup", "iv setup", "single cyc", "cyc/B", "batched cyc", "cyc/B");
+    for (i = 0; i < LINK_CIPHERS; i++)
+    {
+        const cipher_t *cipher = &link_ciphers[i];
+
+        if (filter != NULL && strstr(cipher->name, filter) == NULL)
+            continue;
+        cipher_run(cipher, inner, warmup, samples, step, &result);
+        for (j = 0; j < sizeof(shown) / sizeof(shown[0]); j++)
+        {
+            length = shown[j] - shown[j] % step;
+            if (j > 0 && length == shown[j - 1] - shown[j - 1] % step)
+                continue; // Lengths not measured with this step
+            printf("%-16s %6u", j == 0 ? cipher->name : "", length);
+            if (j == 0)
+                printf(" %10.0f %10.0f", result.key_setup[0], result.iv_setup[0]);
+            else
+                printf(" %10s %10s", "", "");
+            printf(" %12.0f", result.single[length][0]);
+            print_cpb(result.single[length][0], length);
+            printf(" %12.0f", result.batched[length][0]);
+            print_cpb(result.batched[length][0], length);
+            printf("\n");
+        }
+        for (length = 0; csv != NULL && length <= MAVLINK_MAX_PAYLOAD; length += step)
+        {
+            fprintf(csv, "%s,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,", cipher->name, length, result.key_setup[0], result.key_setup[1], result.iv_setup[0], result.iv_setup[1],
+                    result.single[length][0], result.single[length][1]);
+            if (length > 0)
+                fprintf(csv, "%.3f,", result.single[length][0] / length);
+            else
+                fprintf(csv, ",");
+            fprintf(csv, "%.1f,%.1f,", result.batched[length][0], result.batched[length][1]);
+            if (length > 0)
+                fprintf(csv, "%.3f\n", result.batched[length][0] / length);
+            else
+                fprintf(csv, "\n");
+        }
+    }
+
+    if (csv != NULL)
+        fclose(csv);
+    return 0;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#ifndef _ENERGY_H
+#define _ENERGY_H
+/***********************************************************************************
+ * Energy counters (Intel/AMD RAPL) around a measured batch of operations
+ *
+ * Reads the Linux powercap zones (/sys/class/powercap/<zone>/energy_uj), or the
+ * perf "power" PMU (energy-pkg, energy-psys...) where powercap is missing:
+ *
+ *   Energy_Open(&meter);
+ *   Energy_Start(&meter);  ... batch ...  joules = Energy_Stop(&meter, NULL);
+ *
+ * RAPL counts a whole package (or platform), not a process, and updates about
+ * once per millisecond: batches must last tens of milliseconds, and the energy
+ * the package draws idle (Energy_Idle) is subtracted to get the cost of the
+ * operations. Energy_Open returns 0 when no counter can be read (no RAPL,
+ * virtual machine, energy_uj readable by root only, perf_event_paranoid), or
+ * when the counters do not advance; callers then just skip the energy columns.
+ ***********************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define ENERGY_MAX_DOMAINS 8
+#define ENERGY_SOURCE_NONE 0
+#define ENERGY_SOURCE_POWERCAP 1
+#define ENERGY_SOURCE_PERF 2
+#define ENERGY_PROBE_MS 20 // Longest wait for a first counter update
+
+typedef struct
+{
+    int source;
+    unsigned int count;
+    char names[ENERGY_MAX_DOMAINS][32];
+    int fd[ENERGY_MAX_DOMAINS];         // energy_uj (powercap) or perf event
+    uint64_t range[ENERGY_MAX_DOMAINS]; // Wraparound of energy_uj, 0 for perf
+    double scale[ENERGY_MAX_DOMAINS];   // Joules per counter unit
+    uint64_t start[ENERGY_MAX_DOMAINS];
+    unsigned int primary; // Bit mask of the domains summed by Energy_Stop: packages, else the platform
+} energy_meter_t;
+
+static int energy_read_file(const char *path, char *buffer, size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    ssize_t n;
+
+    if (fd < 0)
+        return 0;
+    n = read(fd, buffer, size - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buffer[n] = '\0';
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return 1;
+}
+
+static int energy_read_counter(const energy_meter_t *meter, unsigned int domain, uint64_t *value)
+{
+    char buffer[32];
+    ssize_t n;
+
+    if (meter->source == ENERGY_SOURCE_PERF)
+        return read(meter->fd[domain], value, sizeof(uint64_t)) == sizeof(uint64_t);
+    n = pread(meter->fd[domain], buffer, sizeof(buffer) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buffer[n] = '\0';
+    *value = strtoull(buffer, NULL, 10);
+    return 1;
+}
+
+static void energy_open_powercap(energy_meter_t *meter)
+{ // Top-level zones and their subzones (core, uncore, dram) whose counter is readable
+    char path[300], name[32], range[32];
+    glob_t zones;
+    size_t i;
+    int fd;
+
+    if (glob("/sys/class/powercap/intel-rapl:*", 0, NULL, &zones) != 0)
+        return;
+    for (i = 0; i < zones.gl_pathc && meter->count < ENERGY_MAX_DOMAINS; i++)
+    {
+        snprintf(path, sizeof(path), "%s/name", zones.gl_pathv[i]);
+        if (!energy_read_file(path, name, sizeof(name)))
+            continue;
+        snprintf(path, sizeof(path), "%s/max_energy_range_uj", zones.gl_pathv[i]);
+        if (!energy_read_file(path, range, sizeof(range)))
+            continue;
+        snprintf(path, sizeof(path), "%s/energy_uj", zones.gl_pathv[i]);
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+            continue;
+        snprintf(meter->names[meter->count], sizeof(meter->names[0]), "%s", name);
+        meter->fd[meter->count] = fd;
+        meter->range[meter->count] = strtoull(range, NULL, 10);
+        meter->scale[meter->count] = 1e-6;
+        if (strncmp(name, "package", 7) == 0)
+            meter->primary |= 1u << meter->count;
+        meter->count++;
+    }
+    globfree(&zones);
+    meter->source = meter->count ? ENERGY_SOURCE_POWERCAP : ENERGY_SOURCE_NONE;
+}
+
+static void energy_open_perf(energy_meter_t *meter)
+{ // System-wide events of the power PMU, counted on CPU 0 (one package)
+    static const char *events[] = {"energy-pkg", "energy-cores", "energy-gpu", "energy-ram", "energy-psys"};
+    char path[128], buffer[64];
+    struct perf_event_attr attr;
+    unsigned int i;
+    unsigned long long config;
+    int type, fd;
+
+    if (!energy_read_file("/sys/bus/event_source/devices/power/type", buffer, sizeof(buffer)))
+        return;
+    type = atoi(buffer);
+    for (i = 0; i < sizeof(events) / sizeof(events[0]) && meter->count < ENERGY_MAX_DOMAINS; i++)
+    {
+        snprintf(path, sizeof(path), "/sys/bus/event_source/devices/power/events/%s", events[i]);
+        if (!energy_read_file(path, buffer, sizeof(buffer)) || sscanf(buffer, "event=%llx", &config) != 1)
+            continue;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = (uint32_t)type;
+        attr.config = config;
+        fd = (int)syscall(SYS_perf_event_open, &attr, -1, 0, -1, 0);
+        if (fd < 0)
+            continue;
+        snprintf(path, sizeof(path), "/sys/bus/event_source/devices/power/events/%s.scale", events[i]);
+        meter->scale[meter->count] = energy_read_file(path, buffer, sizeof(buffer)) ? atof(buffer) : 2.3283064365386962890625e-10;
+        snprintf(meter->names[meter->count], sizeof(meter->names[0]), "%s", events[i]);
+        meter->fd[meter->count] = fd;
+        meter->range[meter->count] = 0;
+        if (strcmp(events[i], "energy-pkg") == 0)
+            meter->primary |= 1u << meter->count;
+        meter->count++;
+    }
+    meter->source = meter->count ? ENERGY_SOURCE_PERF : ENERGY_SOURCE_NONE;
+}
+
+void Energy_Close(energy_meter_t *meter)
+{
+    unsigned int i;
+
+    for (i = 0; i < meter->count; i++)
+        close(meter->fd[i]);
+    meter->count = 0;
+    meter->source = ENERGY_SOURCE_NONE;
+}
+
+void Energy_Start(energy_meter_t *meter)
+{
+    unsigned int i;
+
+    for (i = 0; i < meter->count; i++)
+    {
+        if (!energy_read_counter(meter, i, &meter->start[i]))
+            meter->start[i] = 0;
+    }
+}
+
+// Joules since Energy_Start, per domain in joules (if not NULL) and summed over the primary domains
+double Energy_Stop(energy_meter_t *meter, double *joules)
+{
+    uint64_t value, delta;
+    double total = 0, domain;
+    unsigned int i;
+
+    for (i = 0; i < meter->count; i++)
+    {
+        domain = 0;
+        if (energy_read_counter(meter, i, &value))
+        {
+            delta = value >= meter->start[i] ? value - meter->start[i] : value + meter->range[i] - meter->start[i];
+            domain = delta * meter->scale[i];
+        }
+        if (joules != NULL)
+            joules[i] = domain;
+        if (meter->primary & (1u << i))
+            total += domain;
+    }
+    return total;
+}
+
+// Open the energy counters, returns the number of domains (0: energy cannot be measured)
+unsigned int Energy_Open(energy_meter_t *meter)
+{
+    struct timespec pause = {0, 1000000};
+    unsigned int i;
+
+    memset(meter, 0, sizeof(energy_meter_t));
+    energy_open_powercap(meter);
+    if (meter->count == 0)
+        energy_open_perf(meter);
+    if (meter->count == 0)
+        return 0;
+    if (meter->primary == 0)
+        meter->primary = 1u << (meter->count - 1); // Platform (psys) or the only domain
+
+    // Virtual machines expose the counters but never update them
+    Energy_Start(meter);
+    for (i = 0; i < ENERGY_PROBE_MS; i++)
+    {
+        nanosleep(&pause, NULL);
+        if (Energy_Stop(meter, NULL) > 0)
+            return meter->count;
+    }
+    Energy_Close(meter);
+    return 0;
+}
+
+const char *Energy_Source(const energy_meter_t *meter)
+{
+    return meter->source == ENERGY_SOURCE_POWERCAP ? "powercap" : meter->source == ENERGY_SOURCE_PERF ? "perf power PMU" : "none";
+}
+
+// Power drawn while the process sleeps for ms milliseconds, in watts
+double Energy_Idle(energy_meter_t *meter, unsigned int ms)
+{
+    struct timespec pause = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+
+    Energy_Start(meter);
+    nanosleep(&pause, NULL);
+    return Energy_Stop(meter, NULL) * 1000.0 / ms;
+}
+#endif
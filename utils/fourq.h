@@ -13,6 +13,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#ifdef FOURQ_THREADS
+#include <pthread.h>
+#endif
 
 /***********************************************************************************
  *					                  FourQ                                        *
@@ -63,6 +66,10 @@ typedef int64_t sdigit_t; // Signed 64-bit digit
 // Basic parameters for double scalar multiplication
 #define WP_DOUBLEBASE 8 // Memory requirement: 24KB (storage for 256 points).
 #define WQ_DOUBLEBASE 4
+#define WQ_PREPARED 6 // Window for prepared public keys. Memory requirement: 8KB per key (storage for 64 points).
+
+// Basic parameters for batch key generation
+#define KEYGEN_BATCH_SIZE 32 // Points normalized with a single inversion. Memory requirement: 6KB of stack.
 
 // FourQ's basic element definitions and point representations
 
@@ -158,6 +165,8 @@ typedef uint64_t uint128_t[2];
 
 #define NPOINTS_DOUBLEMUL_WQ (1 << (WQ_DOUBLEBASE - 2))
 
+#define NPOINTS_PREPARED (1 << (WQ_PREPARED - 2))
+
 // FourQ's point representations
 
 typedef struct
@@ -182,6 +191,12 @@ typedef struct
 
 typedef point_extproj_precomp point_extproj_precomp_t[1];
 
+typedef struct
+{
+    unsigned char PublicKey[32];                            // Encoded public key A
+    point_extproj_precomp_t Q_tables[4 * NPOINTS_PREPARED]; // Odd multiples of A, Phi(A), Psi(A) and Phi(Psi(A))
+} schnorrq_prepared_key_t; // SchnorrQ public key prepared for repeated signature verifications.
+
 typedef struct
 {
     f2elm_t xy;
@@ -283,6 +298,43 @@ static unsigned int is_digit_lessthan_ct(digit_t x, digit_t y)
     fp2copy1271((Q)->yx, (P)->yx);       \
     fp2copy1271((Q)->t2, (P)->t2);
 
+// Operation counters (build with FOURQ_OPCOUNT)
+// Per-thread counts of field operations, constant-time table lookups and point operations, used to compare
+// algorithm and window-size choices with a machine-independent metric. fpadd counts additions and subtractions,
+// fpmul does not include squarings, and fpinv counts GF(p) inversions (their internal squarings and
+// multiplications are counted too). Without FOURQ_OPCOUNT the counters compile to nothing.
+
+typedef struct
+{
+    uint64_t fpmul;
+    uint64_t fpsqr;
+    uint64_t fpadd;
+    uint64_t fpinv;
+    uint64_t table_lookup;
+    uint64_t point_double;
+    uint64_t point_add;
+} fourq_opcount_t;
+
+#ifdef FOURQ_OPCOUNT
+static __thread fourq_opcount_t fourq_opcount;
+
+#define OPCOUNT(counter) (fourq_opcount.counter++)
+#define OPCOUNT_SUB(counter) (fourq_opcount.counter--)
+
+void FourQ_OpCountReset(void)
+{ // Reset the counters of the calling thread
+    memset(&fourq_opcount, 0, sizeof(fourq_opcount_t));
+}
+
+void FourQ_OpCountSnapshot(fourq_opcount_t *counts)
+{ // Copy the counters of the calling thread
+    memmove(counts, &fourq_opcount, sizeof(fourq_opcount_t));
+}
+#else
+#define OPCOUNT(counter) ((void)0)
+#define OPCOUNT_SUB(counter) ((void)0)
+#endif
+
 /***********************************************************************************
  *                                   HEADER                                        *
  ***********************************************************************************/
@@ -327,6 +379,7 @@ void fpsqr1271(felm_t a, felm_t c);
 
 // Field inversion, af = a^-1 = a^(p-2) mod p
 void fpinv1271(felm_t a);
+void fpinv1271_vartime(felm_t a);
 
 // Exponentiation over GF(p), af = a^(125-1)
 void fpexp1251(felm_t a, felm_t af);
@@ -361,11 +414,13 @@ void fp2sqr1271_a(f2elm_t a, f2elm_t c);
 
 // Quadratic extension field inversion, af = a^-1 = a^(p-2) in GF((2^127-1)^2)
 void fp2inv1271(f2elm_t a);
+void fp2inv1271_vartime(f2elm_t a);
 
 /************ Curve and recoding functions *************/
 
 // Normalize projective twisted Edwards point Q = (X,Y,Z) -> P = (x,y)
 void eccnorm(point_extproj_t P, point_t Q);
+void eccnorm_vartime(point_extproj_t P, point_t Q);
 
 // Conversion from representation (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT), where T = Ta*Tb
 void R1_to_R2(point_extproj_t P, point_extproj_precomp_t Q);
@@ -556,6 +611,7 @@ void fpadd1271(felm_t a, felm_t b, felm_t c)
     unsigned int i;
     unsigned int carry = 0;
 
+    OPCOUNT(fpadd);
     for (i = 0; i < NWORDS_FIELD; i++)
     {
         ADDC(carry, a[i], b[i], carry, c[i]);
@@ -573,6 +629,7 @@ void fpsub1271(felm_t a, felm_t b, felm_t c)
     unsigned int i;
     unsigned int borrow = 0;
 
+    OPCOUNT(fpadd);
     for (i = 0; i < NWORDS_FIELD; i++)
     {
         SUBC(borrow, a[i], b[i], borrow, c[i]);
@@ -604,6 +661,7 @@ void fpmul1271(felm_t a, felm_t b, felm_t c)
     digit_t t[2 * NWORDS_FIELD] = {0};
     unsigned int carry = 0;
 
+    OPCOUNT(fpmul);
     for (i = 0; i < NWORDS_FIELD; i++)
     {
         u = 0;
@@ -639,6 +697,8 @@ void fpmul1271(felm_t a, felm_t b, felm_t c)
 void fpsqr1271(felm_t a, felm_t c)
 { // Field squaring using schoolbook method, c = a^2 mod p
 
+    OPCOUNT(fpsqr);
+    OPCOUNT_SUB(fpmul);
     fpmul1271(a, a, c);
 }
 
@@ -748,12 +808,71 @@ void fpinv1271(felm_t a)
     // Hardcoded for p = 2^127-1
     felm_t t;
 
+    OPCOUNT(fpinv);
     fpexp1251(a, t);
     fpsqr1271(t, t);
     fpsqr1271(t, t);
     fpmul1271(a, t, a);
 }
 
+void fpinv1271_vartime(felm_t a)
+{ // Field inversion using the binary extended Euclidean algorithm, af = a^-1 mod p
+    // Output is fully reduced. Zero is mapped to zero, as in fpinv1271().
+    // SECURITY NOTE: this function does not run in constant time (input "a" is assumed to be public).
+    felm_t u, v, x1, x2;
+
+    OPCOUNT(fpinv);
+    mod1271(a);
+    if (a[0] == 0 && a[1] == 0)
+    {
+        return;
+    }
+
+    fpcopy1271(a, u); // u = a, x1 = 1
+    fpzero1271(x1);
+    x1[0] = 1;
+    v[0] = prime1271_0; // v = p, x2 = 0
+    v[1] = prime1271_1;
+    fpzero1271(x2);
+
+    // Invariants: x1*a = u and x2*a = v (mod p)
+    while ((u[0] != 1 || u[1] != 0) && (v[0] != 1 || v[1] != 0))
+    {
+        while ((u[0] & 1) == 0)
+        {
+            SHIFTR(u[1], u[0], 1, u[0], RADIX);
+            u[1] >>= 1;
+            fpdiv1271(x1);
+        }
+        while ((v[0] & 1) == 0)
+        {
+            SHIFTR(v[1], v[0], 1, v[0], RADIX);
+            v[1] >>= 1;
+            fpdiv1271(x2);
+        }
+        if (u[1] > v[1] || (u[1] == v[1] && u[0] >= v[0]))
+        {
+            subtract(u, v, u, NWORDS_FIELD);
+            fpsub1271(x1, x2, x1);
+        }
+        else
+        {
+            subtract(v, u, v, NWORDS_FIELD);
+            fpsub1271(x2, x1, x2);
+        }
+    }
+
+    if (u[0] == 1 && u[1] == 0)
+    {
+        fpcopy1271(x1, a);
+    }
+    else
+    {
+        fpcopy1271(x2, a);
+    }
+    mod1271(a);
+}
+
 static void multiply(const digit_t *a, const digit_t *b, digit_t *c)
 { // Schoolbook multiprecision multiply, c = a*b
 
@@ -929,6 +1048,7 @@ void table_lookup_1x8(point_extproj_precomp_t *table, point_extproj_precomp_t P,
     unsigned int i, j;
     digit_t mask;
 
+    OPCOUNT(table_lookup);
     ecccopy_precomp(table[0], point); // point = table[0]
 
     for (i = 1; i < 8; i++)
@@ -976,6 +1096,7 @@ void table_lookup_fixed_base(point_precomp_t *table, point_precomp_t P, unsigned
     unsigned int i, j;
     digit_t mask;
 
+    OPCOUNT(table_lookup);
     ecccopy_precomp_fixed_base(table[0], point); // point = table[0]
 
     for (i = 1; i < VPOINTS_FIXEDBASE; i++)
@@ -1123,6 +1244,20 @@ void fp2inv1271(f2elm_t a)
 #endif
 }
 
+void fp2inv1271_vartime(f2elm_t a)
+{ // GF(p^2) inversion, a = (a0-i*a1)/(a0^2+a1^2)
+    // SECURITY NOTE: this function does not run in constant time (input "a" is assumed to be public).
+    felm_t t1, t2;
+
+    fpsqr1271(a[0], t1);       // t1 = a0^2
+    fpsqr1271(a[1], t2);       // t2 = a1^2
+    fpadd1271(t1, t2, t1);     // t1 = a0^2+a1^2
+    fpinv1271_vartime(t1);     // t1 = (a0^2+a1^2)^-1
+    fpneg1271(a[1]);           // a = a0-i*a1
+    fpmul1271(a[0], t1, a[0]);
+    fpmul1271(a[1], t1, a[1]); // a = (a0-i*a1)*(a0^2+a1^2)^-1
+}
+
 void clear_words(void *mem, unsigned int nwords)
 { // Clear integer-size digits from memory. "nwords" indicates the number of integer digits to be zeroed.
     // This function uses the volatile type qualifier to inform the compiler not to optimize out the memory clearing.
@@ -1160,6 +1295,21 @@ void eccnorm(point_extproj_t P, point_t Q)
     mod1271(Q->y[1]);
 }
 
+void eccnorm_vartime(point_extproj_t P, point_t Q)
+{ // Normalize a projective point (X1:Y1:Z1), including full reduction, using a variable-time inversion
+    // Input: P = (X1:Y1:Z1) in twisted Edwards coordinates
+    // Output: Q = (X1/Z1,Y1/Z1), corresponding to (X1:Y1:Z1:T1) in extended twisted Edwards coordinates
+    // SECURITY NOTE: this function does not run in constant time (input point P is assumed to be public).
+
+    fp2inv1271_vartime(P->z);     // Z1 = Z1^-1
+    fp2mul1271(P->x, P->z, Q->x); // X1 = X1/Z1
+    fp2mul1271(P->y, P->z, Q->y); // Y1 = Y1/Z1
+    mod1271(Q->x[0]);
+    mod1271(Q->x[1]);
+    mod1271(Q->y[0]);
+    mod1271(Q->y[1]);
+}
+
 void R1_to_R2(point_extproj_t P, point_extproj_precomp_t Q)
 { // Conversion from representation (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT), where T = Ta*Tb
     // Input:  P = (X1,Y1,Z1,Ta,Tb), where T1 = Ta*Tb, corresponding to (X1:Y1:Z1:T1) in extended twisted Edwards coordinates
@@ -1201,6 +1351,7 @@ void eccdouble(point_extproj_t P)
     //         corresponding to (Xfinal:Yfinal:Zfinal:Tfinal) in extended twisted Edwards coordinates
     f2elm_t t1, t2;
 
+    OPCOUNT(point_double);
     fp2sqr1271(P->x, t1);            // t1 = X1^2
     fp2sqr1271(P->y, t2);            // t2 = Y1^2
     fp2add1271(P->x, P->y, P->x);    // t3 = X1+Y1
@@ -1227,6 +1378,7 @@ void eccadd_core(point_extproj_precomp_t P, point_extproj_precomp_t Q, point_ext
     //         corresponding to (Xfinal:Yfinal:Zfinal:Tfinal) in extended twisted Edwards coordinates
     f2elm_t t1, t2;
 
+    OPCOUNT(point_add);
     fp2mul1271(P->t2, Q->t2, R->z); // Z = 2dT1*T2
     fp2mul1271(P->z2, Q->z2, t1);   // t1 = 2Z1*Z2
     fp2mul1271(P->xy, Q->xy, R->x); // X = (X1+Y1)(X2+Y2)
@@ -1331,6 +1483,7 @@ static void eccmadd(point_precomp_t Q, point_extproj_t P)
     //         corresponding to (Xfinal:Yfinal:Zfinal:Tfinal) in extended twisted Edwards coordinates
     f2elm_t t1, t2;
 
+    OPCOUNT(point_add);
     fp2mul1271(P->ta, P->tb, P->ta); // Ta = T1
     fp2add1271(P->z, P->z, t1);      // t1 = 2Z1
     fp2mul1271(P->ta, Q->t2, P->ta); // Ta = 2dT1*t2
@@ -1412,16 +1565,15 @@ void mLSB_set_recode(uint64_t *scalar, unsigned int *digits)
     return;
 }
 
-bool ecc_mul_fixed(digit_t *k, point_t Q)
-{ // Fixed-base scalar multiplication Q = k*G, where G is the generator. FIXED_BASE_TABLE stores v*2^(w-1) = 80 multiples of G.
+static void ecc_mul_fixed_extproj(digit_t *k, point_extproj_t R)
+{ // Fixed-base scalar multiplication R = k*G, where G is the generator. FIXED_BASE_TABLE stores v*2^(w-1) = 80 multiples of G.
     // Inputs: scalar "k" in [0, 2^256-1].
-    // Output: Q = k*G in affine coordinates (x,y).
+    // Output: R = k*G in representation (X,Y,Z,Ta,Tb), without normalization.
     // The function is based on the modified LSB-set comb method, which converts the scalar to an odd signed representation
     // with (bitlength(order)+w*v) digits.
     unsigned int j, w = W_FIXEDBASE, v = V_FIXEDBASE, d = D_FIXEDBASE, e = E_FIXEDBASE;
     unsigned int digit = 0, digits[NBITS_ORDER_PLUS_ONE + (W_FIXEDBASE * V_FIXEDBASE) - 1] = {0};
     digit_t temp[NWORDS_ORDER];
-    point_extproj_t R;
     point_precomp_t S;
     int i, ii;
 
@@ -1466,11 +1618,24 @@ bool ecc_mul_fixed(digit_t *k, point_t Q)
             eccmadd(S, R); // R = R+S using representations (X,Y,Z,Ta,Tb) <- (X,Y,Z,Ta,Tb) + (x+y,y-x,2dt)
         }
     }
-    eccnorm(R, Q); // Conversion to affine coordinates (x,y) and modular correction.
 
 #ifdef TEMP_ZEROING
     clear_words((void *)digits, NBITS_ORDER_PLUS_ONE + (W_FIXEDBASE * V_FIXEDBASE) - 1);
     clear_words((void *)S, sizeof(point_precomp_t) / sizeof(unsigned int));
+#endif
+}
+
+bool ecc_mul_fixed(digit_t *k, point_t Q)
+{ // Fixed-base scalar multiplication Q = k*G, where G is the generator.
+    // Inputs: scalar "k" in [0, 2^256-1].
+    // Output: Q = k*G in affine coordinates (x,y).
+    point_extproj_t R;
+
+    ecc_mul_fixed_extproj(k, R);
+    eccnorm(R, Q); // Conversion to affine coordinates (x,y) and modular correction.
+
+#ifdef TEMP_ZEROING
+    clear_words((void *)R, sizeof(point_extproj_t) / sizeof(unsigned int));
 #endif
     return true;
 }
@@ -1496,30 +1661,13 @@ static void eccneg_precomp(point_precomp_t P, point_precomp_t Q)
     fp2neg1271(Q->t2);
 }
 
-bool ecc_mul_double(digit_t *k, point_t Q, digit_t *l, point_t R)
-{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator. Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G)).
-    // Inputs: point Q in affine coordinates,
-    //         scalars "k" and "l" in [0, 2^256-1].
-    // Output: R = k*G + l*Q in affine coordinates (x,y).
-    // The function uses wNAF with interleaving.
-
-    // SECURITY NOTE: this function is intended for a non-constant-time operation such as signature verification.
-
-    unsigned int position;
-    int i, digits_k1[65] = {0}, digits_k2[65] = {0}, digits_k3[65] = {0}, digits_k4[65] = {0};
-    int digits_l1[65] = {0}, digits_l2[65] = {0}, digits_l3[65] = {0}, digits_l4[65] = {0};
-    point_precomp_t V;
-    point_extproj_t Q1, Q2, Q3, Q4, T;
-    point_extproj_precomp_t U, Q_table1[NPOINTS_DOUBLEMUL_WQ], Q_table2[NPOINTS_DOUBLEMUL_WQ], Q_table3[NPOINTS_DOUBLEMUL_WQ], Q_table4[NPOINTS_DOUBLEMUL_WQ];
-    uint64_t k_scalars[4], l_scalars[4];
+static void ecc_precomp_endomorphisms(point_t Q, point_extproj_precomp_t *Q_tables, unsigned int npoints)
+{ // Precomputed tables of odd multiples of Q, Phi(Q), Psi(Q) and Phi(Psi(Q)), "npoints" points each, stored one after the other
+    // Input: point Q in affine coordinates, already validated
+    point_extproj_t Q1, Q2, Q3, Q4;
 
     point_setup(Q, Q1); // Convert to representation (X,Y,1,Ta,Tb)
 
-    if (ecc_point_validate(Q1) == false)
-    { // Check if point lies on the curve
-        return false;
-    }
-
     // Computing endomorphisms over point Q
     ecccopy(Q1, Q2);
     ecc_phi(Q2);
@@ -1528,20 +1676,33 @@ bool ecc_mul_double(digit_t *k, point_t Q, digit_t *l, point_t R)
     ecccopy(Q2, Q4);
     ecc_psi(Q4);
 
+    ecc_precomp_double(Q1, Q_tables, npoints); // Precomputation
+    ecc_precomp_double(Q2, Q_tables + npoints, npoints);
+    ecc_precomp_double(Q3, Q_tables + 2 * npoints, npoints);
+    ecc_precomp_double(Q4, Q_tables + 3 * npoints, npoints);
+}
+
+static void ecc_mul_double_tables(digit_t *k, point_extproj_precomp_t *Q_tables, unsigned int wq, digit_t *l, point_t R)
+{ // Double scalar multiplication R = k*G + l*Q with the tables of Q computed by ecc_precomp_endomorphisms() with window "wq"
+    // SECURITY NOTE: this function is intended for a non-constant-time operation such as signature verification.
+    unsigned int position, npoints = 1 << (wq - 2);
+    int i, top, digits_k1[65] = {0}, digits_k2[65] = {0}, digits_k3[65] = {0}, digits_k4[65] = {0};
+    int digits_l1[65] = {0}, digits_l2[65] = {0}, digits_l3[65] = {0}, digits_l4[65] = {0};
+    point_precomp_t V;
+    point_extproj_t T;
+    point_extproj_precomp_t U, *Q_table1 = Q_tables, *Q_table2 = Q_tables + npoints, *Q_table3 = Q_tables + 2 * npoints, *Q_table4 = Q_tables + 3 * npoints;
+    uint64_t k_scalars[4], l_scalars[4];
+
     decompose((uint64_t *)k, k_scalars); // Scalar decomposition
     decompose((uint64_t *)l, l_scalars);
     wNAF_recode(k_scalars[0], WP_DOUBLEBASE, digits_k1); // Scalar recoding
     wNAF_recode(k_scalars[1], WP_DOUBLEBASE, digits_k2);
     wNAF_recode(k_scalars[2], WP_DOUBLEBASE, digits_k3);
     wNAF_recode(k_scalars[3], WP_DOUBLEBASE, digits_k4);
-    wNAF_recode(l_scalars[0], WQ_DOUBLEBASE, digits_l1);
-    wNAF_recode(l_scalars[1], WQ_DOUBLEBASE, digits_l2);
-    wNAF_recode(l_scalars[2], WQ_DOUBLEBASE, digits_l3);
-    wNAF_recode(l_scalars[3], WQ_DOUBLEBASE, digits_l4);
-    ecc_precomp_double(Q1, Q_table1, NPOINTS_DOUBLEMUL_WQ); // Precomputation
-    ecc_precomp_double(Q2, Q_table2, NPOINTS_DOUBLEMUL_WQ);
-    ecc_precomp_double(Q3, Q_table3, NPOINTS_DOUBLEMUL_WQ);
-    ecc_precomp_double(Q4, Q_table4, NPOINTS_DOUBLEMUL_WQ);
+    wNAF_recode(l_scalars[0], wq, digits_l1);
+    wNAF_recode(l_scalars[1], wq, digits_l2);
+    wNAF_recode(l_scalars[2], wq, digits_l3);
+    wNAF_recode(l_scalars[3], wq, digits_l4);
 
     fp2zero1271(T->x); // Initialize T as the neutral point (0:1:1)
     fp2zero1271(T->y);
@@ -1549,7 +1710,16 @@ bool ecc_mul_double(digit_t *k, point_t Q, digit_t *l, point_t R)
     fp2zero1271(T->z);
     T->z[0][0] = 1;
 
-    for (i = 64; i >= 0; i--)
+    for (top = 64; top >= 0; top--)
+    { // Skip the leading all-zero digit columns, which would only double the neutral point
+        if ((digits_k1[top] | digits_k2[top] | digits_k3[top] | digits_k4[top] |
+             digits_l1[top] | digits_l2[top] | digits_l3[top] | digits_l4[top]) != 0)
+        {
+            break;
+        }
+    }
+
+    for (i = top; i >= 0; i--)
     {
         eccdouble(T); // Double (X_T,Y_T,Z_T,Ta_T,Tb_T) = 2(X_T,Y_T,Z_T,Ta_T,Tb_T)
         if (digits_l1[i] < 0)
@@ -1643,11 +1813,163 @@ bool ecc_mul_double(digit_t *k, point_t Q, digit_t *l, point_t R)
         }
     }
 
-    eccnorm(T, R); // Output R = (x,y)
+    eccnorm_vartime(T, R); // Output R = (x,y)
+}
+
+bool ecc_mul_double_vartime(digit_t *k, point_t Q, digit_t *l, point_t R)
+{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator. Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G)).
+    // Inputs: point Q in affine coordinates,
+    //         scalars "k" and "l" in [0, 2^256-1].
+    // Output: R = k*G + l*Q in affine coordinates (x,y).
+    // The function uses wNAF with interleaving. The main loop starts at the most significant nonzero digit and
+    // the output is normalized with a variable-time inversion.
+
+    // SECURITY NOTE: this function is intended for a non-constant-time operation such as signature verification.
+
+    point_extproj_t Q1;
+    point_extproj_precomp_t Q_tables[4 * NPOINTS_DOUBLEMUL_WQ];
+
+    point_setup(Q, Q1); // Convert to representation (X,Y,1,Ta,Tb)
+
+    if (ecc_point_validate(Q1) == false)
+    { // Check if point lies on the curve
+        return false;
+    }
+
+    ecc_precomp_endomorphisms(Q, Q_tables, NPOINTS_DOUBLEMUL_WQ);
+    ecc_mul_double_tables(k, Q_tables, WQ_DOUBLEBASE, l, R);
 
     return true;
 }
 
+bool ecc_mul_double(digit_t *k, point_t Q, digit_t *l, point_t R)
+{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator.
+    // SECURITY NOTE: this function does not run in constant time, see ecc_mul_double_vartime().
+
+    return ecc_mul_double_vartime(k, Q, l, R);
+}
+
+bool ecc_mul_multi_vartime(digit_t *k, point_t *Q, digit_t *l, unsigned int npoints, point_t R)
+{ // Multi-scalar multiplication R = k*G + l[0]*Q[0] + ... + l[npoints-1]*Q[npoints-1], where G is the generator.
+    // Generalization of ecc_mul_double_vartime() to "npoints" variable bases. All the terms share the same 65 doublings.
+    // Inputs: points Q[i] in affine coordinates,
+    //         scalar "k" and scalars l[i] (stored in "l" with stride NWORDS_ORDER) in [0, 2^256-1].
+    // Output: R = k*G + sum l[i]*Q[i] in affine coordinates (x,y). Returns false if a point is not on the curve or memory allocation fails.
+    // SECURITY NOTE: this function is intended for a non-constant-time operation such as signature verification.
+    unsigned int j, m, position;
+    int i, top, digits_k[4][65] = {{0}};
+    int(*digits_l)[4][65] = NULL;
+    point_extproj_precomp_t(*Q_table)[4][NPOINTS_DOUBLEMUL_WQ] = NULL;
+    point_precomp_t V;
+    point_extproj_t P[4], T;
+    point_extproj_precomp_t U;
+    uint64_t scalars[4];
+    bool result = false;
+
+    digits_l = (int(*)[4][65])calloc(npoints, sizeof(*digits_l));
+    Q_table = (point_extproj_precomp_t(*)[4][NPOINTS_DOUBLEMUL_WQ])calloc(npoints, sizeof(*Q_table));
+    if (digits_l == NULL || Q_table == NULL)
+    {
+        goto cleanup;
+    }
+
+    decompose((uint64_t *)k, scalars); // Scalar decomposition and recoding for the fixed base
+    for (m = 0; m < 4; m++)
+    {
+        wNAF_recode(scalars[m], WP_DOUBLEBASE, digits_k[m]);
+    }
+
+    for (j = 0; j < npoints; j++)
+    {
+        point_setup(Q[j], P[0]); // Convert to representation (X,Y,1,Ta,Tb)
+        if (ecc_point_validate(P[0]) == false)
+        { // Check if point lies on the curve
+            goto cleanup;
+        }
+
+        // Computing endomorphisms over point Q[j]
+        ecccopy(P[0], P[1]);
+        ecc_phi(P[1]);
+        ecccopy(P[0], P[2]);
+        ecc_psi(P[2]);
+        ecccopy(P[1], P[3]);
+        ecc_psi(P[3]);
+
+        decompose((uint64_t *)(l + j * NWORDS_ORDER), scalars);
+        for (m = 0; m < 4; m++)
+        {
+            wNAF_recode(scalars[m], WQ_DOUBLEBASE, digits_l[j][m]);
+            ecc_precomp_double(P[m], Q_table[j][m], NPOINTS_DOUBLEMUL_WQ);
+        }
+    }
+
+    fp2zero1271(T->x); // Initialize T as the neutral point (0:1:1)
+    fp2zero1271(T->y);
+    T->y[0][0] = 1;
+    fp2zero1271(T->z);
+    T->z[0][0] = 1;
+
+    for (top = 64; top >= 0; top--)
+    { // Skip the leading all-zero digit columns
+        int column = digits_k[0][top] | digits_k[1][top] | digits_k[2][top] | digits_k[3][top];
+        for (j = 0; j < npoints && column == 0; j++)
+        {
+            column = digits_l[j][0][top] | digits_l[j][1][top] | digits_l[j][2][top] | digits_l[j][3][top];
+        }
+        if (column != 0)
+        {
+            break;
+        }
+    }
+
+    for (i = top; i >= 0; i--)
+    {
+        eccdouble(T); // Double (X_T,Y_T,Z_T,Ta_T,Tb_T) = 2(X_T,Y_T,Z_T,Ta_T,Tb_T)
+        for (j = 0; j < npoints; j++)
+        {
+            for (m = 0; m < 4; m++)
+            {
+                if (digits_l[j][m][i] < 0)
+                {
+                    position = (-digits_l[j][m][i]) / 2;
+                    eccneg_extproj_precomp(Q_table[j][m][position], U); // Load and negate U from the precomputed table
+                    eccadd(U, T);                                       // T = T+U
+                }
+                else if (digits_l[j][m][i] > 0)
+                {
+                    position = (digits_l[j][m][i]) / 2;
+                    eccadd(Q_table[j][m][position], T); // T = T+U
+                }
+            }
+        }
+        for (m = 0; m < 4; m++)
+        {
+            if (digits_k[m][i] < 0)
+            {
+                position = (-digits_k[m][i]) / 2;
+                eccneg_precomp(((point_precomp_t *)&DOUBLE_SCALAR_TABLE)[m * NPOINTS_DOUBLEMUL_WP + position], V); // Load and negate V from the fixed-base table
+                eccmadd(V, T);                                                                                     // T = T+V
+            }
+            else if (digits_k[m][i] > 0)
+            {
+                position = (digits_k[m][i]) / 2;
+                eccmadd(((point_precomp_t *)&DOUBLE_SCALAR_TABLE)[m * NPOINTS_DOUBLEMUL_WP + position], T); // T = T+V
+            }
+        }
+    }
+
+    eccnorm_vartime(T, R); // Output R = (x,y)
+    result = true;
+
+cleanup:
+    if (digits_l != NULL)
+        free(digits_l);
+    if (Q_table != NULL)
+        free(Q_table);
+
+    return result;
+}
+
 void ecc_precomp_double(point_extproj_t P, point_extproj_precomp_t *Table, unsigned int npoints)
 { // Generation of the precomputation table used internally by the double scalar multiplication function ecc_mul_double().
     // Inputs: point P in representation (X,Y,Z,Ta,Tb),
@@ -2454,7 +2776,7 @@ ECCRYPTO_STATUS SchnorrQ_FullKeyGeneration(unsigned char *SecretKey, unsigned ch
 {
     ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_UNKNOWN;
 
-    Status = RandomBytesFunction(SecretKey, 32);
+    Status = (ECCRYPTO_STATUS)RandomBytesFunction(SecretKey, 32);
     if (Status != ECCRYPTO_SUCCESS)
     {
         goto cleanup;
@@ -2579,9 +2901,9 @@ ECCRYPTO_STATUS SchnorrQ_Verify(const unsigned char *PublicKey, const unsigned c
         goto cleanup;
     }
 
-    Status = ecc_mul_double((digit_t *)(Signature + 32), A, (digit_t *)h, A);
-    if (Status != ECCRYPTO_SUCCESS)
+    if (ecc_mul_double_vartime((digit_t *)(Signature + 32), A, (digit_t *)h, A) == false)
     {
+        Status = ECCRYPTO_ERROR;
         goto cleanup;
     }
 
@@ -2602,6 +2924,376 @@ cleanup:
 
     return Status;
 }
+// SchnorrQ public key preparation
+// Decodes and validates PublicKey once and precomputes its tables with a wider window (WQ_PREPARED), so that
+// every later SchnorrQ_VerifyPrepared() skips the point decompression and the precomputation.
+// Input: 32-byte PublicKey
+// Output: Key
+ECCRYPTO_STATUS SchnorrQ_PrepareKey(const unsigned char *PublicKey, schnorrq_prepared_key_t *Key)
+{
+    point_t A;
+    point_extproj_t A1;
+    ECCRYPTO_STATUS Status;
+
+    if ((PublicKey[15] & 0x80) != 0)
+    { // Is bit128(PublicKey) = 0?
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    Status = decode(PublicKey, A); // Also verifies that A is on the curve. If it is not, it fails
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        return Status;
+    }
+    point_setup(A, A1);
+    if (ecc_point_validate(A1) == false)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    memmove(Key->PublicKey, PublicKey, 32);
+    ecc_precomp_endomorphisms(A, Key->Q_tables, NPOINTS_PREPARED);
+
+    return ECCRYPTO_SUCCESS;
+}
+
+// SchnorrQ signature verification with a prepared public key
+// Same result as SchnorrQ_Verify() with Key->PublicKey
+// Inputs: Key prepared by SchnorrQ_PrepareKey(), 64-byte Signature, and Message of size SizeMessage in bytes
+// Output: true (valid signature) or false (invalid signature)
+ECCRYPTO_STATUS SchnorrQ_VerifyPrepared(const schnorrq_prepared_key_t *Key, const unsigned char *Message, const unsigned int SizeMessage, const unsigned char *Signature, unsigned int *valid)
+{
+    point_t R;
+    unsigned char *temp, h[64];
+    unsigned int i;
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_UNKNOWN;
+
+    *valid = false;
+
+    temp = (unsigned char *)calloc(1, SizeMessage + 64);
+    if (temp == NULL)
+    {
+        Status = ECCRYPTO_ERROR_NO_MEMORY;
+        goto cleanup;
+    }
+
+    if (((Signature[15] & 0x80) != 0) || (Signature[63] != 0) || ((Signature[62] & 0xC0) != 0))
+    { // Are bit128(Signature) = 0 and Signature+32 < 2^246?
+        Status = ECCRYPTO_ERROR_INVALID_PARAMETER;
+        goto cleanup;
+    }
+
+    memmove(temp, Signature, 32);
+    memmove(temp + 32, Key->PublicKey, 32);
+    memmove(temp + 64, Message, SizeMessage);
+
+    if (CryptoHashFunction(temp, SizeMessage + 64, h) != 0)
+    {
+        Status = ECCRYPTO_ERROR;
+        goto cleanup;
+    }
+
+    ecc_mul_double_tables((digit_t *)(Signature + 32), (point_extproj_precomp_t *)Key->Q_tables, WQ_PREPARED, (digit_t *)h, R);
+    Status = ECCRYPTO_SUCCESS;
+
+    encode(R, (unsigned char *)R);
+
+    for (i = 0; i < NWORDS_ORDER; i++)
+    {
+        if (((digit_t *)R)[i] != ((digit_t *)Signature)[i])
+        {
+            goto cleanup;
+        }
+    }
+    *valid = true;
+
+cleanup:
+    if (temp != NULL)
+        free(temp);
+
+    return Status;
+}
+
+/**************** SchnorrQ signature half-aggregation ****************/
+// n signatures (R_i, s_i) on messages M_i under public keys A_i are compressed to (R_1, ..., R_n, s),
+// where s = sum z_i*s_i mod r and z_i are derived from a hash of all (R_i, A_i, h_i), h_i = H(R_i||A_i||M_i).
+// The aggregate is valid iff 392*(s*G + sum z_i*h_i*A_i - sum z_i*R_i) = 0, which is checked with a single
+// multi-scalar multiplication followed by co-factor clearing. R_i and A_i must be canonical encodings of points
+// that are not of small order (392*P != 0), which rejects pure torsion points. A point of the prime-order subgroup
+// plus a small-torsion component still decodes: the clearing removes that component, so such an R_i is accepted
+// here while SchnorrQ_Verify rejects it. Only the holder of the secret key can produce one (malleability of R_i,
+// not a forgery), and a full subgroup check of every R_i would cost more than a verification. An aggregate thus
+// proves that each key signed its message; where every R_i must also pass SchnorrQ_Verify, the aggregator
+// verifies the signatures individually before SchnorrQ_HalfAggregate().
+
+static ECCRYPTO_STATUS SchnorrQ_Challenge(const unsigned char *R, const unsigned char *PublicKey, const unsigned char *Message, const unsigned int SizeMessage, unsigned char *h)
+{ // h = H(R||PublicKey||Message), as computed by SchnorrQ_Sign() and SchnorrQ_Verify()
+    unsigned char *temp;
+    ECCRYPTO_STATUS Status = ECCRYPTO_SUCCESS;
+
+    temp = (unsigned char *)calloc(1, SizeMessage + 64);
+    if (temp == NULL)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+
+    memmove(temp, R, 32);
+    memmove(temp + 32, PublicKey, 32);
+    memmove(temp + 64, Message, SizeMessage);
+
+    if (CryptoHashFunction(temp, SizeMessage + 64, h) != 0)
+    {
+        Status = ECCRYPTO_ERROR;
+    }
+    free(temp);
+
+    return Status;
+}
+
+static ECCRYPTO_STATUS SchnorrQ_DecodeAggregatePoint(const unsigned char *Encoded, point_t P)
+{ // Decode a canonical encoding of a point on the curve that is not of small order
+    point_extproj_t R;
+    point_t T;
+    felm_t y;
+    unsigned char encoded[32];
+    unsigned int i;
+    ECCRYPTO_STATUS Status;
+
+    Status = decode(Encoded, P); // Also verifies that P is on the curve
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        return Status;
+    }
+    for (i = 0; i < 2; i++)
+    { // Both coordinates of y below p
+        fpcopy1271(P->y[i], y);
+        mod1271(y);
+        if (memcmp(y, P->y[i], sizeof(felm_t)) != 0)
+        {
+            return ECCRYPTO_ERROR_INVALID_PARAMETER;
+        }
+    }
+    encode(P, encoded);
+    if (memcmp(encoded, Encoded, 32) != 0)
+    { // Sign bit set for x = 0
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    point_setup(P, R);
+    cofactor_clearing(R);
+    eccnorm_vartime(R, T);
+    if (is_neutral_point(T))
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    return ECCRYPTO_SUCCESS;
+}
+
+static ECCRYPTO_STATUS SchnorrQ_AggregateCoefficients(unsigned int n, const unsigned char *Rs, const unsigned char *PublicKeys, const unsigned char *hs, digit_t *z)
+{ // z_i = H(H(R_1||...||R_n||A_1||...||A_n||h_1||...||h_n)||i) mod r, for i in [0, n-1]
+    unsigned char *transcript, digest[68], h[64];
+    unsigned int i;
+    ECCRYPTO_STATUS Status = ECCRYPTO_SUCCESS;
+
+    transcript = (unsigned char *)calloc(n, 128);
+    if (transcript == NULL)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+
+    memmove(transcript, Rs, 32 * n);
+    memmove(transcript + 32 * n, PublicKeys, 32 * n);
+    memmove(transcript + 64 * n, hs, 64 * n);
+    if (CryptoHashFunction(transcript, 128 * (unsigned long long)n, digest) != 0)
+    {
+        Status = ECCRYPTO_ERROR;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        digest[64] = (unsigned char)i;
+        digest[65] = (unsigned char)(i >> 8);
+        digest[66] = (unsigned char)(i >> 16);
+        digest[67] = (unsigned char)(i >> 24);
+        if (CryptoHashFunction(digest, 68, h) != 0)
+        {
+            Status = ECCRYPTO_ERROR;
+            goto cleanup;
+        }
+        modulo_order((digit_t *)h, z + i * NWORDS_ORDER);
+    }
+
+cleanup:
+    free(transcript);
+
+    return Status;
+}
+
+// SchnorrQ signature half-aggregation
+// It compresses n signatures produced by SchnorrQ_Sign() into a single (n*32+32)-byte aggregate.
+// The individual signatures are not verified.
+// Inputs: number of signatures n, n*32-byte PublicKeys, n messages Messages[i] of size SizeMessages[i] in bytes,
+//         n*64-byte Signatures
+// Output: (n*32+32)-byte Aggregate
+ECCRYPTO_STATUS SchnorrQ_HalfAggregate(unsigned int n, const unsigned char *PublicKeys, const unsigned char **Messages, const unsigned int *SizeMessages, const unsigned char *Signatures, unsigned char *Aggregate)
+{
+    unsigned char *hs = NULL;
+    digit_t *z = NULL, s[NWORDS_ORDER], zs[NWORDS_ORDER], acc[NWORDS_ORDER] = {0};
+    unsigned int i;
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_UNKNOWN;
+
+    if (n == 0)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    hs = (unsigned char *)calloc(n, 64);
+    z = (digit_t *)calloc(n, NWORDS_ORDER * sizeof(digit_t));
+    if (hs == NULL || z == NULL)
+    {
+        Status = ECCRYPTO_ERROR_NO_MEMORY;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        memmove(Aggregate + 32 * i, Signatures + 64 * i, 32);
+        Status = SchnorrQ_Challenge(Signatures + 64 * i, PublicKeys + 32 * i, Messages[i], SizeMessages[i], hs + 64 * i);
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            goto cleanup;
+        }
+    }
+
+    Status = SchnorrQ_AggregateCoefficients(n, Aggregate, PublicKeys, hs, z);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++)
+    { // acc = acc + z_i*s_i mod r
+        memmove(s, Signatures + 64 * i + 32, 32);
+        to_Montgomery(s, s);
+        to_Montgomery(z + i * NWORDS_ORDER, zs);
+        Montgomery_multiply_mod_order(s, zs, zs);
+        from_Montgomery(zs, zs);
+        add_mod_order(acc, zs, acc);
+    }
+    memmove(Aggregate + 32 * n, acc, 32);
+    Status = ECCRYPTO_SUCCESS;
+
+cleanup:
+    if (hs != NULL)
+        free(hs);
+    if (z != NULL)
+        free(z);
+
+    return Status;
+}
+
+// SchnorrQ half-aggregate signature verification
+// It verifies an aggregate produced by SchnorrQ_HalfAggregate() with one multi-scalar multiplication.
+// Inputs: number of signatures n, n*32-byte PublicKeys, n messages Messages[i] of size SizeMessages[i] in bytes,
+//         (n*32+32)-byte Aggregate
+// Output: true (valid aggregate) or false (invalid aggregate)
+ECCRYPTO_STATUS SchnorrQ_HalfAggregateVerify(unsigned int n, const unsigned char *PublicKeys, const unsigned char **Messages, const unsigned int *SizeMessages, const unsigned char *Aggregate, unsigned int *valid)
+{
+    point_t *points = NULL, T;
+    point_extproj_t TT;
+    unsigned char *hs = NULL;
+    digit_t *z = NULL, *scalars = NULL, s[NWORDS_ORDER], zero[NWORDS_ORDER] = {0};
+    unsigned int i;
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_UNKNOWN;
+
+    *valid = false;
+
+    if (n == 0 || (Aggregate[32 * n + 31] != 0) || ((Aggregate[32 * n + 30] & 0xC0) != 0))
+    { // Is s < 2^246?
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    points = (point_t *)calloc(2 * n, sizeof(point_t));
+    hs = (unsigned char *)calloc(n, 64);
+    z = (digit_t *)calloc(n, NWORDS_ORDER * sizeof(digit_t));
+    scalars = (digit_t *)calloc(2 * n, NWORDS_ORDER * sizeof(digit_t));
+    if (points == NULL || hs == NULL || z == NULL || scalars == NULL)
+    {
+        Status = ECCRYPTO_ERROR_NO_MEMORY;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (((PublicKeys[32 * i + 15] & 0x80) != 0) || ((Aggregate[32 * i + 15] & 0x80) != 0))
+        { // Are bit128(PublicKey) = bit128(R) = 0?
+            Status = ECCRYPTO_ERROR_INVALID_PARAMETER;
+            goto cleanup;
+        }
+        Status = SchnorrQ_DecodeAggregatePoint(PublicKeys + 32 * i, points[i]);
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            goto cleanup;
+        }
+        Status = SchnorrQ_DecodeAggregatePoint(Aggregate + 32 * i, points[n + i]);
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            goto cleanup;
+        }
+        Status = SchnorrQ_Challenge(Aggregate + 32 * i, PublicKeys + 32 * i, Messages[i], SizeMessages[i], hs + 64 * i);
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            goto cleanup;
+        }
+    }
+
+    Status = SchnorrQ_AggregateCoefficients(n, Aggregate, PublicKeys, hs, z);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        digit_t *zi = z + i * NWORDS_ORDER, *hi = (digit_t *)(hs + 64 * i);
+
+        modulo_order(hi, hi); // scalars[i] = z_i*h_i mod r
+        to_Montgomery(hi, hi);
+        to_Montgomery(zi, scalars + i * NWORDS_ORDER);
+        Montgomery_multiply_mod_order(scalars + i * NWORDS_ORDER, hi, scalars + i * NWORDS_ORDER);
+        from_Montgomery(scalars + i * NWORDS_ORDER, scalars + i * NWORDS_ORDER);
+        subtract_mod_order(zero, zi, scalars + (n + i) * NWORDS_ORDER); // scalars[n+i] = -z_i mod r
+    }
+    memmove(s, Aggregate + 32 * n, 32);
+
+    if (ecc_mul_multi_vartime(s, points, scalars, 2 * n, T) == false)
+    {
+        Status = ECCRYPTO_ERROR;
+        goto cleanup;
+    }
+    Status = ECCRYPTO_SUCCESS;
+
+    point_setup(T, TT); // Torsion components of R_i and A_i vanish
+    cofactor_clearing(TT);
+    eccnorm_vartime(TT, T);
+    if (is_neutral_point(T))
+    {
+        *valid = true;
+    }
+
+cleanup:
+    if (points != NULL)
+        free(points);
+    if (hs != NULL)
+        free(hs);
+    if (z != NULL)
+        free(z);
+    if (scalars != NULL)
+        free(scalars);
+
+    return Status;
+}
+
 /**************** Public API for co-factor ECDH key exchange with compressed,
  * 32-byte public keys ****************/
 
@@ -2681,6 +3373,190 @@ cleanup:
     return Status;
 }
 
+// Compressed public key generation for a batch of secret keys
+// It produces the public keys PublicKeys[i] = encoding of SecretKeys[i]*G (G is the generator), for i in [0, n-1].
+// The fixed-base multiplications run back to back and every KEYGEN_BATCH_SIZE points share one field inversion
+// (Montgomery's simultaneous inversion trick).
+// Inputs: number of keys n, n*32-byte SecretKeys
+// Output: n*32-byte PublicKeys
+ECCRYPTO_STATUS CompressedPublicKeyGenerationBatch(unsigned int n, const unsigned char *SecretKeys, unsigned char *PublicKeys)
+{
+    point_extproj_t R[KEYGEN_BATCH_SIZE];
+    f2elm_t acc[KEYGEN_BATCH_SIZE], inv, zinv;
+    point_t P;
+    unsigned int base, i, m;
+
+    for (base = 0; base < n; base += m)
+    {
+        m = (n - base < KEYGEN_BATCH_SIZE) ? (n - base) : KEYGEN_BATCH_SIZE;
+
+        for (i = 0; i < m; i++)
+        {
+            ecc_mul_fixed_extproj((digit_t *)(SecretKeys + 32 * (base + i)), R[i]);
+        }
+
+        fp2copy1271(R[0]->z, acc[0]); // acc[i] = Z0*Z1*...*Zi
+        for (i = 1; i < m; i++)
+        {
+            fp2mul1271(acc[i - 1], R[i]->z, acc[i]);
+        }
+        fp2copy1271(acc[m - 1], inv);
+        fp2inv1271(inv); // inv = (Z0*Z1*...*Z(m-1))^-1
+
+        for (i = m - 1; i > 0; i--)
+        {
+            fp2mul1271(inv, acc[i - 1], zinv); // zinv = Zi^-1
+            fp2mul1271(inv, R[i]->z, inv);     // inv = (Z0*...*Z(i-1))^-1
+            fp2mul1271(R[i]->x, zinv, P->x);
+            fp2mul1271(R[i]->y, zinv, P->y);
+            mod1271(P->x[0]);
+            mod1271(P->x[1]);
+            mod1271(P->y[0]);
+            mod1271(P->y[1]);
+            encode(P, PublicKeys + 32 * (base + i));
+        }
+        fp2mul1271(R[0]->x, inv, P->x);
+        fp2mul1271(R[0]->y, inv, P->y);
+        mod1271(P->x[0]);
+        mod1271(P->x[1]);
+        mod1271(P->y[0]);
+        mod1271(P->y[1]);
+        encode(P, PublicKeys + 32 * base);
+    }
+
+#ifdef TEMP_ZEROING
+    clear_words((void *)R, sizeof(R) / sizeof(unsigned int));
+    clear_words((void *)acc, sizeof(acc) / sizeof(unsigned int));
+    clear_words((void *)inv, sizeof(f2elm_t) / sizeof(unsigned int));
+    clear_words((void *)zinv, sizeof(f2elm_t) / sizeof(unsigned int));
+#endif
+    return ECCRYPTO_SUCCESS;
+}
+
+// Keypair generation for a batch of key exchange keys. Public keys are compressed to 32 bytes
+// It draws the n secret keys with a single call to the random source and computes the public keys
+// with CompressedPublicKeyGenerationBatch().
+// Input:   number of keys n
+// Outputs: n*32-byte SecretKeys and n*32-byte PublicKeys
+ECCRYPTO_STATUS CompressedKeyGenerationBatch(unsigned int n, unsigned char *SecretKeys, unsigned char *PublicKeys)
+{
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_UNKNOWN;
+
+    Status = (ECCRYPTO_STATUS)RandomBytesFunction(SecretKeys, 32 * n);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    Status = CompressedPublicKeyGenerationBatch(n, SecretKeys, PublicKeys);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    return ECCRYPTO_SUCCESS;
+
+cleanup:
+    clear_words((unsigned int *)SecretKeys, n * 256 / (sizeof(unsigned int) * 8));
+    clear_words((unsigned int *)PublicKeys, n * 256 / (sizeof(unsigned int) * 8));
+
+    return Status;
+}
+
+#ifdef FOURQ_THREADS
+typedef struct
+{
+    unsigned int n;
+    const unsigned char *SecretKeys;
+    unsigned char *PublicKeys;
+    ECCRYPTO_STATUS Status;
+    bool joinable;
+} keygen_batch_job_t;
+
+static void *keygen_batch_worker(void *arg)
+{
+    keygen_batch_job_t *job = (keygen_batch_job_t *)arg;
+
+    job->Status = CompressedPublicKeyGenerationBatch(job->n, job->SecretKeys, job->PublicKeys);
+    return NULL;
+}
+
+// Multi-threaded variant of CompressedKeyGenerationBatch() (requires FOURQ_THREADS and -pthread)
+// The secret keys are drawn with a single call to the random source, then the public key computation
+// is split in contiguous slices across nthreads threads.
+// Inputs:  number of keys n, number of threads nthreads
+// Outputs: n*32-byte SecretKeys and n*32-byte PublicKeys
+ECCRYPTO_STATUS CompressedKeyGenerationBatchParallel(unsigned int n, unsigned char *SecretKeys, unsigned char *PublicKeys, unsigned int nthreads)
+{
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_UNKNOWN;
+    pthread_t *threads = NULL;
+    keygen_batch_job_t *jobs = NULL;
+    unsigned int i, offset, slice;
+
+    if (nthreads <= 1 || n < 2 * KEYGEN_BATCH_SIZE)
+    {
+        return CompressedKeyGenerationBatch(n, SecretKeys, PublicKeys);
+    }
+
+    threads = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+    jobs = (keygen_batch_job_t *)calloc(nthreads, sizeof(keygen_batch_job_t));
+    if (threads == NULL || jobs == NULL)
+    {
+        Status = ECCRYPTO_ERROR_NO_MEMORY;
+        goto cleanup;
+    }
+
+    Status = (ECCRYPTO_STATUS)RandomBytesFunction(SecretKeys, 32 * n);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    for (i = 0, offset = 0; i < nthreads; i++, offset += slice)
+    {
+        slice = n / nthreads + (i < n % nthreads ? 1 : 0);
+        jobs[i].n = slice;
+        jobs[i].SecretKeys = SecretKeys + 32 * offset;
+        jobs[i].PublicKeys = PublicKeys + 32 * offset;
+        jobs[i].Status = ECCRYPTO_ERROR_UNKNOWN;
+        jobs[i].joinable = (pthread_create(&threads[i], NULL, keygen_batch_worker, &jobs[i]) == 0);
+        if (jobs[i].joinable == false)
+        { // Fall back to the calling thread
+            keygen_batch_worker(&jobs[i]);
+        }
+    }
+    for (i = 0; i < nthreads; i++)
+    {
+        if (jobs[i].joinable == true)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        if (jobs[i].Status != ECCRYPTO_SUCCESS)
+        {
+            Status = jobs[i].Status;
+        }
+    }
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    free(threads);
+    free(jobs);
+    return ECCRYPTO_SUCCESS;
+
+cleanup:
+    if (threads != NULL)
+        free(threads);
+    if (jobs != NULL)
+        free(jobs);
+    clear_words((unsigned int *)SecretKeys, n * 256 / (sizeof(unsigned int) * 8));
+    clear_words((unsigned int *)PublicKeys, n * 256 / (sizeof(unsigned int) * 8));
+
+    return Status;
+}
+#endif
+
 // Secret agreement computation for key exchange using a compressed, 32-byte
 // public key
 
@@ -0,0 +1,497 @@
+#define _GNU_SOURCE
+#include "fourq.h"
+#include "certificate.h"
+#include "perfcounters.h"
+#include "energy.h"
+#include "bench.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+// Microbenchmarks of the FourQ and SHA-512 primitives
+// Every sample times "inner" back-to-back calls of one operation, so cheap operations are
+// not swamped by the clock overhead. Results are per call: nanoseconds (CLOCK_MONOTONIC)
+// and cycles (TSC, constant rate on current x86 CPUs; 0 elsewhere) as min/p50/p90/p99/mean.
+// Hardware counters (perfcounters.h) are collected in a separate pass over the same number
+// of calls, so the counter syscalls stay out of the timed samples; their means per call are
+// reported with the IPC. Energy (energy.h, RAPL) is read around a third pass of at least
+// -e milliseconds, reported per call above the idle power of the package. Build with
+// FOURQ_OPCOUNT to also report field and point operation counts per call. The half-aggregate
+// operations cover AGGREGATE_SIGNATURES signatures per call.
+
+#define MAX_MESSAGE 16384
+#define AGGREGATE_SIGNATURES 16
+
+typedef struct
+{
+    felm_t a, b;
+    f2elm_t a2;
+    point_t P, Q;
+    digit_t k[NWORDS_ORDER], l[NWORDS_ORDER];
+    unsigned char schnorrq_secret[32], schnorrq_public[32], signature[64];                  // SchnorrQ key pair, signature of message
+    unsigned char ecdh_secret[32], ecdh_public[32], peer_public[32], shared[32], encoded[32]; // Compressed ECDH
+    unsigned char message[MAX_MESSAGE], digest[64];
+    unsigned char aggregate_public[AGGREGATE_SIGNATURES * 32], aggregate_signatures[AGGREGATE_SIGNATURES * 64]; // Signatures of message[i..]
+    unsigned char aggregate[AGGREGATE_SIGNATURES * 32 + 32];
+    const unsigned char *aggregate_messages[AGGREGATE_SIGNATURES];
+    unsigned int aggregate_sizes[AGGREGATE_SIGNATURES];
+} bench_state_t;
+
+typedef struct
+{
+    const char *name;
+    unsigned int bytes; // Input size, 0 when the operation has none
+    unsigned int inner; // Calls per sample
+    void (*run)(bench_state_t *state, unsigned int bytes);
+} bench_t;
+
+typedef struct
+{
+    unsigned int samples;
+    double ns[5];     // min, p50, p90, p99, mean per call
+    double cycles[5]; // Same for cycles
+    double counters[PERF_COUNTERS]; // Mean per call, only for available counters
+    double joules, joules_above_idle; // Per call, only with energy counters
+#ifdef FOURQ_OPCOUNT
+    fourq_opcount_t ops; // Of a single call
+#endif
+} bench_result_t;
+
+static void bench_fpmul1271(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    fpmul1271(s->a, s->b, s->a);
+}
+
+static void bench_fp2inv1271(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    fp2inv1271(s->a2);
+}
+
+static void bench_ecc_mul(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    ecc_mul(s->P, s->k, s->Q, false);
+}
+
+static void bench_ecc_mul_fixed(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    ecc_mul_fixed(s->k, s->Q);
+}
+
+static void bench_ecc_mul_double(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    ecc_mul_double(s->k, s->P, s->l, s->Q);
+}
+
+static void bench_decode(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    decode(s->encoded, s->Q);
+}
+
+static void bench_schnorrq_sign(bench_state_t *s, unsigned int bytes)
+{
+    SchnorrQ_Sign(s->schnorrq_secret, s->schnorrq_public, s->message, bytes, s->signature);
+}
+
+static void bench_schnorrq_verify(bench_state_t *s, unsigned int bytes)
+{
+    unsigned int valid;
+
+    SchnorrQ_Verify(s->schnorrq_public, s->message, bytes, s->signature, &valid);
+}
+
+static void bench_half_aggregate(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    SchnorrQ_HalfAggregate(AGGREGATE_SIGNATURES, s->aggregate_public, s->aggregate_messages, s->aggregate_sizes, s->aggregate_signatures, s->aggregate);
+}
+
+static void bench_half_aggregate_verify(bench_state_t *s, unsigned int bytes)
+{
+    unsigned int valid;
+
+    (void)bytes;
+    SchnorrQ_HalfAggregateVerify(AGGREGATE_SIGNATURES, s->aggregate_public, s->aggregate_messages, s->aggregate_sizes, s->aggregate, &valid);
+}
+
+static void bench_key_generation(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    CompressedKeyGeneration(s->ecdh_secret, s->ecdh_public);
+}
+
+static void bench_secret_agreement(bench_state_t *s, unsigned int bytes)
+{
+    (void)bytes;
+    CompressedSecretAgreement(s->ecdh_secret, s->peer_public, s->shared);
+}
+
+static void bench_sha512(bench_state_t *s, unsigned int bytes)
+{
+    crypto_sha512(s->message, bytes, s->digest);
+}
+
+static const bench_t benchmarks[] = {
+    {"fpmul1271", 0, 1000, bench_fpmul1271},
+    {"fp2inv1271", 0, 100, bench_fp2inv1271},
+    {"ecc_mul", 0, 1, bench_ecc_mul},
+    {"ecc_mul_fixed", 0, 1, bench_ecc_mul_fixed},
+    {"ecc_mul_double", 0, 1, bench_ecc_mul_double},
+    {"decode", 0, 10, bench_decode},
+    {"SchnorrQ_Sign", CERT_MAX_SIGNED, 1, bench_schnorrq_sign},
+    {"SchnorrQ_Verify", CERT_MAX_SIGNED, 1, bench_schnorrq_verify},
+    {"SchnorrQ_HalfAggregate", CERT_MAX_SIGNED, 1, bench_half_aggregate},
+    {"SchnorrQ_HalfAggregateVerify", CERT_MAX_SIGNED, 1, bench_half_aggregate_verify},
+    {"CompressedKeyGeneration", 0, 1, bench_key_generation},
+    {"CompressedSecretAgreement", 0, 1, bench_secret_agreement},
+    {"crypto_sha512", 0, 100, bench_sha512},
+    {"crypto_sha512", 64, 100, bench_sha512},
+    {"crypto_sha512", 112, 100, bench_sha512},
+    {"crypto_sha512", 128, 100, bench_sha512},
+    {"crypto_sha512", 256, 100, bench_sha512},
+    {"crypto_sha512", 1024, 20, bench_sha512},
+    {"crypto_sha512", 4096, 5, bench_sha512},
+    {"crypto_sha512", 16384, 1, bench_sha512},
+};
+
+static void summarize(double *values, unsigned int n, double *out)
+{ // min, nearest-rank p50/p90/p99, mean
+    static const unsigned int percentiles[3] = {50, 90, 99};
+    double sum = 0;
+    unsigned int i;
+
+    qsort(values, n, sizeof(double), Bench_CompareDouble);
+    for (i = 0; i < n; i++)
+        sum += values[i];
+    out[0] = values[0];
+    for (i = 0; i < 3; i++)
+        out[1 + i] = values[Bench_Rank(n, percentiles[i])];
+    out[4] = sum / n;
+}
+
+static int bench_setup(bench_state_t *s)
+{ // Returns 0 if the SchnorrQ key pair does not verify its own signature or the aggregate of the signatures
+    unsigned char peer_secret[32], secret[32];
+    unsigned int i, valid = 0;
+
+    memset(s, 0, sizeof(bench_state_t));
+    random_bytes((unsigned char *)s->a, sizeof(felm_t));
+    random_bytes((unsigned char *)s->b, sizeof(felm_t));
+    random_bytes((unsigned char *)s->a2, sizeof(f2elm_t));
+    s->a[1] &= 0x7FFFFFFFFFFFFFFF;
+    s->b[1] &= 0x7FFFFFFFFFFFFFFF;
+    s->a2[0][1] &= 0x7FFFFFFFFFFFFFFF;
+    s->a2[1][1] &= 0x7FFFFFFFFFFFFFFF;
+    random_bytes((unsigned char *)s->k, sizeof(s->k));
+    random_bytes((unsigned char *)s->l, sizeof(s->l));
+    for (i = 0; i < MAX_MESSAGE; i++)
+        s->message[i] = (unsigned char)i;
+
+    ecc_mul_fixed(s->k, s->P); // Random point of the prime-order subgroup
+    encode(s->P, s->encoded);
+
+    // Separate secrets: CompressedKeyGeneration draws a new one, signing must keep its (sk, pk) pair
+    random_bytes(s->schnorrq_secret, sizeof(s->schnorrq_secret));
+    SchnorrQ_KeyGeneration(s->schnorrq_secret, s->schnorrq_public);
+    SchnorrQ_Sign(s->schnorrq_secret, s->schnorrq_public, s->message, CERT_MAX_SIGNED, s->signature);
+    SchnorrQ_Verify(s->schnorrq_public, s->message, CERT_MAX_SIGNED, s->signature, &valid);
+    CompressedKeyGeneration(s->ecdh_secret, s->ecdh_public);
+    CompressedKeyGeneration(peer_secret, s->peer_public);
+    memset(peer_secret, 0, sizeof(peer_secret));
+    if (!valid)
+        return 0;
+
+    for (i = 0; i < AGGREGATE_SIGNATURES; i++)
+    { // One signer per message
+        s->aggregate_messages[i] = s->message + i;
+        s->aggregate_sizes[i] = CERT_MAX_SIGNED;
+        random_bytes(secret, sizeof(secret));
+        SchnorrQ_KeyGeneration(secret, s->aggregate_public + 32 * i);
+        SchnorrQ_Sign(secret, s->aggregate_public + 32 * i, s->aggregate_messages[i], CERT_MAX_SIGNED, s->aggregate_signatures + 64 * i);
+    }
+    memset(secret, 0, sizeof(secret));
+    if (SchnorrQ_HalfAggregate(AGGREGATE_SIGNATURES, s->aggregate_public, s->aggregate_messages, s->aggregate_sizes, s->aggregate_signatures, s->aggregate) != ECCRYPTO_SUCCESS ||
+        SchnorrQ_HalfAggregateVerify(AGGREGATE_SIGNATURES, s->aggregate_public, s->aggregate_messages, s->aggregate_sizes, s->aggregate, &valid) != ECCRYPTO_SUCCESS)
+        return 0;
+    return valid;
+}
+
+static void bench_run(const bench_t *bench, bench_state_t *state, unsigned int warmup, unsigned int samples, perf_counters_t *pc, energy_meter_t *meter, double idle_watts,
+                      unsigned int energy_ms, bench_result_t *result)
+{
+    uint64_t values[PERF_COUNTERS];
+    double *ns = (double *)malloc(samples * sizeof(double)), *cycles = (double *)malloc(samples * sizeof(double)), joules, seconds;
+    uint64_t t0, c0, calls;
+    unsigned int i, j;
+
+    for (i = 0; i < warmup; i++)
+    {
+        for (j = 0; j < bench->inner; j++)
+            bench->run(state, bench->bytes);
+    }
+    for (i = 0; i < samples; i++)
+    {
+        t0 = Bench_Now(CLOCK_MONOTONIC);
+        c0 = Bench_Cycles();
+        for (j = 0; j < bench->inner; j++)
+            bench->run(state, bench->bytes);
+        cycles[i] = (double)(Bench_Cycles() - c0) / bench->inner;
+        ns[i] = (double)(Bench_Now(CLOCK_MONOTONIC) - t0) / bench->inner;
+    }
+
+    memset(result->counters, 0, sizeof(result->counters));
+    if (pc != NULL)
+    {
+        PerfCounters_Start(pc);
+        for (i = 0; i < samples; i++)
+        {
+            for (j = 0; j < bench->inner; j++)
+                bench->run(state, bench->bytes);
+        }
+        PerfCounters_Stop(pc, values);
+        for (i = 0; i < PERF_COUNTERS; i++)
+            result->counters[i] = (double)values[i] / ((double)samples * bench->inner);
+    }
+
+    result->joules = result->joules_above_idle = 0;
+    if (meter != NULL)
+    { // RAPL updates about every millisecond: one batch long enough to resolve
+        calls = 0;
+        t0 = Bench_Now(CLOCK_MONOTONIC);
+        Energy_Start(meter);
+        do
+        {
+            for (j = 0; j < bench->inner; j++)
+                bench->run(state, bench->bytes);
+            calls += bench->inner;
+        } while (Bench_Now(CLOCK_MONOTONIC) - t0 < energy_ms * 1000000ULL);
+        joules = Energy_Stop(meter, NULL);
+        seconds = (Bench_Now(CLOCK_MONOTONIC) - t0) / 1e9;
+        result->joules = joules / calls;
+        result->joules_above_idle = (joules - idle_watts * seconds) / calls;
+    }
+
+#ifdef FOURQ_OPCOUNT
+    FourQ_OpCountReset();
+    bench->run(state, bench->bytes);
+    FourQ_OpCountSnapshot(&result->ops);
+#endif
+    result->samples = samples;
+    summarize(ns, samples, result->ns);
+    summarize(cycles, samples, result->cycles);
+    free(ns);
+    free(cycles);
+}
+
+static double bench_ipc(const perf_counters_t *pc, const bench_result_t *result)
+{ // Instructions per cycle, 0 when the counters are unavailable
+    if (pc == NULL || !PerfCounters_Available(pc, PERF_CYCLES) || !PerfCounters_Available(pc, PERF_INSTRUCTIONS) || result->counters[PERF_CYCLES] == 0)
+        return 0;
+    return result->counters[PERF_INSTRUCTIONS] / result->counters[PERF_CYCLES];
+}
+
+static void print_json(FILE *fp, const bench_t *bench, const bench_result_t *result, const perf_counters_t *pc, const energy_meter_t *meter, int first)
+{
+    static const char *fields[5] = {"min", "p50", "p90", "p99", "mean"};
+    unsigned int i;
+
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"bytes\": %u, \"inner\": %u, \"samples\": %u, \"ns\": {", first ? "" : ",", bench->name, bench->bytes, bench->inner, result->samples);
+    for (i = 0; i < 5; i++)
+        fprintf(fp, "%s\"%s\": %.2f", i ? ", " : "", fields[i], result->ns[i]);
+    fprintf(fp, "}, \"cycles\": {");
+    for (i = 0; i < 5; i++)
+        fprintf(fp, "%s\"%s\": %.1f", i ? ", " : "", fields[i], result->cycles[i]);
+    fprintf(fp, "}");
+    if (pc != NULL)
+    { // null for the counters this machine cannot provide
+        fprintf(fp, ", \"counters\": {");
+        for (i = 0; i < PERF_COUNTERS; i++)
+        {
+            if (PerfCounters_Available(pc, i))
+                fprintf(fp, "%s\"%s\": %.2f", i ? ", " : "", perf_counter_names[i], result->counters[i]);
+            else
+                fprintf(fp, "%s\"%s\": null", i ? ", " : "", perf_counter_names[i]);
+        }
+        if (bench_ipc(pc, result) > 0)
+            fprintf(fp, ", \"ipc\": %.3f}", bench_ipc(pc, result));
+        else
+            fprintf(fp, ", \"ipc\": null}");
+    }
+    if (meter != NULL)
+        fprintf(fp, ", \"energy\": {\"joules\": %.9f, \"joules_above_idle\": %.9f}", result->joules, result->joules_above_idle);
+    else
+        fprintf(fp, ", \"energy\": null");
+#ifdef FOURQ_OPCOUNT
+    fprintf(fp, ", \"opcount\": {\"fpmul\": %" PRIu64 ", \"fpsqr\": %" PRIu64 ", \"fpadd\": %" PRIu64 ", \"fpinv\": %" PRIu64 ", \"table_lookup\": %" PRIu64 ", \"point_double\": %" PRIu64 ", \"point_add\": %" PRIu64 "}",
+            result->ops.fpmul, result->ops.fpsqr, result->ops.fpadd, result->ops.fpinv, result->ops.table_lookup, result->ops.point_double, result->ops.point_add);
+#endif
+    fprintf(fp, "}");
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s [-w warmup] [-n samples] [-f filter] [-c cpu] [-j results.json] [-P] [-e ms]\n", name);
+    printf("  -w: untimed samples before measuring (default: 20)\n");
+    printf("  -n: timed samples per operation (default: 200)\n");
+    printf("  -f: only run operations whose name contains the filter\n");
+    printf("  -c: pin the process to one CPU\n");
+    printf("  -j: write the results as JSON\n");
+    printf("  -P: do not collect hardware performance counters\n");
+    printf("  -e: milliseconds of the energy pass per operation, 0 to skip it (default: 200)\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int warmup = 20, samples = 200, energy_ms = 200, i, first = 1;
+    const char *filter = NULL, *json_path = NULL;
+    static bench_state_t state;
+    bench_result_t result;
+    FILE *json = NULL;
+    perf_counters_t counters, *pc = &counters;
+    energy_meter_t energy, *meter = &energy;
+    double idle_watts = 0;
+    unsigned int available;
+    int opt, cpu = -1;
+
+    while ((opt = getopt(argc, argv, "w:n:f:c:j:Pe:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            warmup = (unsigned int)atoi(optarg);
+            break;
+        case 'n':
+            samples = (unsigned int)atoi(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        case 'P':
+            pc = NULL;
+            break;
+        case 'e':
+            energy_ms = (unsigned int)atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (samples == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    Bench_PinCpu(cpu);
+    if (json_path != NULL)
+    {
+        json = fopen(json_path, "w");
+        if (json == NULL)
+        {
+            perror(json_path);
+            return 1;
+        }
+    }
+
+    if (pc != NULL)
+    {
+        available = PerfCounters_Open(pc);
+        if (available == 0)
+        {
+            fprintf(stderr, "perf_event_open: no counter available (check /proc/sys/kernel/perf_event_paranoid)\n");
+            pc = NULL;
+        }
+        else if (available < PERF_COUNTERS)
+        {
+            fprintf(stderr, "perf_event_open: %u of %u counters available, missing:", available, PERF_COUNTERS);
+            for (i = 0; i < PERF_COUNTERS; i++)
+            {
+                if (!PerfCounters_Available(pc, i))
+                    fprintf(stderr, " %s", perf_counter_names[i]);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+
+    if (energy_ms == 0)
+        meter = NULL;
+    else if (Energy_Open(meter) == 0)
+    {
+        fprintf(stderr, "energy: no RAPL counter available or advancing (powercap, perf power PMU)\n");
+        meter = NULL;
+    }
+    else
+    {
+        idle_watts = Energy_Idle(meter, energy_ms);
+        fprintf(stderr, "energy: %s, idle %.2f W\n", Energy_Source(meter), idle_watts);
+    }
+    if (json != NULL)
+    {
+        fprintf(json, "{\n  \"warmup\": %u,\n  \"samples\": %u,\n", warmup, samples);
+        if (meter != NULL)
+            fprintf(json, "  \"energy_source\": \"%s\",\n  \"idle_watts\": %.3f,\n", Energy_Source(meter), idle_watts);
+        fprintf(json, "  \"benchmarks\": [");
+    }
+
+    if (!bench_setup(&state))
+    {
+        fprintf(stderr, "SchnorrQ_Verify or SchnorrQ_HalfAggregateVerify rejects the benchmark signatures\n");
+        return 1;
+    }
+    printf("%-28s %6s %12s %12s %12s %12s %12s %6s %10s %10s %10s\n", "operation", "bytes", "ns min", "ns p50", "ns p99", "cycles p50", "cycles p99", "IPC", "br-miss", "LLC-miss", "uJ");
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        const bench_t *bench = &benchmarks[i];
+
+        if (filter != NULL && strstr(bench->name, filter) == NULL)
+            continue;
+        bench_run(bench, &state, warmup, samples, pc, meter, idle_watts, energy_ms, &result);
+        printf("%-28s %6u %12.1f %12.1f %12.1f %12.0f %12.0f", bench->name, bench->bytes, result.ns[0], result.ns[1], result.ns[3], result.cycles[1], result.cycles[3]);
+        if (bench_ipc(pc, &result) > 0)
+            printf(" %6.2f", bench_ipc(pc, &result));
+        else
+            printf(" %6s", "-");
+        if (pc != NULL && PerfCounters_Available(pc, PERF_BRANCH_MISSES))
+            printf(" %10.1f", result.counters[PERF_BRANCH_MISSES]);
+        else
+            printf(" %10s", "-");
+        if (pc != NULL && PerfCounters_Available(pc, PERF_LLC_MISSES))
+            printf(" %10.2f", result.counters[PERF_LLC_MISSES]);
+        else
+            printf(" %10s", "-");
+        if (meter != NULL)
+            printf(" %10.3f\n", result.joules_above_idle * 1e6);
+        else
+            printf(" %10s\n", "-");
+        if (json != NULL)
+        {
+            print_json(json, bench, &result, pc, meter, first);
+            first = 0;
+        }
+    }
+
+    if (json != NULL)
+    {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    if (pc != NULL)
+        PerfCounters_Close(pc);
+    if (meter != NULL)
+        Energy_Close(meter);
+    return 0;
+}
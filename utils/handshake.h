@@ -0,0 +1,367 @@
+#pragma once
+
+#ifndef _HANDSHAKE_H
+#define _HANDSHAKE_H
+/***********************************************************************************
+ * One round trip certificate + ECDH handshake
+ *
+ *   initiator -> responder: 0x01 | len | cert_I | E_I | sig_I(flight 1)
+ *   responder -> initiator: 0x02 | len | cert_R | E_R | sig_R(H(flight 1) || flight 2)
+ *
+ * cert is the compact encoding of certificate.h, E the ephemeral ECDH public key
+ * and sig a SchnorrQ signature with the certified signing_key of the sender (a
+ * version 2 device certificate), covering everything sent before it. Both sides
+ * check the peer certificate with a certchain_t (and an optional revocation
+ * filter; with an optional certcache_t a known certificate skips its signature
+ * verification), then
+ *
+ *   session_key = HKDF-Extract(salt = H(flight 1) || H(flight 2), ECDH(e_I, E_R))
+ *
+ * The session key is a PRK: traffic keys are expanded from hs->schedule
+ * (KeySchedule_Derive in kdf.h), never taken from the ECDH output directly.
+ *
+ * The ephemeral key and, for the initiator, the whole first flight are computed
+ * by Handshake_Precompute() before the link is up, so after a dropout the first
+ * message leaves immediately. Every phase is timed (handshake_timing_t).
+ *
+ * The engine is transport agnostic: messages go through the send/recv callbacks
+ * of handshake_transport_t (MAVLink, UDP, a test pipe...). The header also builds
+ * as C++ (ArduPilot and QGroundControl are C++ code bases).
+ ***********************************************************************************/
+#include "certchain.h"
+#include "certcache.h"
+#include "revocation.h"
+#include "kdf.h"
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HANDSHAKE_MAX_MESSAGE (2 + CERT_MAX_ENCODED + 32 + 64)
+#define HANDSHAKE_FLIGHT1 0x01
+#define HANDSHAKE_FLIGHT2 0x02
+
+typedef struct
+{
+    void *context;
+    int (*send)(void *context, const unsigned char *message, unsigned int length);                        // Returns 0 on success
+    int (*recv)(void *context, unsigned char *message, unsigned int max_length, unsigned int timeout_ms); // Returns the message length, < 0 on error or timeout
+} handshake_transport_t;
+
+typedef enum
+{
+    HANDSHAKE_IDLE,
+    HANDSHAKE_READY,         // Ephemeral key (and first flight) precomputed
+    HANDSHAKE_WAIT_RESPONSE, // Initiator: first flight sent
+    HANDSHAKE_DONE,
+    HANDSHAKE_FAILED
+} handshake_state_t;
+
+typedef struct
+{ // Nanoseconds spent in each phase
+    uint64_t precompute;  // Ephemeral key generation and signature of the own flight
+    uint64_t certificate; // Peer certificate decoding, chain and revocation checks
+    uint64_t signature;   // Peer flight signature verification
+    uint64_t agreement;   // Ephemeral ECDH and session key derivation
+    uint64_t respond;     // Responder: signature of the second flight
+    uint64_t network;     // Initiator: from the first flight sent to the response received, 0 before the response
+    uint64_t total;       // From Handshake_Start (or the first flight received) to HANDSHAKE_DONE
+} handshake_timing_t;
+
+typedef struct
+{
+    handshake_state_t state;
+    bool initiator;
+    const mavlink_device_certificate_t *own; // Certificate with the signing secret key
+    const certchain_t *chain;
+    const revocation_filter_t *revoked; // Optional
+    certcache_t *cache;                 // Optional, not shared between threads
+    const handshake_transport_t *transport;
+    unsigned char ephemeral_secret[32];
+    unsigned char ephemeral_public[32];
+    unsigned char flight[HANDSHAKE_MAX_MESSAGE]; // Own flight
+    unsigned int flight_length;
+    unsigned char transcript[64]; // H(flight 1)
+    unsigned char session_key[64]; // PRK of the session
+    key_schedule_t schedule;       // Prepared session_key
+    info_t peer; // Certified information of the peer
+    handshake_timing_t timing;
+    uint64_t started; // Timestamps (ns), not durations
+    uint64_t sent;    // Initiator: first flight sent
+} handshake_t;
+
+static uint64_t handshake_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static ECCRYPTO_STATUS handshake_build_flight(handshake_t *hs, unsigned char type)
+{ // type | len | cert | E | sig over (H(flight 1) if responding) || type | len | cert | E
+    unsigned char temp[64 + HANDSHAKE_MAX_MESSAGE];
+    unsigned int length, offset = 0;
+
+    if (hs->own->info.version != CERT_FORMAT_VERSION)
+    { // A legacy certificate has no signing key
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    hs->flight[0] = type;
+    length = CertEncode(hs->own, &hs->flight[2]);
+    if (length == 0)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    hs->flight[1] = (unsigned char)length;
+    memcpy(&hs->flight[2 + length], hs->ephemeral_public, 32);
+    hs->flight_length = 2 + length + 32;
+
+    if (type == HANDSHAKE_FLIGHT2)
+    {
+        memcpy(temp, hs->transcript, 64);
+        offset = 64;
+    }
+    memcpy(&temp[offset], hs->flight, hs->flight_length);
+
+    if (SchnorrQ_Sign(hs->own->signing_secret_key, hs->own->info.signing_key, temp, offset + hs->flight_length, &hs->flight[hs->flight_length]) != ECCRYPTO_SUCCESS)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    hs->flight_length += 64;
+    return ECCRYPTO_SUCCESS;
+}
+
+static ECCRYPTO_STATUS handshake_check_flight(handshake_t *hs, const unsigned char *message, unsigned int length, unsigned char type, const unsigned char **ephemeral)
+{ // Parse and authenticate a peer flight, fills hs->peer
+    unsigned char temp[64 + HANDSHAKE_MAX_MESSAGE];
+    unsigned int offset = 0, valid;
+    cert_view_t view;
+    ECCRYPTO_STATUS Status;
+    uint64_t t0, t1;
+
+    t0 = handshake_now_ns();
+    if (length < 2 || message[0] != type || length != 2u + message[1] + 32 + 64 || !CertView_Parse(&message[2], message[1], &view))
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    CertView_ToInfo(&view, &hs->peer);
+    if (hs->cache != NULL)
+        Status = CertCache_VerifyChain(hs->cache, hs->chain, &hs->peer, view.sign, (uint64_t)time(NULL), &valid);
+    else
+        Status = CertChain_Verify(hs->chain, &hs->peer, view.sign, (uint64_t)time(NULL), &valid);
+    if (Status != ECCRYPTO_SUCCESS || !valid)
+    {
+        return ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+    }
+    if (hs->revoked != NULL && Revocation_Check(hs->revoked, hs->peer.issuer, hs->peer.seq_number))
+    {
+        return ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+    }
+    t1 = handshake_now_ns();
+    hs->timing.certificate += t1 - t0;
+
+    // The flight is signed with the certified signing key of the peer (CertChain_Verify only accepts version 2)
+    if (type == HANDSHAKE_FLIGHT2)
+    {
+        memcpy(temp, hs->transcript, 64);
+        offset = 64;
+    }
+    memcpy(&temp[offset], message, length - 64);
+    if (SchnorrQ_Verify(hs->peer.signing_key, temp, offset + length - 64, &message[length - 64], &valid) != ECCRYPTO_SUCCESS || !valid)
+    {
+        return ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+    }
+    hs->timing.signature += handshake_now_ns() - t1;
+
+    *ephemeral = &message[length - 64 - 32];
+    return ECCRYPTO_SUCCESS;
+}
+
+static ECCRYPTO_STATUS handshake_derive(handshake_t *hs, const unsigned char *peer_ephemeral, const unsigned char *flight2, unsigned int flight2_length)
+{ // session_key = HKDF-Extract(H(flight 1) || H(flight 2), ECDH)
+    unsigned char temp[32 + 64 + 64];
+    uint64_t t0 = handshake_now_ns();
+    ECCRYPTO_STATUS Status;
+
+    Status = CompressedSecretAgreement(hs->ephemeral_secret, peer_ephemeral, temp);
+    if (Status == ECCRYPTO_SUCCESS)
+    {
+        memcpy(&temp[32], hs->transcript, 64);
+        crypto_sha512(flight2, flight2_length, &temp[96]);
+        HKDF_Extract(&temp[32], 128, temp, 32, &hs->schedule.prk, hs->session_key);
+    }
+    clear_words((unsigned int *)temp, sizeof(temp) / sizeof(unsigned int));
+    clear_words((unsigned int *)hs->ephemeral_secret, 32 / sizeof(unsigned int));
+    hs->timing.agreement += handshake_now_ns() - t0;
+
+    return Status;
+}
+
+static ECCRYPTO_STATUS handshake_fail(handshake_t *hs, ECCRYPTO_STATUS Status)
+{
+    hs->state = HANDSHAKE_FAILED;
+    clear_words((unsigned int *)hs->ephemeral_secret, 32 / sizeof(unsigned int));
+    clear_words((unsigned int *)hs->session_key, 64 / sizeof(unsigned int));
+    KeySchedule_Free(&hs->schedule);
+    return Status;
+}
+
+// Set up a handshake
+// Inputs: initiator (vehicle) or responder (GCS), own certificate (with its secret key), chain of trusted authorities,
+//         optional revocation filter (NULL), optional cache of verified certificates (NULL), transport
+void Handshake_Init(handshake_t *hs, bool initiator, const mavlink_device_certificate_t *own, const certchain_t *chain, const revocation_filter_t *revoked, certcache_t *cache,
+                    const handshake_transport_t *transport)
+{
+    memset(hs, 0, sizeof(handshake_t));
+    hs->state = HANDSHAKE_IDLE;
+    hs->initiator = initiator;
+    hs->own = own;
+    hs->chain = chain;
+    hs->revoked = revoked;
+    hs->cache = cache;
+    hs->transport = transport;
+}
+
+// Work that does not depend on the peer: ephemeral key pair and, for the initiator, the signed first flight
+// Can run ahead of time, e.g. as soon as the previous session ends
+ECCRYPTO_STATUS Handshake_Precompute(handshake_t *hs)
+{
+    uint64_t t0 = handshake_now_ns();
+    ECCRYPTO_STATUS Status;
+
+    if (hs->state != HANDSHAKE_IDLE)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    Status = CompressedKeyGeneration(hs->ephemeral_secret, hs->ephemeral_public);
+    if (Status == ECCRYPTO_SUCCESS && hs->initiator)
+    {
+        Status = handshake_build_flight(hs, HANDSHAKE_FLIGHT1);
+        if (Status == ECCRYPTO_SUCCESS)
+            crypto_sha512(hs->flight, hs->flight_length, hs->transcript);
+    }
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        return handshake_fail(hs, Status);
+    }
+    hs->timing.precompute += handshake_now_ns() - t0;
+    hs->state = HANDSHAKE_READY;
+
+    return ECCRYPTO_SUCCESS;
+}
+
+// Initiator: send the first flight (precomputing it if needed)
+ECCRYPTO_STATUS Handshake_Start(handshake_t *hs)
+{
+    ECCRYPTO_STATUS Status;
+
+    if (!hs->initiator)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    hs->started = handshake_now_ns();
+    if (hs->state == HANDSHAKE_IDLE && (Status = Handshake_Precompute(hs)) != ECCRYPTO_SUCCESS)
+    {
+        return Status;
+    }
+    if (hs->state != HANDSHAKE_READY)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    if (hs->transport->send(hs->transport->context, hs->flight, hs->flight_length) != 0)
+    {
+        return handshake_fail(hs, ECCRYPTO_ERROR);
+    }
+    hs->state = HANDSHAKE_WAIT_RESPONSE;
+    hs->sent = handshake_now_ns();
+
+    return ECCRYPTO_SUCCESS;
+}
+
+// Process a message of the peer
+// Responder: first flight -> second flight sent, HANDSHAKE_DONE. Initiator: second flight -> HANDSHAKE_DONE
+ECCRYPTO_STATUS Handshake_Receive(handshake_t *hs, const unsigned char *message, unsigned int length)
+{
+    const unsigned char *ephemeral;
+    ECCRYPTO_STATUS Status;
+    uint64_t t0;
+
+    if (hs->initiator)
+    {
+        if (hs->state != HANDSHAKE_WAIT_RESPONSE)
+        {
+            return ECCRYPTO_ERROR_INVALID_PARAMETER;
+        }
+        hs->timing.network = handshake_now_ns() - hs->sent;
+
+        Status = handshake_check_flight(hs, message, length, HANDSHAKE_FLIGHT2, &ephemeral);
+        if (Status == ECCRYPTO_SUCCESS)
+            Status = handshake_derive(hs, ephemeral, message, length);
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            return handshake_fail(hs, Status);
+        }
+    }
+    else
+    {
+        hs->started = handshake_now_ns();
+        if (hs->state == HANDSHAKE_IDLE && (Status = Handshake_Precompute(hs)) != ECCRYPTO_SUCCESS)
+        {
+            return Status;
+        }
+        if (hs->state != HANDSHAKE_READY)
+        {
+            return ECCRYPTO_ERROR_INVALID_PARAMETER;
+        }
+
+        Status = handshake_check_flight(hs, message, length, HANDSHAKE_FLIGHT1, &ephemeral);
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            return handshake_fail(hs, Status);
+        }
+        crypto_sha512(message, length, hs->transcript);
+
+        t0 = handshake_now_ns();
+        Status = handshake_build_flight(hs, HANDSHAKE_FLIGHT2);
+        hs->timing.respond += handshake_now_ns() - t0;
+        if (Status == ECCRYPTO_SUCCESS)
+            Status = handshake_derive(hs, ephemeral, hs->flight, hs->flight_length);
+        if (Status == ECCRYPTO_SUCCESS && hs->transport->send(hs->transport->context, hs->flight, hs->flight_length) != 0)
+            Status = ECCRYPTO_ERROR;
+        if (Status != ECCRYPTO_SUCCESS)
+        {
+            return handshake_fail(hs, Status);
+        }
+    }
+
+    hs->timing.total = handshake_now_ns() - hs->started;
+    hs->state = HANDSHAKE_DONE;
+    return ECCRYPTO_SUCCESS;
+}
+
+// Blocking driver: run the whole handshake over the transport
+// Output: hs->session_key, hs->schedule and hs->peer when HANDSHAKE_DONE
+ECCRYPTO_STATUS Handshake_Run(handshake_t *hs, unsigned int timeout_ms)
+{
+    unsigned char message[HANDSHAKE_MAX_MESSAGE];
+    ECCRYPTO_STATUS Status;
+    int length;
+
+    if (hs->initiator && (Status = Handshake_Start(hs)) != ECCRYPTO_SUCCESS)
+    {
+        return Status;
+    }
+    length = hs->transport->recv(hs->transport->context, message, sizeof(message), timeout_ms);
+    if (length < 0)
+    {
+        return handshake_fail(hs, ECCRYPTO_ERROR);
+    }
+    return Handshake_Receive(hs, message, (unsigned int)length);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,475 @@
+#define _GNU_SOURCE
+#include "handshake.h"
+#include "energy.h"
+#include "bench.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <poll.h>
+#include <glob.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Handshake load simulator: N vehicles run the certificate + ECDH handshake
+// (handshake.h) against one GCS endpoint over UDP, for a growing vehicle count.
+// With RAPL counters (energy.h) each step also reports the energy per handshake above
+// idle: both sides with the in-process GCS, the vehicles only with an external one.
+// With -C the in-process GCS checks vehicle certificates through a certcache_t.
+
+#define GCS_PORT 14550
+#define MAX_VEHICLES 1024
+#define MAX_STEPS 32
+#define MAX_INTERMEDIATES 8
+
+typedef struct
+{
+    int fd;
+    struct sockaddr_in peer; // Last sender (GCS) or the GCS address (vehicle)
+} udp_context_t;
+
+typedef struct
+{
+    pthread_t thread;
+    const mavlink_device_certificate_t *certificate;
+    unsigned int timeout_ms;
+    uint64_t *latencies; // Nanoseconds, one per completed handshake
+    size_t count, capacity;
+    unsigned int failed;
+} vehicle_t;
+
+static const certchain_t *chain;
+static struct sockaddr_in gcs_address;
+static volatile int running, gcs_running; // Vehicles of the current step run, GCS endpoint is up
+static uint64_t gcs_handshakes, gcs_failed;
+static certcache_t gcs_cache; // Owned by the GCS thread, capacity 0: no cache
+static energy_meter_t *meter; // NULL: no energy counter
+static double idle_watts;
+
+static int udp_send(void *context, const unsigned char *message, unsigned int length)
+{
+    udp_context_t *udp = (udp_context_t *)context;
+
+    return sendto(udp->fd, message, length, 0, (struct sockaddr *)&udp->peer, sizeof(udp->peer)) == (ssize_t)length ? 0 : -1;
+}
+
+static int udp_recv(void *context, unsigned char *message, unsigned int max_length, unsigned int timeout_ms)
+{
+    udp_context_t *udp = (udp_context_t *)context;
+    struct pollfd pfd = {udp->fd, POLLIN, 0};
+    socklen_t len = sizeof(udp->peer);
+
+    if (poll(&pfd, 1, (int)timeout_ms) <= 0)
+        return -1;
+    return (int)recvfrom(udp->fd, message, max_length, 0, (struct sockaddr *)&udp->peer, &len);
+}
+
+static int load_certificate(const char *path, mavlink_device_certificate_t *certificate)
+{
+    return CertLoad(path, certificate) == ECCRYPTO_SUCCESS;
+}
+
+void *gcsWorker(void *arg)
+{ // GCS endpoint: answers every first flight, precomputes the next ephemeral key while the socket is idle
+    const mavlink_device_certificate_t *certificate = (const mavlink_device_certificate_t *)arg;
+    handshake_transport_t transport = {NULL, udp_send, udp_recv};
+    unsigned char message[HANDSHAKE_MAX_MESSAGE];
+    udp_context_t udp;
+    handshake_t hs;
+    int length;
+
+    udp.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp.fd < 0 || bind(udp.fd, (struct sockaddr *)&gcs_address, sizeof(gcs_address)) != 0)
+    {
+        perror("GCS socket");
+        exit(1);
+    }
+    transport.context = &udp;
+    Handshake_Init(&hs, false, certificate, chain, NULL, gcs_cache.capacity ? &gcs_cache : NULL, &transport);
+    gcs_running = 1;
+
+    for (;;)
+    {
+        if (hs.state == HANDSHAKE_IDLE)
+        {
+            Handshake_Precompute(&hs);
+        }
+        length = udp_recv(&udp, message, sizeof(message), 100);
+        if (length < 0)
+            continue;
+
+        if (Handshake_Receive(&hs, message, (unsigned int)length) == ECCRYPTO_SUCCESS)
+            __atomic_add_fetch(&gcs_handshakes, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_add_fetch(&gcs_failed, 1, __ATOMIC_RELAXED);
+        Handshake_Init(&hs, false, certificate, chain, NULL, gcs_cache.capacity ? &gcs_cache : NULL, &transport);
+    }
+    return NULL;
+}
+
+void *vehicleWorker(void *arg)
+{ // Back-to-back handshakes until the step ends
+    vehicle_t *vehicle = (vehicle_t *)arg;
+    handshake_transport_t transport = {NULL, udp_send, udp_recv};
+    udp_context_t udp;
+    handshake_t hs;
+    uint64_t t0, *grown;
+
+    udp.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp.fd < 0)
+    {
+        perror("vehicle socket");
+        return NULL;
+    }
+    transport.context = &udp;
+
+    while (running)
+    {
+        udp.peer = gcs_address;
+        Handshake_Init(&hs, true, vehicle->certificate, chain, NULL, NULL, &transport);
+        t0 = Bench_Now(CLOCK_MONOTONIC);
+        if (Handshake_Run(&hs, vehicle->timeout_ms) != ECCRYPTO_SUCCESS || hs.state != HANDSHAKE_DONE)
+        {
+            vehicle->failed++;
+            continue;
+        }
+        if (vehicle->count == vehicle->capacity)
+        {
+            grown = (uint64_t *)realloc(vehicle->latencies, (vehicle->capacity ? 2 * vehicle->capacity : 1024) * sizeof(uint64_t));
+            if (grown == NULL)
+            { // This vehicle stops, its samples so far are kept
+                perror("vehicle latencies");
+                break;
+            }
+            vehicle->latencies = grown;
+            vehicle->capacity = vehicle->capacity ? 2 * vehicle->capacity : 1024;
+        }
+        vehicle->latencies[vehicle->count++] = Bench_Now(CLOCK_MONOTONIC) - t0;
+    }
+
+    close(udp.fd);
+    return NULL;
+}
+
+int runStep(vehicle_t *vehicles, unsigned int nvehicles, const mavlink_device_certificate_t *devices, unsigned int ndevices,
+            unsigned int seconds, unsigned int timeout_ms, clockid_t gcs_clock, FILE *csv)
+{ // Returns 0, or -1 if the step could not run (the vehicles already started are stopped)
+    uint64_t wall, gcs_cpu = 0, handshakes = 0, gcs_done, *all;
+    double rate, p50, p99, max, cpu_per_handshake = 0, gcs_load = 0, joules = 0;
+    unsigned int i, started, failed = 0;
+    size_t n = 0;
+    int error;
+
+    memset(vehicles, 0, nvehicles * sizeof(vehicle_t));
+    gcs_done = __atomic_load_n(&gcs_handshakes, __ATOMIC_RELAXED);
+    if (gcs_running)
+        gcs_cpu = Bench_Now(gcs_clock);
+    if (meter != NULL)
+        Energy_Start(meter);
+    wall = Bench_Now(CLOCK_MONOTONIC);
+
+    running = 1;
+    for (started = 0; started < nvehicles; started++)
+    {
+        vehicles[started].certificate = &devices[started % ndevices];
+        vehicles[started].timeout_ms = timeout_ms;
+        error = pthread_create(&vehicles[started].thread, NULL, vehicleWorker, &vehicles[started]);
+        if (error != 0)
+        {
+            fprintf(stderr, "vehicle %u: %s\n", started, strerror(error));
+            break;
+        }
+    }
+    if (started == nvehicles)
+        sleep(seconds);
+    running = 0;
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(vehicles[i].thread, NULL);
+        handshakes += vehicles[i].count;
+        failed += vehicles[i].failed;
+    }
+    wall = Bench_Now(CLOCK_MONOTONIC) - wall;
+    if (meter != NULL)
+        joules = Energy_Stop(meter, NULL) - idle_watts * wall / 1e9;
+    if (gcs_running)
+        gcs_cpu = Bench_Now(gcs_clock) - gcs_cpu;
+    gcs_done = __atomic_load_n(&gcs_handshakes, __ATOMIC_RELAXED) - gcs_done;
+
+    all = started == nvehicles ? (uint64_t *)malloc((handshakes ? handshakes : 1) * sizeof(uint64_t)) : NULL;
+    if (all == NULL)
+    {
+        if (started == nvehicles)
+            fprintf(stderr, "Out of memory for %" PRIu64 " latencies\n", handshakes);
+        for (i = 0; i < started; i++)
+            free(vehicles[i].latencies);
+        return -1;
+    }
+    for (i = 0; i < nvehicles; i++)
+    {
+        memcpy(&all[n], vehicles[i].latencies, vehicles[i].count * sizeof(uint64_t));
+        n += vehicles[i].count;
+        free(vehicles[i].latencies);
+    }
+    qsort(all, n, sizeof(uint64_t), Bench_CompareU64);
+
+    rate = handshakes / (wall / 1e9);
+    p50 = Bench_PercentileUs(all, n, 50);
+    p99 = Bench_PercentileUs(all, n, 99);
+    max = Bench_PercentileUs(all, n, 100);
+    if (gcs_running)
+    { // An external GCS is not measured
+        cpu_per_handshake = gcs_done ? gcs_cpu / 1e3 / gcs_done : 0.0;
+        gcs_load = 100.0 * gcs_cpu / wall;
+    }
+
+    printf("%8u %12.1f %10.1f %10.1f %10.1f", nvehicles, rate, p50, p99, max);
+    if (gcs_running)
+        printf(" %14.1f %8.1f", cpu_per_handshake, gcs_load);
+    else
+        printf(" %14s %8s", "-", "-");
+    printf(" %8u", failed);
+    if (meter != NULL && handshakes > 0)
+        printf(" %10.3f\n", joules * 1e3 / handshakes);
+    else
+        printf(" %10s\n", "-");
+    if (csv != NULL)
+    {
+        fprintf(csv, "%u,%.1f,%.1f,%.1f,%.1f,", nvehicles, rate, p50, p99, max);
+        if (gcs_running)
+            fprintf(csv, "%.1f,%.1f,", cpu_per_handshake, gcs_load);
+        else
+            fprintf(csv, ",,");
+        fprintf(csv, "%u,", failed);
+        if (meter != NULL && handshakes > 0)
+            fprintf(csv, "%.3e\n", joules / handshakes);
+        else
+            fprintf(csv, "\n");
+        fflush(csv);
+    }
+    free(all);
+    return 0;
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s -a authority.cert -g gcs.cert -v 'dir/device_*.cert' [options]\n", name);
+    printf("  -a: root authority certificate trusted by both sides\n");
+    printf("  -i: sub-authority certificate, repeat in issuing order (root first)\n");
+    printf("  -g: GCS certificate (with its secret key) for the in-process GCS endpoint\n");
+    printf("  -v: glob of vehicle certificates, as written by cert_generator -b\n");
+    printf("  -n: vehicle counts, comma separated (default: 1,2,4,8,16,32)\n");
+    printf("  -t: seconds per vehicle count (default: 5)\n");
+    printf("  -H: address of an external GCS, no in-process endpoint (default: 127.0.0.1)\n");
+    printf("  -p: GCS UDP port (default: %d)\n", GCS_PORT);
+    printf("  -G: only run the GCS endpoint, until interrupted\n");
+    printf("  -C: the GCS caches up to this many verified vehicle certificates (default: no cache)\n");
+    printf("  -o: append the results to a CSV file\n");
+    printf("  -E: do not read the energy counters\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *authority_path = NULL, *gcs_path = NULL, *vehicle_glob = NULL, *intermediates[MAX_INTERMEDIATES], *host = NULL, *csv_path = NULL;
+    char steps_list[256] = "1,2,4,8,16,32", *token;
+    unsigned int steps[MAX_STEPS], nsteps = 0, nintermediates = 0, seconds = 5, port = GCS_PORT, only_gcs = 0, ndevices = 0, cache_capacity = 0, i, valid;
+    mavlink_device_certificate_t root, gcs, intermediate, *devices;
+    static vehicle_t vehicles[MAX_VEHICLES];
+    static energy_meter_t energy;
+    certchain_t trusted;
+    pthread_t gcs_thread;
+    clockid_t gcs_clock = CLOCK_MONOTONIC;
+    FILE *csv = NULL;
+    glob_t paths;
+    int opt, error, status = 0;
+
+    meter = &energy;
+    while ((opt = getopt(argc, argv, "a:i:g:v:n:t:H:p:GC:o:Eh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            authority_path = optarg;
+            break;
+        case 'i':
+            if (nintermediates < MAX_INTERMEDIATES)
+                intermediates[nintermediates++] = optarg;
+            break;
+        case 'g':
+            gcs_path = optarg;
+            break;
+        case 'v':
+            vehicle_glob = optarg;
+            break;
+        case 'n':
+            snprintf(steps_list, sizeof(steps_list), "%s", optarg);
+            break;
+        case 't':
+            seconds = (unsigned int)atoi(optarg);
+            break;
+        case 'H':
+            host = optarg;
+            break;
+        case 'p':
+            port = (unsigned int)atoi(optarg);
+            break;
+        case 'G':
+            only_gcs = 1;
+            break;
+        case 'C':
+            cache_capacity = (unsigned int)atoi(optarg);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        case 'E':
+            meter = NULL;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (authority_path == NULL || (host == NULL && gcs_path == NULL) || (!only_gcs && vehicle_glob == NULL))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!load_certificate(authority_path, &root) || CertChain_Init(&trusted, &root, 1 + MAX_INTERMEDIATES) != ECCRYPTO_SUCCESS)
+    {
+        printf("Cannot load the authority certificate %s\n", authority_path);
+        return 1;
+    }
+    for (i = 0; i < nintermediates; i++)
+    {
+        if (!load_certificate(intermediates[i], &intermediate) ||
+            CertChain_AddIntermediate(&trusted, &intermediate.info, intermediate.sign, (uint64_t)time(NULL), &valid) != ECCRYPTO_SUCCESS || !valid)
+        {
+            printf("Sub-authority certificate %s is not valid\n", intermediates[i]);
+            return 1;
+        }
+    }
+    chain = &trusted;
+
+    memset(&gcs_address, 0, sizeof(gcs_address));
+    gcs_address.sin_family = AF_INET;
+    gcs_address.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host != NULL ? host : "127.0.0.1", &gcs_address.sin_addr) != 1)
+    {
+        printf("Invalid GCS address %s\n", host);
+        return 1;
+    }
+
+    if (host == NULL)
+    {
+        if (!load_certificate(gcs_path, &gcs))
+        {
+            printf("Cannot load the GCS certificate %s\n", gcs_path);
+            return 1;
+        }
+        if (cache_capacity > 0 && CertCache_Init(&gcs_cache, cache_capacity) != ECCRYPTO_SUCCESS)
+        {
+            printf("Cannot create a certificate cache of %u entries\n", cache_capacity);
+            return 1;
+        }
+        if ((error = pthread_create(&gcs_thread, NULL, gcsWorker, &gcs)) != 0)
+        {
+            printf("Cannot start the GCS endpoint: %s\n", strerror(error));
+            return 1;
+        }
+        while (!gcs_running)
+            usleep(1000);
+        pthread_getcpuclockid(gcs_thread, &gcs_clock);
+        if (only_gcs)
+        {
+            printf("GCS listening on UDP port %u\n", port);
+            for (;;)
+            {
+                fflush(stdout);
+                sleep(10);
+                printf("%" PRIu64 " handshakes, %" PRIu64 " rejected", gcs_handshakes, gcs_failed);
+                if (gcs_cache.capacity)
+                    printf(", certificate cache %" PRIu64 " hits, %" PRIu64 " misses", __atomic_load_n(&gcs_cache.hits, __ATOMIC_RELAXED),
+                           __atomic_load_n(&gcs_cache.misses, __ATOMIC_RELAXED));
+                printf("\n");
+            }
+        }
+    }
+
+    if (glob(vehicle_glob, 0, NULL, &paths) != 0 || paths.gl_pathc == 0)
+    {
+        printf("No vehicle certificate matches %s\n", vehicle_glob);
+        return 1;
+    }
+    devices = (mavlink_device_certificate_t *)malloc(paths.gl_pathc * sizeof(mavlink_device_certificate_t));
+    if (devices == NULL)
+    {
+        printf("Out of memory for %zu vehicle certificates\n", paths.gl_pathc);
+        return 1;
+    }
+    for (i = 0; i < paths.gl_pathc; i++)
+    {
+        if (load_certificate(paths.gl_pathv[i], &devices[ndevices]))
+            ndevices++;
+    }
+    globfree(&paths);
+    if (ndevices == 0)
+    {
+        printf("No readable vehicle certificate in %s\n", vehicle_glob);
+        return 1;
+    }
+
+    for (token = strtok(steps_list, ","); token != NULL && nsteps < MAX_STEPS; token = strtok(NULL, ","))
+    {
+        steps[nsteps] = (unsigned int)atoi(token);
+        if (steps[nsteps] > 0 && steps[nsteps] <= MAX_VEHICLES)
+            nsteps++;
+    }
+
+    if (csv_path != NULL)
+    {
+        csv = fopen(csv_path, "a");
+        if (csv != NULL && ftell(csv) == 0)
+            fprintf(csv, "vehicles,handshakes_per_s,p50_us,p99_us,max_us,gcs_cpu_us_per_handshake,gcs_cpu_percent,failed,joules_per_handshake_above_idle\n");
+    }
+    if (meter != NULL && Energy_Open(meter) == 0)
+    {
+        fprintf(stderr, "energy: no RAPL counter available or advancing (powercap, perf power PMU)\n");
+        meter = NULL;
+    }
+    else if (meter != NULL)
+    {
+        idle_watts = Energy_Idle(meter, 500); // The GCS endpoint is idle between steps
+        fprintf(stderr, "energy: %s, idle %.2f W\n", Energy_Source(meter), idle_watts);
+    }
+
+    printf("%u vehicle certificates, GCS %s:%u, %u s per step\n", ndevices, host != NULL ? host : "127.0.0.1 (in process)", port, seconds);
+    printf("%8s %12s %10s %10s %10s %14s %8s %8s %10s\n", "vehicles", "handshakes/s", "p50 us", "p99 us", "max us", "GCS CPU us/hs", "GCS %", "failed", "mJ/hs");
+    for (i = 0; i < nsteps; i++)
+    {
+        if (runStep(vehicles, steps[i], devices, ndevices, seconds, 1000, gcs_clock, csv) != 0)
+        {
+            printf("Stopped at %u vehicles\n", steps[i]);
+            status = 1;
+            break;
+        }
+    }
+
+    if (gcs_cache.capacity)
+        printf("GCS certificate cache: %" PRIu64 " hits, %" PRIu64 " misses\n", __atomic_load_n(&gcs_cache.hits, __ATOMIC_RELAXED),
+               __atomic_load_n(&gcs_cache.misses, __ATOMIC_RELAXED));
+
+    if (csv != NULL)
+        fclose(csv);
+    if (meter != NULL)
+        Energy_Close(meter);
+    free(devices);
+    CertChain_Free(&trusted);
+    return status;
+}
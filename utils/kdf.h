@@ -0,0 +1,223 @@
+#pragma once
+
+#ifndef _KDF_H
+#define _KDF_H
+/***********************************************************************************
+ * HMAC-SHA512, HKDF-SHA512 (RFC 5869) and the session key schedule
+ *
+ * An HMAC key is prepared once (HMAC_SHA512_Init): the key xor ipad and key xor
+ * opad blocks are compressed with crypto_hashblocks_sha512 and only the two
+ * midstates are kept. A MAC of a short message then costs two compressions
+ * instead of four.
+ *
+ * The handshake extracts the ECDH output once into a PRK (HKDF_Extract), kept
+ * prepared in a key_schedule_t. Traffic keys are expanded from it per direction,
+ * per cipher and per epoch:
+ *
+ *   key = HKDF-Expand(PRK, "uav traffic" 0x00 cipher 0x00 direction epoch, L)
+ *
+ * so rotating keys during a long mission is a couple of hash blocks.
+ *
+ *   KDF(key, label, context) = HKDF-Expand(key, label 0x00 context, 64)
+ *
+ * derives the other single-use values (resumption secrets, binders...).
+ ***********************************************************************************/
+#include "fourq.h"
+
+#define HKDF_MAX_INFO 256
+#define KDF_DIRECTION_INITIATOR 0 // Vehicle -> GCS
+#define KDF_DIRECTION_RESPONDER 1 // GCS -> vehicle
+
+typedef struct
+{ // SHA-512 states after the key xor ipad and key xor opad blocks
+    unsigned char inner[64];
+    unsigned char outer[64];
+} hmac_sha512_key_t;
+
+typedef struct
+{
+    hmac_sha512_key_t prk;
+} key_schedule_t;
+
+static void kdf_sha512_finish(unsigned char *state, unsigned long long prefix, const unsigned char *in, unsigned long long inlen, unsigned char *out)
+{ // SHA-512 of (prefix bytes already compressed into state) || in, same padding as crypto_sha512
+    unsigned char padded[256];
+    unsigned long long bytes = prefix + inlen, i, padded_length;
+
+    crypto_hashblocks_sha512(state, in, inlen);
+    in += inlen;
+    inlen &= 127;
+    in -= inlen;
+
+    padded_length = inlen < 112 ? 128 : 256;
+    memcpy(padded, in, inlen);
+    padded[inlen] = 0x80;
+    for (i = inlen + 1; i < padded_length - 8; i++)
+        padded[i] = 0;
+    store_bigendian(&padded[padded_length - 8], bytes << 3);
+    padded[padded_length - 9] = (unsigned char)(bytes >> 61);
+    crypto_hashblocks_sha512(state, padded, padded_length);
+
+    memcpy(out, state, 64);
+}
+
+// Prepare an HMAC-SHA512 key
+void HMAC_SHA512_Init(hmac_sha512_key_t *prepared, const unsigned char *key, unsigned int key_length)
+{
+    unsigned char block[128], hashed_key[64];
+    unsigned int i;
+
+    if (key_length > 128)
+    {
+        crypto_sha512(key, key_length, hashed_key);
+        key = hashed_key;
+        key_length = 64;
+    }
+    memset(block, 0, sizeof(block));
+    memcpy(block, key, key_length);
+
+    for (i = 0; i < 128; i++)
+        block[i] ^= 0x36;
+    memcpy(prepared->inner, iv, 64);
+    crypto_hashblocks_sha512(prepared->inner, block, 128);
+
+    for (i = 0; i < 128; i++)
+        block[i] ^= 0x36 ^ 0x5c;
+    memcpy(prepared->outer, iv, 64);
+    crypto_hashblocks_sha512(prepared->outer, block, 128);
+
+    clear_words((unsigned int *)block, sizeof(block) / sizeof(unsigned int));
+    clear_words((unsigned int *)hashed_key, sizeof(hashed_key) / sizeof(unsigned int));
+}
+
+// HMAC-SHA512 of "message" under a prepared key, 64-byte output
+void HMAC_SHA512_Compute(const hmac_sha512_key_t *prepared, const unsigned char *message, unsigned long long message_length, unsigned char *mac)
+{
+    unsigned char state[64], inner[64];
+
+    memcpy(state, prepared->inner, 64);
+    kdf_sha512_finish(state, 128, message, message_length, inner);
+    memcpy(state, prepared->outer, 64);
+    kdf_sha512_finish(state, 128, inner, 64, mac);
+
+    clear_words((unsigned int *)state, sizeof(state) / sizeof(unsigned int));
+    clear_words((unsigned int *)inner, sizeof(inner) / sizeof(unsigned int));
+}
+
+// HMAC-SHA512 of "message" under "key", 64-byte output
+void HMAC_SHA512(const unsigned char *key, unsigned int key_length, const unsigned char *message, unsigned long long message_length, unsigned char *mac)
+{
+    hmac_sha512_key_t prepared;
+
+    HMAC_SHA512_Init(&prepared, key, key_length);
+    HMAC_SHA512_Compute(&prepared, message, message_length, mac);
+    clear_words((unsigned int *)&prepared, sizeof(prepared) / sizeof(unsigned int));
+}
+
+// HKDF-Extract: PRK = HMAC-SHA512(salt, ikm)
+// Outputs: prepared PRK, and the 64-byte PRK itself if prk is not NULL
+void HKDF_Extract(const unsigned char *salt, unsigned int salt_length, const unsigned char *ikm, unsigned int ikm_length, hmac_sha512_key_t *prepared, unsigned char *prk)
+{
+    unsigned char temp[64];
+
+    HMAC_SHA512(salt, salt_length, ikm, ikm_length, temp);
+    HMAC_SHA512_Init(prepared, temp, sizeof(temp));
+    if (prk != NULL)
+        memcpy(prk, temp, sizeof(temp));
+    clear_words((unsigned int *)temp, sizeof(temp) / sizeof(unsigned int));
+}
+
+// HKDF-Expand: "length" (up to 255*64) bytes of output keying material from a prepared PRK
+// Inputs: info of up to HKDF_MAX_INFO bytes
+ECCRYPTO_STATUS HKDF_Expand(const hmac_sha512_key_t *prk, const unsigned char *info, unsigned int info_length, unsigned char *out, unsigned int length)
+{
+    unsigned char block[64 + HKDF_MAX_INFO + 1], t[64];
+    unsigned int offset = 0, previous = 0, counter, n;
+
+    if (info_length > HKDF_MAX_INFO || length > 255 * 64)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    for (counter = 1; offset < length; counter++)
+    { // T(i) = HMAC(PRK, T(i-1) || info || i)
+        memcpy(&block[previous], info, info_length);
+        block[previous + info_length] = (unsigned char)counter;
+        HMAC_SHA512_Compute(prk, block, previous + info_length + 1, t);
+
+        n = length - offset < 64 ? length - offset : 64;
+        memcpy(&out[offset], t, n);
+        offset += n;
+        memcpy(block, t, 64);
+        previous = 64;
+    }
+
+    clear_words((unsigned int *)block, sizeof(block) / sizeof(unsigned int));
+    clear_words((unsigned int *)t, sizeof(t) / sizeof(unsigned int));
+    return ECCRYPTO_SUCCESS;
+}
+
+// 64 bytes derived from a prepared key for the use named by "label"
+// Inputs: NUL-terminated label, context (may be NULL if context_length is 0)
+void KDF_SHA512_Prepared(const hmac_sha512_key_t *key, const char *label, const unsigned char *context, unsigned int context_length, unsigned char *out)
+{
+    unsigned char info[HKDF_MAX_INFO], h[64];
+    unsigned int label_length = (unsigned int)strlen(label) + 1;
+
+    if (label_length + context_length > sizeof(info))
+    { // Same construction with a hashed context
+        crypto_sha512(context, context_length, h);
+        context = h;
+        context_length = sizeof(h);
+    }
+    memcpy(info, label, label_length);
+    if (context_length > 0)
+        memcpy(&info[label_length], context, context_length);
+    HKDF_Expand(key, info, label_length + context_length, out, 64);
+}
+
+// 64 bytes derived from "key" for the use named by "label"
+void KDF_SHA512(const unsigned char *key, unsigned int key_length, const char *label, const unsigned char *context, unsigned int context_length, unsigned char *out)
+{
+    hmac_sha512_key_t prepared;
+
+    HMAC_SHA512_Init(&prepared, key, key_length);
+    KDF_SHA512_Prepared(&prepared, label, context, context_length, out);
+    clear_words((unsigned int *)&prepared, sizeof(prepared) / sizeof(unsigned int));
+}
+
+// Key schedule of a session from its 64-byte PRK (handshake_t.session_key, or the key of a resumed session)
+void KeySchedule_Init(key_schedule_t *schedule, const unsigned char *prk)
+{
+    HMAC_SHA512_Init(&schedule->prk, prk, 64);
+}
+
+void KeySchedule_Free(key_schedule_t *schedule)
+{
+    clear_words((unsigned int *)schedule, sizeof(key_schedule_t) / sizeof(unsigned int));
+}
+
+// Traffic key of one direction (KDF_DIRECTION_*) and cipher (e.g. "chacha20") for a rekeying epoch
+// Both sides move to epoch + 1 to rotate keys, no new handshake is needed
+ECCRYPTO_STATUS KeySchedule_Derive(const key_schedule_t *schedule, unsigned int direction, const char *cipher, uint32_t epoch, unsigned char *key, unsigned int key_length)
+{
+    static const char label[] = "uav traffic";
+    unsigned char info[HKDF_MAX_INFO];
+    unsigned int cipher_length = (unsigned int)strlen(cipher) + 1, length;
+
+    if (direction > KDF_DIRECTION_RESPONDER || sizeof(label) + cipher_length + 5 > sizeof(info))
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    memcpy(info, label, sizeof(label));
+    length = sizeof(label);
+    memcpy(&info[length], cipher, cipher_length);
+    length += cipher_length;
+    info[length++] = (unsigned char)direction;
+    info[length++] = (unsigned char)epoch;
+    info[length++] = (unsigned char)(epoch >> 8);
+    info[length++] = (unsigned char)(epoch >> 16);
+    info[length++] = (unsigned char)(epoch >> 24);
+
+    return HKDF_Expand(&schedule->prk, info, length, key, key_length);
+}
+#endif
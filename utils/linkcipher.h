@@ -0,0 +1,562 @@
+#pragma once
+
+#ifndef _LINKCIPHER_H
+#define _LINKCIPHER_H
+/***********************************************************************************
+ * Ciphers of the MAVLink payload behind one interface, for the benchmarks
+ *
+ * A cipher_t is a key setup, an IV load and an encrypt function over a
+ * cipher_ctx_t; encrypt continues the keystream where the previous call
+ * stopped. The MAVLink library keeps one key and one IV per direction and
+ * encrypts every payload from the start of the keystream, so the link reloads
+ * the IV before each payload:
+ *
+ *   cipher->keysetup(&ctx, key);
+ *   cipher->ivsetup(&ctx, iv);   cipher->encrypt(&ctx, payload, out, length);
+ *
+ * pcap2mavlink.py decrypts captures under the same scheme.
+ *
+ * link_ciphers[] holds portable versions of the ciphers of the MAVLink library:
+ * ChaCha20 (RFC 7539), Rabbit (RFC 4503 with the IV setup and byte order of the
+ * ECRYPT code), Trivium (eSTREAM) and Simon and Speck from 64/96 to 128/256 in
+ * CTR mode. Simon and Speck read key, block and counter as little-endian words
+ * like the implementation guide of the designers; the IV is the first counter
+ * block, a little-endian integer incremented by one per block.
+ ***********************************************************************************/
+#include "fourq.h"
+
+#define MAVLINK_MAX_PAYLOAD 255
+#define LINK_MAX_KEY 32
+#define LINK_MAX_IV 16
+
+typedef struct
+{
+    uint32_t input[16];
+    unsigned char stream[64];
+    unsigned int used; // Keystream bytes of stream already consumed
+} chacha20_ctx_t;
+
+typedef struct
+{
+    uint32_t x[8], c[8], carry;
+    uint32_t master_x[8], master_c[8], master_carry; // State after the key setup, the start of every IV setup
+    unsigned char stream[16];
+    unsigned int used;
+} rabbit_ctx_t;
+
+typedef struct
+{ // Each register keeps its last 128 bits, [0] the older half: 64 clocks per step
+    uint64_t key[2];
+    uint64_t a[2], b[2], c[2];
+    unsigned char stream[8];
+    unsigned int used;
+} trivium_ctx_t;
+
+typedef struct
+{
+    union
+    {
+        uint32_t w32[44];
+        uint64_t w64[72];
+    } round_keys;
+    unsigned int rounds;
+    uint64_t counter[2]; // Block words (y, x), 64-bit blocks use the low halves
+    unsigned char stream[16];
+    unsigned int used;
+} simon_speck_ctx_t;
+
+typedef union
+{
+    chacha20_ctx_t chacha20;
+    rabbit_ctx_t rabbit;
+    trivium_ctx_t trivium;
+    simon_speck_ctx_t simon_speck;
+} cipher_ctx_t;
+
+typedef struct
+{
+    const char *name;
+    unsigned int key_bytes, iv_bytes;
+    void (*keysetup)(cipher_ctx_t *ctx, const unsigned char *key);
+    void (*ivsetup)(cipher_ctx_t *ctx, const unsigned char *iv);
+    void (*encrypt)(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length);
+} cipher_t;
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define ROTR32(v, n) (((v) >> (n)) | ((v) << (32 - (n))))
+#define ROTL64(v, n) (((v) << (n)) | ((v) >> (64 - (n))))
+#define ROTR64(v, n) (((v) >> (n)) | ((v) << (64 - (n))))
+#define QUARTERROUND(a, b, c, d)     \
+    a += b, d ^= a, d = ROTL32(d, 16); \
+    c += d, b ^= c, b = ROTL32(b, 12); \
+    a += b, d ^= a, d = ROTL32(d, 8);  \
+    c += d, b ^= c, b = ROTL32(b, 7)
+
+static uint32_t load32_le(const unsigned char *in)
+{
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static uint64_t load64_le(const unsigned char *in)
+{
+    return (uint64_t)load32_le(in) | (uint64_t)load32_le(&in[4]) << 32;
+}
+
+static void store32_le(unsigned char *out, uint32_t v)
+{
+    out[0] = (unsigned char)v;
+    out[1] = (unsigned char)(v >> 8);
+    out[2] = (unsigned char)(v >> 16);
+    out[3] = (unsigned char)(v >> 24);
+}
+
+static void store64_le(unsigned char *out, uint64_t v)
+{
+    store32_le(out, (uint32_t)v);
+    store32_le(&out[4], (uint32_t)(v >> 32));
+}
+
+static void chacha20_keysetup(cipher_ctx_t *ctx, const unsigned char *key)
+{ // Portable ChaCha20 (RFC 7539), 96-bit nonce and 32-bit block counter
+    static const unsigned char sigma[17] = "expand 32-byte k"; // 16 bytes used, the terminator keeps C++ happy
+    unsigned int i;
+
+    for (i = 0; i < 4; i++)
+        ctx->chacha20.input[i] = load32_le(&sigma[4 * i]);
+    for (i = 0; i < 8; i++)
+        ctx->chacha20.input[4 + i] = load32_le(&key[4 * i]);
+}
+
+static void chacha20_ivsetup(cipher_ctx_t *ctx, const unsigned char *iv)
+{
+    ctx->chacha20.input[12] = 0;
+    ctx->chacha20.input[13] = load32_le(&iv[0]);
+    ctx->chacha20.input[14] = load32_le(&iv[4]);
+    ctx->chacha20.input[15] = load32_le(&iv[8]);
+    ctx->chacha20.used = 64;
+}
+
+static void chacha20_block(chacha20_ctx_t *c)
+{
+    uint32_t x[16];
+    unsigned int i;
+
+    memcpy(x, c->input, sizeof(x));
+    for (i = 0; i < 10; i++)
+    {
+        QUARTERROUND(x[0], x[4], x[8], x[12]);
+        QUARTERROUND(x[1], x[5], x[9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[8], x[13]);
+        QUARTERROUND(x[3], x[4], x[9], x[14]);
+    }
+    for (i = 0; i < 16; i++)
+        store32_le(&c->stream[4 * i], x[i] + c->input[i]);
+    c->input[12]++;
+    c->used = 0;
+}
+
+static void chacha20_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    chacha20_ctx_t *c = &ctx->chacha20;
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (c->used == 64)
+            chacha20_block(c);
+        out[i] = in[i] ^ c->stream[c->used++];
+    }
+}
+
+static uint32_t rabbit_g(uint32_t u)
+{
+    uint64_t square = (uint64_t)u * u;
+
+    return (uint32_t)square ^ (uint32_t)(square >> 32);
+}
+
+static void rabbit_next_state(uint32_t *x, uint32_t *c, uint32_t *carry)
+{
+    static const uint32_t a[8] = {0x4D34D34D, 0xD34D34D3, 0x34D34D34, 0x4D34D34D, 0xD34D34D3, 0x34D34D34, 0x4D34D34D, 0xD34D34D3};
+    uint32_t g[8];
+    uint64_t t;
+    unsigned int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        t = (uint64_t)c[i] + a[i] + *carry;
+        *carry = (uint32_t)(t >> 32);
+        c[i] = (uint32_t)t;
+    }
+    for (i = 0; i < 8; i++)
+        g[i] = rabbit_g(x[i] + c[i]);
+    x[0] = g[0] + ROTL32(g[7], 16) + ROTL32(g[6], 16);
+    x[1] = g[1] + ROTL32(g[0], 8) + g[7];
+    x[2] = g[2] + ROTL32(g[1], 16) + ROTL32(g[0], 16);
+    x[3] = g[3] + ROTL32(g[2], 8) + g[1];
+    x[4] = g[4] + ROTL32(g[3], 16) + ROTL32(g[2], 16);
+    x[5] = g[5] + ROTL32(g[4], 8) + g[3];
+    x[6] = g[6] + ROTL32(g[5], 16) + ROTL32(g[4], 16);
+    x[7] = g[7] + ROTL32(g[6], 8) + g[5];
+}
+
+static void rabbit_keysetup(cipher_ctx_t *ctx, const unsigned char *key)
+{ // Rabbit (RFC 4503), 128-bit key
+    rabbit_ctx_t *r = &ctx->rabbit;
+    uint32_t k0 = load32_le(&key[0]), k1 = load32_le(&key[4]), k2 = load32_le(&key[8]), k3 = load32_le(&key[12]);
+    unsigned int i;
+
+    r->master_x[0] = k0;
+    r->master_x[2] = k1;
+    r->master_x[4] = k2;
+    r->master_x[6] = k3;
+    r->master_x[1] = (k3 << 16) | (k2 >> 16);
+    r->master_x[3] = (k0 << 16) | (k3 >> 16);
+    r->master_x[5] = (k1 << 16) | (k0 >> 16);
+    r->master_x[7] = (k2 << 16) | (k1 >> 16);
+    r->master_c[0] = ROTL32(k2, 16);
+    r->master_c[2] = ROTL32(k3, 16);
+    r->master_c[4] = ROTL32(k0, 16);
+    r->master_c[6] = ROTL32(k1, 16);
+    r->master_c[1] = (k0 & 0xFFFF0000) | (k1 & 0xFFFF);
+    r->master_c[3] = (k1 & 0xFFFF0000) | (k2 & 0xFFFF);
+    r->master_c[5] = (k2 & 0xFFFF0000) | (k3 & 0xFFFF);
+    r->master_c[7] = (k3 & 0xFFFF0000) | (k0 & 0xFFFF);
+    r->master_carry = 0;
+    for (i = 0; i < 4; i++)
+        rabbit_next_state(r->master_x, r->master_c, &r->master_carry);
+    for (i = 0; i < 8; i++)
+        r->master_c[i] ^= r->master_x[(i + 4) & 7];
+}
+
+static void rabbit_ivsetup(cipher_ctx_t *ctx, const unsigned char *iv)
+{ // 64-bit IV
+    rabbit_ctx_t *r = &ctx->rabbit;
+    uint32_t i0 = load32_le(&iv[0]), i2 = load32_le(&iv[4]);
+    uint32_t i1 = (i0 >> 16) | (i2 & 0xFFFF0000), i3 = (i2 << 16) | (i0 & 0xFFFF);
+    unsigned int i;
+
+    memcpy(r->x, r->master_x, sizeof(r->x));
+    r->c[0] = r->master_c[0] ^ i0;
+    r->c[1] = r->master_c[1] ^ i1;
+    r->c[2] = r->master_c[2] ^ i2;
+    r->c[3] = r->master_c[3] ^ i3;
+    r->c[4] = r->master_c[4] ^ i0;
+    r->c[5] = r->master_c[5] ^ i1;
+    r->c[6] = r->master_c[6] ^ i2;
+    r->c[7] = r->master_c[7] ^ i3;
+    r->carry = r->master_carry;
+    for (i = 0; i < 4; i++)
+        rabbit_next_state(r->x, r->c, &r->carry);
+    r->used = 16;
+}
+
+static void rabbit_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    rabbit_ctx_t *r = &ctx->rabbit;
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (r->used == 16)
+        {
+            rabbit_next_state(r->x, r->c, &r->carry);
+            store32_le(&r->stream[0], r->x[0] ^ (r->x[5] >> 16) ^ (r->x[3] << 16));
+            store32_le(&r->stream[4], r->x[2] ^ (r->x[7] >> 16) ^ (r->x[5] << 16));
+            store32_le(&r->stream[8], r->x[4] ^ (r->x[1] >> 16) ^ (r->x[7] << 16));
+            store32_le(&r->stream[12], r->x[6] ^ (r->x[3] >> 16) ^ (r->x[1] << 16));
+            r->used = 0;
+        }
+        out[i] = in[i] ^ r->stream[r->used++];
+    }
+}
+
+// Bits of a Trivium register clocked "lag" times ago, for the next 64 clocks
+#define TRIVIUM_BITS(r, lag) (((r)[0] >> (128 - (lag))) | ((r)[1] << ((lag)-64)))
+
+static uint64_t trivium_step(trivium_ctx_t *t)
+{ // 64 clocks, returns the keystream bits (first clock in bit 0)
+    uint64_t z, a, b, c;
+
+    z = TRIVIUM_BITS(t->a, 66) ^ TRIVIUM_BITS(t->a, 93) ^ TRIVIUM_BITS(t->b, 69) ^ TRIVIUM_BITS(t->b, 84) ^ TRIVIUM_BITS(t->c, 66) ^ TRIVIUM_BITS(t->c, 111);
+    a = TRIVIUM_BITS(t->c, 66) ^ TRIVIUM_BITS(t->c, 111) ^ (TRIVIUM_BITS(t->c, 109) & TRIVIUM_BITS(t->c, 110)) ^ TRIVIUM_BITS(t->a, 69);
+    b = TRIVIUM_BITS(t->a, 66) ^ TRIVIUM_BITS(t->a, 93) ^ (TRIVIUM_BITS(t->a, 91) & TRIVIUM_BITS(t->a, 92)) ^ TRIVIUM_BITS(t->b, 78);
+    c = TRIVIUM_BITS(t->b, 69) ^ TRIVIUM_BITS(t->b, 84) ^ (TRIVIUM_BITS(t->b, 82) & TRIVIUM_BITS(t->b, 83)) ^ TRIVIUM_BITS(t->c, 87);
+    t->a[0] = t->a[1];
+    t->a[1] = a;
+    t->b[0] = t->b[1];
+    t->b[1] = b;
+    t->c[0] = t->c[1];
+    t->c[1] = c;
+    return z;
+}
+
+static void trivium_keysetup(cipher_ctx_t *ctx, const unsigned char *key)
+{ // Trivium (eSTREAM), 80-bit key read as a little-endian integer, its top bit is s1
+    ctx->trivium.key[0] = (uint64_t)(key[0] | key[1] << 8) << 48;
+    ctx->trivium.key[1] = load64_le(&key[2]);
+}
+
+static void trivium_ivsetup(cipher_ctx_t *ctx, const unsigned char *iv)
+{ // 80-bit IV, same bit order as the key
+    trivium_ctx_t *t = &ctx->trivium;
+    unsigned int i;
+
+    t->a[0] = t->key[0];
+    t->a[1] = t->key[1];
+    t->b[0] = (uint64_t)(iv[0] | iv[1] << 8) << 48;
+    t->b[1] = load64_le(&iv[2]);
+    t->c[0] = (uint64_t)7 << 17; // s286, s287, s288
+    t->c[1] = 0;
+    for (i = 0; i < 4 * 288 / 64; i++)
+        trivium_step(t);
+    t->used = 8;
+}
+
+static void trivium_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    trivium_ctx_t *t = &ctx->trivium;
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (t->used == 8)
+        {
+            store64_le(t->stream, trivium_step(t));
+            t->used = 0;
+        }
+        out[i] = in[i] ^ t->stream[t->used++];
+    }
+}
+
+#define SIMON_Z2 0x7369F885192C0EF5ULL
+#define SIMON_Z3 0xFC2CE51207A635DBULL
+#define SIMON_Z4 0xFDC94C3A046D678BULL
+
+static void simon64_keysetup(simon_speck_ctx_t *s, const unsigned char *key, unsigned int m, unsigned int rounds, uint64_t z)
+{ // Simon with 64-bit block, m key words
+    uint32_t *k = s->round_keys.w32, tmp;
+    unsigned int i;
+
+    for (i = 0; i < m; i++)
+        k[i] = load32_le(&key[4 * i]);
+    for (i = m; i < rounds; i++)
+    {
+        tmp = ROTR32(k[i - 1], 3);
+        if (m == 4)
+            tmp ^= k[i - 3];
+        tmp ^= ROTR32(tmp, 1);
+        k[i] = ~k[i - m] ^ tmp ^ (uint32_t)((z >> ((i - m) % 62)) & 1) ^ 3;
+    }
+    s->rounds = rounds;
+}
+
+static void simon128_keysetup(simon_speck_ctx_t *s, const unsigned char *key, unsigned int m, unsigned int rounds, uint64_t z)
+{ // Simon with 128-bit block, m key words
+    uint64_t *k = s->round_keys.w64, tmp;
+    unsigned int i;
+
+    for (i = 0; i < m; i++)
+        k[i] = load64_le(&key[8 * i]);
+    for (i = m; i < rounds; i++)
+    {
+        tmp = ROTR64(k[i - 1], 3);
+        if (m == 4)
+            tmp ^= k[i - 3];
+        tmp ^= ROTR64(tmp, 1);
+        k[i] = ~k[i - m] ^ tmp ^ ((z >> ((i - m) % 62)) & 1) ^ 3;
+    }
+    s->rounds = rounds;
+}
+
+static void speck64_keysetup(simon_speck_ctx_t *s, const unsigned char *key, unsigned int m, unsigned int rounds)
+{ // Speck with 64-bit block, m key words
+    uint32_t l[3 + 27], a = load32_le(&key[0]);
+    unsigned int i;
+
+    for (i = 0; i < m - 1; i++)
+        l[i] = load32_le(&key[4 * (i + 1)]);
+    s->round_keys.w32[0] = a;
+    for (i = 0; i < rounds - 1; i++)
+    {
+        l[i + m - 1] = (a + ROTR32(l[i], 8)) ^ i;
+        a = ROTL32(a, 3) ^ l[i + m - 1];
+        s->round_keys.w32[i + 1] = a;
+    }
+    s->rounds = rounds;
+}
+
+static void speck128_keysetup(simon_speck_ctx_t *s, const unsigned char *key, unsigned int m, unsigned int rounds)
+{ // Speck with 128-bit block, m key words
+    uint64_t l[3 + 34], a = load64_le(&key[0]);
+    unsigned int i;
+
+    for (i = 0; i < m - 1; i++)
+        l[i] = load64_le(&key[8 * (i + 1)]);
+    s->round_keys.w64[0] = a;
+    for (i = 0; i < rounds - 1; i++)
+    {
+        l[i + m - 1] = (a + ROTR64(l[i], 8)) ^ i;
+        a = ROTL64(a, 3) ^ l[i + m - 1];
+        s->round_keys.w64[i + 1] = a;
+    }
+    s->rounds = rounds;
+}
+
+static void simon64_block(simon_speck_ctx_t *s)
+{ // Encrypts the counter into stream
+    uint32_t y = (uint32_t)s->counter[0], x = (uint32_t)s->counter[1], tmp;
+    unsigned int i;
+
+    for (i = 0; i < s->rounds; i++)
+    {
+        tmp = x;
+        x = y ^ (ROTL32(x, 1) & ROTL32(x, 8)) ^ ROTL32(x, 2) ^ s->round_keys.w32[i];
+        y = tmp;
+    }
+    store32_le(&s->stream[0], y);
+    store32_le(&s->stream[4], x);
+}
+
+static void simon128_block(simon_speck_ctx_t *s)
+{
+    uint64_t y = s->counter[0], x = s->counter[1], tmp;
+    unsigned int i;
+
+    for (i = 0; i < s->rounds; i++)
+    {
+        tmp = x;
+        x = y ^ (ROTL64(x, 1) & ROTL64(x, 8)) ^ ROTL64(x, 2) ^ s->round_keys.w64[i];
+        y = tmp;
+    }
+    store64_le(&s->stream[0], y);
+    store64_le(&s->stream[8], x);
+}
+
+static void speck64_block(simon_speck_ctx_t *s)
+{
+    uint32_t y = (uint32_t)s->counter[0], x = (uint32_t)s->counter[1];
+    unsigned int i;
+
+    for (i = 0; i < s->rounds; i++)
+    {
+        x = (ROTR32(x, 8) + y) ^ s->round_keys.w32[i];
+        y = ROTL32(y, 3) ^ x;
+    }
+    store32_le(&s->stream[0], y);
+    store32_le(&s->stream[4], x);
+}
+
+static void speck128_block(simon_speck_ctx_t *s)
+{
+    uint64_t y = s->counter[0], x = s->counter[1];
+    unsigned int i;
+
+    for (i = 0; i < s->rounds; i++)
+    {
+        x = (ROTR64(x, 8) + y) ^ s->round_keys.w64[i];
+        y = ROTL64(y, 3) ^ x;
+    }
+    store64_le(&s->stream[0], y);
+    store64_le(&s->stream[8], x);
+}
+
+static void ctr64_ivsetup(cipher_ctx_t *ctx, const unsigned char *iv)
+{ // First counter block of a 64-bit block cipher
+    ctx->simon_speck.counter[0] = load32_le(&iv[0]);
+    ctx->simon_speck.counter[1] = load32_le(&iv[4]);
+    ctx->simon_speck.used = 8;
+}
+
+static void ctr128_ivsetup(cipher_ctx_t *ctx, const unsigned char *iv)
+{
+    ctx->simon_speck.counter[0] = load64_le(&iv[0]);
+    ctx->simon_speck.counter[1] = load64_le(&iv[8]);
+    ctx->simon_speck.used = 16;
+}
+
+static void ctr_encrypt(simon_speck_ctx_t *s, const unsigned char *in, unsigned char *out, unsigned int length, unsigned int block_bytes, void (*block)(simon_speck_ctx_t *s))
+{ // CTR mode, the counter is incremented as a little-endian integer of block_bytes bytes
+    uint64_t mask = block_bytes == 8 ? 0xFFFFFFFF : UINT64_MAX;
+    unsigned int i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (s->used == block_bytes)
+        {
+            block(s);
+            s->counter[0] = (s->counter[0] + 1) & mask;
+            if (s->counter[0] == 0)
+                s->counter[1] = (s->counter[1] + 1) & mask;
+            s->used = 0;
+        }
+        out[i] = in[i] ^ s->stream[s->used++];
+    }
+}
+
+static void simon64_ctr_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    ctr_encrypt(&ctx->simon_speck, in, out, length, 8, simon64_block);
+}
+
+static void simon128_ctr_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    ctr_encrypt(&ctx->simon_speck, in, out, length, 16, simon128_block);
+}
+
+static void speck64_ctr_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    ctr_encrypt(&ctx->simon_speck, in, out, length, 8, speck64_block);
+}
+
+static void speck128_ctr_encrypt(cipher_ctx_t *ctx, const unsigned char *in, unsigned char *out, unsigned int length)
+{
+    ctr_encrypt(&ctx->simon_speck, in, out, length, 16, speck128_block);
+}
+
+static void simon6496_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { simon64_keysetup(&ctx->simon_speck, key, 3, 42, SIMON_Z2); }
+static void simon64128_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { simon64_keysetup(&ctx->simon_speck, key, 4, 44, SIMON_Z3); }
+static void simon128128_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { simon128_keysetup(&ctx->simon_speck, key, 2, 68, SIMON_Z2); }
+static void simon128192_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { simon128_keysetup(&ctx->simon_speck, key, 3, 69, SIMON_Z3); }
+static void simon128256_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { simon128_keysetup(&ctx->simon_speck, key, 4, 72, SIMON_Z4); }
+static void speck6496_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { speck64_keysetup(&ctx->simon_speck, key, 3, 26); }
+static void speck64128_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { speck64_keysetup(&ctx->simon_speck, key, 4, 27); }
+static void speck128128_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { speck128_keysetup(&ctx->simon_speck, key, 2, 32); }
+static void speck128192_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { speck128_keysetup(&ctx->simon_speck, key, 3, 33); }
+static void speck128256_keysetup(cipher_ctx_t *ctx, const unsigned char *key) { speck128_keysetup(&ctx->simon_speck, key, 4, 34); }
+
+static const cipher_t link_ciphers[] = {
+    {"chacha20", 32, 12, chacha20_keysetup, chacha20_ivsetup, chacha20_encrypt},
+    {"rabbit", 16, 8, rabbit_keysetup, rabbit_ivsetup, rabbit_encrypt},
+    {"trivium", 10, 10, trivium_keysetup, trivium_ivsetup, trivium_encrypt},
+    {"simon6496-ctr", 12, 8, simon6496_keysetup, ctr64_ivsetup, simon64_ctr_encrypt},
+    {"simon64128-ctr", 16, 8, simon64128_keysetup, ctr64_ivsetup, simon64_ctr_encrypt},
+    {"simon128128-ctr", 16, 16, simon128128_keysetup, ctr128_ivsetup, simon128_ctr_encrypt},
+    {"simon128192-ctr", 24, 16, simon128192_keysetup, ctr128_ivsetup, simon128_ctr_encrypt},
+    {"simon128256-ctr", 32, 16, simon128256_keysetup, ctr128_ivsetup, simon128_ctr_encrypt},
+    {"speck6496-ctr", 12, 8, speck6496_keysetup, ctr64_ivsetup, speck64_ctr_encrypt},
+    {"speck64128-ctr", 16, 8, speck64128_keysetup, ctr64_ivsetup, speck64_ctr_encrypt},
+    {"speck128128-ctr", 16, 16, speck128128_keysetup, ctr128_ivsetup, speck128_ctr_encrypt},
+    {"speck128192-ctr", 24, 16, speck128192_keysetup, ctr128_ivsetup, speck128_ctr_encrypt},
+    {"speck128256-ctr", 32, 16, speck128256_keysetup, ctr128_ivsetup, speck128_ctr_encrypt},
+};
+
+#define LINK_CIPHERS (sizeof(link_ciphers) / sizeof(link_ciphers[0]))
+
+// Cipher of link_ciphers by name, NULL if unknown
+const cipher_t *LinkCipher_Find(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < LINK_CIPHERS; i++)
+    {
+        if (strcmp(link_ciphers[i].name, name) == 0)
+            return &link_ciphers[i];
+    }
+    return NULL;
+}
+#endif
@@ -0,0 +1,222 @@
+#pragma once
+
+#ifndef _MERKLE_H
+#define _MERKLE_H
+/***********************************************************************************
+ * Merkle-batched SchnorrQ signing of message windows
+ *
+ * The sender accumulates up to MERKLE_MAX_WINDOW outgoing messages, hashes them
+ * into a Merkle tree and signs only the root (once per window) with SchnorrQ_Sign.
+ * Every message is then authenticated by the signed root plus an inclusion proof
+ * of log2(window) hashes.
+ *
+ * leaf = H(0x00 || message), node = H(0x01 || left || right), truncated to
+ * MERKLE_HASH_BYTES. Missing leaves of a partial window are all-zero nodes.
+ * Signed message = root || window size (32-bit little endian).
+ ***********************************************************************************/
+#include "fourq.h"
+
+#define MERKLE_HASH_BYTES 32
+#define MERKLE_MAX_WINDOW 64   // Memory requirement: 4KB per window (128 nodes)
+#define MERKLE_LEAF_BUFFER 280 // Messages up to MAVLINK_MAX_PACKET_LEN are hashed without heap allocation
+#define MERKLE_MAX_PROOF (6 * MERKLE_HASH_BYTES)
+
+typedef struct
+{
+    unsigned int count; // Number of messages in the window
+    unsigned int size;  // Number of leaves, count rounded up to a power of two
+    unsigned char nodes[2 * MERKLE_MAX_WINDOW][MERKLE_HASH_BYTES]; // nodes[1] is the root, leaves start at nodes[size]
+} merkle_window_t;
+
+static ECCRYPTO_STATUS merkle_leaf(const unsigned char *Message, unsigned int SizeMessage, unsigned char *leaf)
+{ // leaf = H(0x00 || Message)
+    unsigned char buffer[MERKLE_LEAF_BUFFER + 1], h[64], *temp = buffer;
+    ECCRYPTO_STATUS Status = ECCRYPTO_SUCCESS;
+
+    if (SizeMessage > MERKLE_LEAF_BUFFER)
+    {
+        temp = (unsigned char *)calloc(1, SizeMessage + 1);
+        if (temp == NULL)
+        {
+            return ECCRYPTO_ERROR_NO_MEMORY;
+        }
+    }
+
+    temp[0] = 0x00;
+    memmove(temp + 1, Message, SizeMessage);
+    if (CryptoHashFunction(temp, SizeMessage + 1, h) != 0)
+    {
+        Status = ECCRYPTO_ERROR;
+    }
+    memmove(leaf, h, MERKLE_HASH_BYTES);
+
+    if (temp != buffer)
+        free(temp);
+
+    return Status;
+}
+
+static void merkle_node(const unsigned char *left, const unsigned char *right, unsigned char *node)
+{ // node = H(0x01 || left || right)
+    unsigned char temp[2 * MERKLE_HASH_BYTES + 1], h[64];
+
+    temp[0] = 0x01;
+    memmove(temp + 1, left, MERKLE_HASH_BYTES);
+    memmove(temp + 1 + MERKLE_HASH_BYTES, right, MERKLE_HASH_BYTES);
+    CryptoHashFunction(temp, sizeof(temp), h);
+    memmove(node, h, MERKLE_HASH_BYTES);
+}
+
+static unsigned int merkle_size(unsigned int count)
+{ // Number of leaves of a window with "count" messages
+    unsigned int size = 1;
+
+    while (size < count)
+        size <<= 1;
+    return size;
+}
+
+static void merkle_signed_message(const unsigned char *root, unsigned int count, unsigned char *out)
+{ // out = root || count
+    memmove(out, root, MERKLE_HASH_BYTES);
+    out[MERKLE_HASH_BYTES] = (unsigned char)count;
+    out[MERKLE_HASH_BYTES + 1] = (unsigned char)(count >> 8);
+    out[MERKLE_HASH_BYTES + 2] = (unsigned char)(count >> 16);
+    out[MERKLE_HASH_BYTES + 3] = (unsigned char)(count >> 24);
+}
+
+// Start a new (empty) window
+void MerkleWindow_Init(merkle_window_t *window)
+{
+    window->count = 0;
+    window->size = 0;
+}
+
+// Add a message to the window
+// Inputs: Message of size SizeMessage in bytes
+// Output: index of the message in the window, or -1 if the window is full, already signed or hashing fails
+int MerkleWindow_Add(merkle_window_t *window, const unsigned char *Message, unsigned int SizeMessage)
+{
+    if (window->count >= MERKLE_MAX_WINDOW || window->size != 0)
+    {
+        return -1;
+    }
+    // Leaves are staged in the upper half of the array until the window is closed
+    if (merkle_leaf(Message, SizeMessage, window->nodes[MERKLE_MAX_WINDOW + window->count]) != ECCRYPTO_SUCCESS)
+    {
+        return -1;
+    }
+    return (int)window->count++;
+}
+
+// Close the window: build the tree and sign its root
+// Inputs: 32-byte SecretKey, 32-byte PublicKey
+// Outputs: MERKLE_HASH_BYTES-byte Root and 64-byte Signature over Root || window size
+ECCRYPTO_STATUS MerkleWindow_Sign(merkle_window_t *window, const unsigned char *SecretKey, const unsigned char *PublicKey, unsigned char *Root, unsigned char *Signature)
+{
+    unsigned char message[MERKLE_HASH_BYTES + 4];
+    unsigned int i;
+
+    if (window->count == 0)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    window->size = merkle_size(window->count);
+    if (window->size != MERKLE_MAX_WINDOW)
+    { // Move the staged leaves down to their final position
+        memmove(window->nodes[window->size], window->nodes[MERKLE_MAX_WINDOW], window->count * MERKLE_HASH_BYTES);
+    }
+    memset(window->nodes[window->size + window->count], 0, (window->size - window->count) * MERKLE_HASH_BYTES);
+
+    for (i = window->size - 1; i > 0; i--)
+    {
+        merkle_node(window->nodes[2 * i], window->nodes[2 * i + 1], window->nodes[i]);
+    }
+    memmove(Root, window->nodes[1], MERKLE_HASH_BYTES);
+    merkle_signed_message(Root, window->count, message);
+
+    return SchnorrQ_Sign(SecretKey, PublicKey, message, sizeof(message), Signature);
+}
+
+// Inclusion proof of a message of a signed window
+// Input: index of the message
+// Output: Proof (sibling hashes from the leaf up to the root). Returns the proof size in bytes (0 if index is out of range)
+unsigned int MerkleWindow_Proof(const merkle_window_t *window, unsigned int index, unsigned char *Proof)
+{
+    unsigned int node, length = 0;
+
+    if (index >= window->count || window->size == 0)
+    {
+        return 0;
+    }
+
+    for (node = window->size + index; node > 1; node >>= 1)
+    {
+        memmove(Proof + length, window->nodes[node ^ 1], MERKLE_HASH_BYTES);
+        length += MERKLE_HASH_BYTES;
+    }
+    return length;
+}
+
+// Verification of a signed window root (once per window)
+// Inputs: 32-byte PublicKey, MERKLE_HASH_BYTES-byte Root, window size Count, 64-byte Signature
+// Output: true (valid root) or false (invalid root)
+ECCRYPTO_STATUS MerkleWindow_VerifyRoot(const unsigned char *PublicKey, const unsigned char *Root, unsigned int Count, const unsigned char *Signature, unsigned int *valid)
+{
+    unsigned char message[MERKLE_HASH_BYTES + 4];
+
+    *valid = false;
+    if (Count == 0 || Count > MERKLE_MAX_WINDOW)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+
+    merkle_signed_message(Root, Count, message);
+    return SchnorrQ_Verify(PublicKey, message, sizeof(message), Signature, valid);
+}
+
+// Verification of a message against a root previously checked with MerkleWindow_VerifyRoot()
+// Inputs: MERKLE_HASH_BYTES-byte Root, window size Count, message index, Message of size SizeMessage in bytes, Proof of size SizeProof in bytes
+// Output: true (message belongs to the window at position index) or false
+bool MerkleWindow_VerifyProof(const unsigned char *Root, unsigned int Count, unsigned int index, const unsigned char *Message, unsigned int SizeMessage, const unsigned char *Proof, unsigned int SizeProof)
+{
+    unsigned char node[MERKLE_HASH_BYTES];
+    unsigned int size, position, length;
+
+    if (Count == 0 || Count > MERKLE_MAX_WINDOW || index >= Count)
+    {
+        return false;
+    }
+
+    size = merkle_size(Count);
+    length = 0;
+    for (position = size; position > 1; position >>= 1)
+    {
+        length += MERKLE_HASH_BYTES;
+    }
+    if (SizeProof != length)
+    {
+        return false;
+    }
+
+    if (merkle_leaf(Message, SizeMessage, node) != ECCRYPTO_SUCCESS)
+    {
+        return false;
+    }
+
+    for (position = size + index, length = 0; position > 1; position >>= 1, length += MERKLE_HASH_BYTES)
+    {
+        if (position & 1)
+        {
+            merkle_node(Proof + length, node, node);
+        }
+        else
+        {
+            merkle_node(node, Proof + length, node);
+        }
+    }
+
+    return (memcmp(node, Root, MERKLE_HASH_BYTES) == 0);
+}
+#endif
@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+#include "linkcipher.h"
+#include "energy.h"
+#include "bench.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <errno.h>
+
+// Mission replay: drives the encryption and decryption of every MAVLink payload of a
+// message trace (utils/plan2trace.py from a plan, or pcap2mavlink.py --trace from a
+// capture) through each link cipher (linkcipher.h) at fixed multiples of real time,
+// without a simulator. Messages are sent on an absolute schedule, so a rate the cipher
+// cannot keep up with shows as lag; "max" replays unpaced and gives the message rate at
+// which the cipher saturates one core. With RAPL counters (energy.h) every run also reports
+// the energy per message above the idle power of the package. -K writes the keys and IVs
+// of every run to a pcap2mavlink.py key log, to check its keystreams against linkcipher.h.
+
+#define MAX_RATES 16
+#define RATE_MAX 0.0 // Unpaced
+#define SENDER_UAV 0
+#define SENDER_GCS 1
+
+typedef struct
+{
+    uint64_t time_us;
+    unsigned char sender, length;
+} trace_message_t;
+
+typedef struct
+{
+    trace_message_t *messages;
+    size_t count;
+    uint64_t duration_us; // Period of one pass, the trace is looped to fill a run
+} trace_t;
+
+typedef struct
+{
+    uint64_t messages, bytes;
+    double wall_s, cpu_s;
+    double lag_p99_us, lag_max_us; // Late start of a message against its schedule
+    double joules, joules_above_idle;
+} replay_result_t;
+
+static int load_trace(const char *path, trace_t *trace)
+{ // time_us,sender,msgid,length lines after a header, in time order
+    FILE *fp = fopen(path, "r");
+    char line[256], sender[8];
+    uint64_t time_us;
+    unsigned int msgid, length;
+    size_t capacity = 0;
+    trace_message_t *grown;
+
+    if (fp == NULL)
+        return 0;
+    memset(trace, 0, sizeof(trace_t));
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (sscanf(line, "%" SCNu64 ",%7[^,],%u,%u", &time_us, sender, &msgid, &length) != 4)
+            continue; // Header
+        if (trace->count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 4096;
+            grown = realloc(trace->messages, capacity * sizeof(trace_message_t));
+            if (grown == NULL)
+            {
+                fclose(fp);
+                return 0;
+            }
+            trace->messages = grown;
+        }
+        trace->messages[trace->count].time_us = time_us;
+        trace->messages[trace->count].sender = strcmp(sender, "GCS") == 0 ? SENDER_GCS : SENDER_UAV;
+        trace->messages[trace->count].length = (unsigned char)(length > MAVLINK_MAX_PAYLOAD ? MAVLINK_MAX_PAYLOAD : length);
+        trace->count++;
+    }
+    fclose(fp);
+    if (trace->count == 0)
+        return 0;
+    // One pass lasts until the last message plus a mean interval, so loops keep the spacing
+    trace->duration_us = trace->messages[trace->count - 1].time_us + trace->messages[trace->count - 1].time_us / trace->count + 1;
+    return 1;
+}
+
+static void write_keylog(FILE *keylog, const cipher_t *cipher, const char *sender, const unsigned char *key, const unsigned char *iv)
+{ // "<cipher> UAV|GCS <key hex> <iv hex>", the traffic key form of the pcap2mavlink.py --keylog file
+    unsigned int i;
+
+    fprintf(keylog, "%s %s ", cipher->name, sender);
+    for (i = 0; i < cipher->key_bytes; i++)
+        fprintf(keylog, "%02x", key[i]);
+    fprintf(keylog, " ");
+    for (i = 0; i < cipher->iv_bytes; i++)
+        fprintf(keylog, "%02x", iv[i]);
+    fprintf(keylog, "\n");
+    fflush(keylog);
+}
+
+void runReplay(const cipher_t *cipher, const trace_t *trace, double rate, unsigned int seconds, energy_meter_t *meter, double idle_watts, FILE *keylog, replay_result_t *result)
+{
+    static cipher_ctx_t encrypt[2], decrypt[2];
+    unsigned char key[2][LINK_MAX_KEY], iv[2][LINK_MAX_IV], payload[MAVLINK_MAX_PAYLOAD], ciphertext[MAVLINK_MAX_PAYLOAD], plaintext[MAVLINK_MAX_PAYLOAD];
+    uint64_t start, deadline, target, now, cpu, loop, *lags = NULL;
+    size_t i, nlags = 0, max_lags = 0;
+    unsigned int s, j;
+    const trace_message_t *m;
+    struct timespec ts;
+
+    memset(result, 0, sizeof(replay_result_t));
+    random_bytes((unsigned char *)key, sizeof(key));
+    random_bytes((unsigned char *)iv, sizeof(iv));
+    if (keylog != NULL)
+    { // Debug only: anyone with the log can decrypt the traffic
+        write_keylog(keylog, cipher, "UAV", key[SENDER_UAV], iv[SENDER_UAV]);
+        write_keylog(keylog, cipher, "GCS", key[SENDER_GCS], iv[SENDER_GCS]);
+    }
+    for (j = 0; j < sizeof(payload); j++)
+        payload[j] = (unsigned char)j;
+    for (s = 0; s < 2; s++)
+    {
+        cipher->keysetup(&encrypt[s], key[s]);
+        cipher->keysetup(&decrypt[s], key[s]);
+    }
+    if (rate != RATE_MAX)
+    {
+        max_lags = seconds ? (size_t)((seconds * 1e6 * rate / trace->duration_us + 1) * trace->count) : trace->count;
+        lags = malloc(max_lags * sizeof(uint64_t));
+    }
+    // Whole trace once, or as many loops as fit in the run
+    deadline = seconds ? (uint64_t)seconds * 1000000000ULL : 0;
+
+    if (meter != NULL)
+        Energy_Start(meter);
+    start = Bench_Now(CLOCK_MONOTONIC);
+    cpu = Bench_Now(CLOCK_THREAD_CPUTIME_ID);
+    for (loop = 0;; loop++)
+    {
+        for (i = 0; i < trace->count; i++)
+        {
+            m = &trace->messages[i];
+            if (rate != RATE_MAX)
+            {
+                target = (uint64_t)((loop * trace->duration_us + m->time_us) * 1000.0 / rate);
+                if (deadline && target >= deadline)
+                    goto done;
+                now = Bench_Now(CLOCK_MONOTONIC) - start;
+                if (now < target)
+                {
+                    ts.tv_sec = (time_t)((start + target) / 1000000000ULL);
+                    ts.tv_nsec = (long)((start + target) % 1000000000ULL);
+                    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                        ;
+                    now = Bench_Now(CLOCK_MONOTONIC) - start;
+                }
+                if (lags != NULL && nlags < max_lags)
+                    lags[nlags++] = now > target ? now - target : 0;
+            }
+            else if ((result->messages & 255) == 0 && deadline && Bench_Now(CLOCK_MONOTONIC) - start >= deadline)
+            {
+                goto done;
+            }
+
+            // The fixed IV of the direction is reloaded for every payload, as the MAVLink library does
+            cipher->ivsetup(&encrypt[m->sender], iv[m->sender]);
+            cipher->encrypt(&encrypt[m->sender], payload, ciphertext, m->length);
+            cipher->ivsetup(&decrypt[m->sender], iv[m->sender]);
+            cipher->encrypt(&decrypt[m->sender], ciphertext, plaintext, m->length);
+            result->messages++;
+            result->bytes += m->length;
+        }
+        if (!deadline)
+            break;
+    }
+done:
+    result->cpu_s = (Bench_Now(CLOCK_THREAD_CPUTIME_ID) - cpu) / 1e9;
+    result->wall_s = (Bench_Now(CLOCK_MONOTONIC) - start) / 1e9;
+    if (meter != NULL)
+    {
+        result->joules = Energy_Stop(meter, NULL);
+        result->joules_above_idle = result->joules - idle_watts * result->wall_s;
+    }
+    if (nlags > 0)
+    {
+        qsort(lags, nlags, sizeof(uint64_t), Bench_CompareU64);
+        result->lag_p99_us = Bench_PercentileUs(lags, nlags, 99);
+        result->lag_max_us = lags[nlags - 1] / 1e3;
+    }
+    free(lags);
+    memset(encrypt, 0, sizeof(encrypt));
+    memset(decrypt, 0, sizeof(decrypt));
+    memset(key, 0, sizeof(key));
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s -t trace [-r rates] [-d seconds] [-f filter] [-c cpu] [-o results.csv] [-E] [-K keylog]\n", name);
+    printf("  -t: message trace (utils/plan2trace.py, or pcap2mavlink.py --trace)\n");
+    printf("  -r: multiples of real time, comma separated, max for unpaced (default: 1,10,100,max)\n");
+    printf("  -d: seconds per run, the trace is looped or cut to fit; 0 replays it once (default: 10)\n");
+    printf("  -f: only run ciphers whose name contains the filter\n");
+    printf("  -c: pin the process to one CPU\n");
+    printf("  -o: append the results to a CSV file\n");
+    printf("  -E: do not read the energy counters\n");
+    printf("  -K: debug, append the traffic keys and IVs of every run to a key log (pcap2mavlink.py --keylog)\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace_path = NULL, *filter = NULL, *csv_path = NULL, *keylog_path = NULL;
+    char rates_list[256] = "1,10,100,max", *token, rate_name[32];
+    double rates[MAX_RATES], trace_rate, msg_rate;
+    unsigned int nrates = 0, seconds = 10, i, r;
+    energy_meter_t energy, *meter = &energy;
+    double idle_watts = 0;
+    trace_t trace;
+    replay_result_t result;
+    FILE *csv = NULL, *keylog = NULL;
+    int opt, cpu = -1;
+
+    while ((opt = getopt(argc, argv, "t:r:d:f:c:o:EK:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'r':
+            snprintf(rates_list, sizeof(rates_list), "%s", optarg);
+            break;
+        case 'd':
+            seconds = (unsigned int)atoi(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        case 'E':
+            meter = NULL;
+            break;
+        case 'K':
+            keylog_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    for (token = strtok(rates_list, ","); token != NULL && nrates < MAX_RATES; token = strtok(NULL, ","))
+    {
+        rates[nrates] = strcmp(token, "max") == 0 ? RATE_MAX : atof(token);
+        if (rates[nrates] < 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        nrates++;
+    }
+    if (trace_path == NULL || nrates == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!load_trace(trace_path, &trace))
+    {
+        fprintf(stderr, "%s: cannot read the trace\n", trace_path);
+        return 1;
+    }
+    Bench_PinCpu(cpu);
+    if (csv_path != NULL)
+    {
+        csv = fopen(csv_path, "a");
+        if (csv == NULL)
+        {
+            perror(csv_path);
+            return 1;
+        }
+        if (ftell(csv) == 0)
+            fprintf(csv, "cipher,rate,messages,bytes,wall_s,cpu_s,messages_per_s,mbytes_per_s,cpu_percent,lag_p99_us,lag_max_us,joules_per_message,joules_per_message_above_idle\n");
+    }
+    if (keylog_path != NULL)
+    {
+        keylog = fopen(keylog_path, "a");
+        if (keylog == NULL)
+        {
+            perror(keylog_path);
+            return 1;
+        }
+        fprintf(stderr, "key log: %s, for debugging only\n", keylog_path);
+    }
+    if (meter != NULL && Energy_Open(meter) == 0)
+    {
+        fprintf(stderr, "energy: no RAPL counter available or advancing (powercap, perf power PMU)\n");
+        meter = NULL;
+    }
+    else if (meter != NULL)
+    {
+        idle_watts = Energy_Idle(meter, 500);
+        fprintf(stderr, "energy: %s, idle %.2f W\n", Energy_Source(meter), idle_watts);
+    }
+
+    trace_rate = trace.count * 1e6 / trace.duration_us;
+    printf("%s: %zu messages over %.1f s (%.1f messages/s)\n", trace_path, trace.count, trace.duration_us / 1e6, trace_rate);
+    printf("%-16s %6s %10s %12s %10s %7s %12s %12s %10s\n", "cipher", "rate", "messages", "messages/s", "MB/s", "CPU %", "lag p99 us", "lag max us", "uJ/msg");
+    for (i = 0; i < LINK_CIPHERS; i++)
+    {
+        const cipher_t *cipher = &link_ciphers[i];
+
+        if (filter != NULL && strstr(cipher->name, filter) == NULL)
+            continue;
+        for (r = 0; r < nrates; r++)
+        {
+            runReplay(cipher, &trace, rates[r], seconds, meter, idle_watts, keylog, &result);
+            msg_rate = result.wall_s > 0 ? result.messages / result.wall_s : 0;
+            if (rates[r] == RATE_MAX)
+                snprintf(rate_name, sizeof(rate_name), "max");
+            else
+                snprintf(rate_name, sizeof(rate_name), "%gx", rates[r]);
+            printf("%-16s %6s", r == 0 ? cipher->name : "", rate_name);
+            printf(" %10" PRIu64 " %12.0f %10.3f %7.1f", result.messages, msg_rate, result.wall_s > 0 ? result.bytes / result.wall_s / 1e6 : 0,
+                   result.wall_s > 0 ? 100.0 * result.cpu_s / result.wall_s : 0);
+            if (rates[r] == RATE_MAX)
+                printf(" %12s %12s", "-", "-");
+            else
+                printf(" %12.1f %12.1f", result.lag_p99_us, result.lag_max_us);
+            if (meter != NULL && result.messages > 0)
+                printf(" %10.3f", result.joules_above_idle * 1e6 / result.messages);
+            else
+                printf(" %10s", "-");
+            if (rates[r] == RATE_MAX)
+                printf("   saturates one core at %.0fx real time", msg_rate / trace_rate);
+            printf("\n");
+            if (csv != NULL)
+            {
+                fprintf(csv, "%s,%s,%" PRIu64 ",%" PRIu64 ",%.3f,%.3f,%.0f,%.3f,%.1f,%.1f,%.1f,", cipher->name, rate_name, result.messages, result.bytes, result.wall_s, result.cpu_s, msg_rate, result.wall_s > 0 ? result.bytes / result.wall_s / 1e6 : 0,
+                        result.wall_s > 0 ? 100.0 * result.cpu_s / result.wall_s : 0, result.lag_p99_us, result.lag_max_us);
+                if (meter != NULL && result.messages > 0)
+                    fprintf(csv, "%.3e,%.3e\n", result.joules / result.messages, result.joules_above_idle / result.messages);
+                else
+                    fprintf(csv, ",\n");
+            }
+        }
+    }
+
+    if (csv != NULL)
+        fclose(csv);
+    if (keylog != NULL)
+        fclose(keylog);
+    if (meter != NULL)
+        Energy_Close(meter);
+    free(trace.messages);
+    return 0;
+}
@@ -1,10 +1,61 @@
 #!/bin/python
 
-from scapy.all import *
 from pymavlink.dialects.v20 import ardupilotmega as mavlink2
 from builtins import object
+from multiprocessing import Pool
 import time
 import argparse
+import hashlib
+import hmac
+import math
+import mmap
+import os
+import shutil
+import socket
+import struct
+
+# Request/response pairs for the latency analysis: request type -> response type.
+# Requests go from the GCS to the UAV, responses back; they are matched by the key
+# functions below (latest unanswered request with the same key).
+PAIRS = {
+    "COMMAND_LONG": "COMMAND_ACK",
+    "COMMAND_INT": "COMMAND_ACK",
+    "PARAM_REQUEST_READ": "PARAM_VALUE",
+    "PARAM_SET": "PARAM_VALUE",
+    "MISSION_REQUEST_LIST": "MISSION_COUNT",
+    "MISSION_REQUEST_INT": "MISSION_ITEM_INT",
+}
+PENDING_TIMEOUT_US = 10000000
+
+# Capture files are mapped in memory and read record by record straight from the libpcap
+# format, so memory stays bounded by the page cache whatever the length of the flight
+PCAP_MAGIC = {
+    b"\xd4\xc3\xb2\xa1": ("<", 1000000),
+    b"\xa1\xb2\xc3\xd4": (">", 1000000),
+    b"\x4d\x3c\xb2\xa1": ("<", 1000000000),
+    b"\xa1\xb2\x3c\x4d": (">", 1000000000),
+}
+PCAP_HEADER_BYTES = 24
+PCAP_RECORD_BYTES = 16
+MAX_CAPLEN = 262144
+# A record boundary found from an arbitrary offset must be followed by SYNC_RECORDS
+# plausible record headers, within SYNC_SECONDS of the first packet
+SYNC_RECORDS = 8
+SYNC_SECONDS = 31 * 86400
+# Below this size a capture is not split across processes
+SPLIT_BYTES = 16 << 20
+
+LINKTYPE_NULL = 0
+LINKTYPE_ETHERNET = 1
+LINKTYPE_RAW = 101
+LINKTYPE_LOOP = 108
+LINKTYPE_LINUX_SLL = 113
+LINKTYPE_IPV4 = 228
+LINKTYPE_LINUX_SLL2 = 276
+
+# Direction byte of the traffic keys (KDF_DIRECTION_* in kdf.h), by sender
+KDF_DIRECTION = {"UAV": 0, "GCS": 1}
+MAVLINK_MAX_PAYLOAD = 255
 
 
 class fifo(object):
@@ -19,37 +70,584 @@ class fifo(object):
         return self.buf.pop(0)
 
 
-def convert(gcs, uav, file):
-    f = fifo()
-    packets = rdpcap(file)
-    mav = mavlink2.MAVLink(f)
+def param_name(param_id):
+    if isinstance(param_id, bytes):
+        param_id = param_id.decode(errors="ignore")
+    return param_id.rstrip("\x00")
+
+
+def request_keys(msg):
+    """Keys a response to this request can be matched with"""
+    msg_type = msg.get_type()
+    if msg_type in ("COMMAND_LONG", "COMMAND_INT"):
+        return [msg.command]
+    if msg_type == "PARAM_REQUEST_READ":
+        name = param_name(msg.param_id)
+        return [name] if name else [("index", msg.param_index)]
+    if msg_type == "PARAM_SET":
+        return [param_name(msg.param_id)]
+    if msg_type == "MISSION_REQUEST_INT":
+        return [msg.seq]
+    return [None]
+
+
+def response_keys(msg):
+    msg_type = msg.get_type()
+    if msg_type == "COMMAND_ACK":
+        return [msg.command]
+    if msg_type == "PARAM_VALUE":
+        return [param_name(msg.param_id), ("index", msg.param_index)]
+    if msg_type == "MISSION_ITEM_INT":
+        return [msg.seq]
+    return [None]
+
+
+class LatencyHistogram(object):
+    """Latency histogram in microseconds with HdrHistogram-style log-linear buckets:
+    every value is kept with at least `digits` significant decimal digits"""
+
+    def __init__(self, digits=2):
+        self.sub_bits = int(math.ceil(math.log2(2 * 10 ** digits)))
+        self.counts = {}
+        self.total = 0
+        self.sum = 0
+        self.sum_squares = 0
+        self.max = 0
+
+    def record(self, value):
+        value = max(0, int(value))
+        shift = max(0, value.bit_length() - self.sub_bits)
+        bucket = (value >> shift) << shift
+        self.counts[bucket] = self.counts.get(bucket, 0) + 1
+        self.total += 1
+        self.sum += value
+        self.sum_squares += value * value
+        self.max = max(self.max, value)
+
+    def _highest_equivalent(self, bucket):
+        shift = max(0, bucket.bit_length() - self.sub_bits)
+        return bucket + (1 << shift) - 1
+
+    def value_at(self, percentile):
+        """Highest value equivalent to the value at the given percentile"""
+        if self.total == 0:
+            return 0
+        target = max(1, int(math.ceil(percentile / 100.0 * self.total)))
+        count = 0
+        for bucket in sorted(self.counts):
+            count += self.counts[bucket]
+            if count >= target:
+                return min(self._highest_equivalent(bucket), self.max)
+        return self.max
+
+    def write_hgrm(self, out, ticks_per_half_distance=5):
+        """Percentile distribution in the HdrHistogram text format, values in milliseconds"""
+        out.write("%12s %14s %10s %14s\n\n" % ("Value", "Percentile", "TotalCount", "1/(1-Percentile)"))
+        percentile, half = 0.0, 0
+        while self.total:
+            value = self.value_at(percentile)
+            count = sum(c for b, c in self.counts.items() if b <= value)
+            if percentile >= 100.0 or count >= self.total:
+                out.write("%12.3f %2.12f %10d\n" % (value / 1000.0, 1.0, self.total))
+                break
+            out.write("%12.3f %2.12f %10d %14.2f\n" % (value / 1000.0, percentile / 100.0, count, 1 / (1 - percentile / 100.0)))
+            step = 100.0 / (2 ** (half + 1)) / ticks_per_half_distance
+            percentile += step
+            if percentile >= 100.0 * (1 - 0.5 ** (half + 1)) - 1e-9:
+                half += 1
+        mean = self.sum / float(self.total) if self.total else 0.0
+        deviation = math.sqrt(max(0.0, self.sum_squares / float(self.total) - mean * mean)) if self.total else 0.0
+        out.write("#[Mean    = %12.3f, StdDeviation   = %12.3f]\n" % (mean / 1000.0, deviation / 1000.0))
+        out.write("#[Max     = %12.3f, Total count    = %12d]\n" % (self.max / 1000.0, self.total))
+        out.write("#[Buckets = %12d, SubBuckets     = %12d]\n" % (len(self.counts), 1 << self.sub_bits))
+
+
+class PcapFile(object):
+    """Streaming reader of a libpcap capture (pcapng is not supported)"""
+
+    def __init__(self, path):
+        self.path = path
+        self.size = os.path.getsize(path)
+        with open(path, "rb") as f:
+            header = f.read(PCAP_HEADER_BYTES + PCAP_RECORD_BYTES)
+        if header[:4] == b"\x0a\x0d\x0d\x0a":
+            raise ValueError(f"{path}: pcapng is not supported, convert it with 'editcap -F pcap'")
+        if len(header) < PCAP_HEADER_BYTES or header[:4] not in PCAP_MAGIC:
+            raise ValueError(f"{path}: not a pcap file")
+        byteorder, self.ticks = PCAP_MAGIC[header[:4]]
+        snaplen, linktype = struct.unpack_from(byteorder + "II", header, 16)
+        self.linktype = linktype & 0x0fffffff
+        self.max_caplen = snaplen if 0 < snaplen <= MAX_CAPLEN else MAX_CAPLEN
+        self.record = struct.Struct(byteorder + "IIII")
+        self.first = self.record.unpack_from(header, PCAP_HEADER_BYTES)[0] if len(header) == PCAP_HEADER_BYTES + PCAP_RECORD_BYTES else 0
+
+    def records(self, start=PCAP_HEADER_BYTES, end=None):
+        """Yield (capture time in microseconds, frame) for the records whose header starts in [start, end)"""
+        end = min(self.size, self.size if end is None else end)
+        unpack_from = self.record.unpack_from
+        with open(self.path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+            mm.madvise(mmap.MADV_SEQUENTIAL)
+            offset = start
+            while offset < end and offset + PCAP_RECORD_BYTES <= self.size:
+                ts_sec, ts_frac, caplen, _ = unpack_from(mm, offset)
+                data = offset + PCAP_RECORD_BYTES
+                if data + caplen > self.size:
+                    return  # Truncated last record
+                yield ts_sec * 1000000 + ts_frac * 1000000 // self.ticks, mm[data:data + caplen]
+                offset = data + caplen
+
+    def sync(self, offset):
+        """Offset of the first record header at or after offset"""
+        if offset <= PCAP_HEADER_BYTES:
+            return PCAP_HEADER_BYTES
+        with open(self.path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+            for candidate in range(offset, self.size):
+                if self._chained(mm, candidate):
+                    return candidate
+        return self.size
+
+    def _chained(self, mm, offset):
+        for _ in range(SYNC_RECORDS):
+            if offset == self.size:
+                return True
+            if offset + PCAP_RECORD_BYTES > self.size:
+                return False
+            ts_sec, ts_frac, caplen, origlen = self.record.unpack_from(mm, offset)
+            if not (0 < caplen <= self.max_caplen and caplen <= origlen <= MAX_CAPLEN and ts_frac < self.ticks and abs(ts_sec - self.first) <= SYNC_SECONDS):
+                return False
+            offset += PCAP_RECORD_BYTES + caplen
+        return True
+
+    def ranges(self, jobs):
+        """Split the records in up to jobs ranges of file offsets of about the same size"""
+        if jobs <= 1 or self.size < SPLIT_BYTES:
+            return [(PCAP_HEADER_BYTES, self.size)]
+        step = (self.size - PCAP_HEADER_BYTES) // jobs
+        return [(PCAP_HEADER_BYTES + i * step, self.size if i == jobs - 1 else PCAP_HEADER_BYTES + (i + 1) * step) for i in range(jobs)]
+
+
+def udp_datagram(linktype, frame):
+    """(src ip, dst ip, src port, dst port, payload) of an IPv4/UDP frame, None for other traffic"""
+    if linktype == LINKTYPE_ETHERNET:
+        ethertype, ip = frame[12:14], 14
+        while ethertype in (b"\x81\x00", b"\x88\xa8"):  # VLAN tags
+            ethertype, ip = frame[ip + 2:ip + 4], ip + 4
+    elif linktype == LINKTYPE_LINUX_SLL:
+        ethertype, ip = frame[14:16], 16
+    elif linktype == LINKTYPE_LINUX_SLL2:
+        ethertype, ip = frame[0:2], 20
+    elif linktype in (LINKTYPE_NULL, LINKTYPE_LOOP):
+        ethertype, ip = b"\x08\x00" if frame[0:4] in (b"\x02\x00\x00\x00", b"\x00\x00\x00\x02") else None, 4
+    elif linktype in (LINKTYPE_RAW, LINKTYPE_IPV4):
+        ethertype, ip = b"\x08\x00", 0
+    else:
+        return None
+    # IPv4, UDP, not a fragment
+    if ethertype != b"\x08\x00" or len(frame) < ip + 28 or frame[ip] >> 4 != 4 or frame[ip + 9] != 17 or (frame[ip + 6] & 0x3f or frame[ip + 7]):
+        return None
+    udp = ip + (frame[ip] & 0x0f) * 4
+    sport, dport, length = struct.unpack_from("!HHH", frame, udp)
+    return frame[ip + 12:ip + 16], frame[ip + 16:ip + 20], sport, dport, frame[udp + 8:udp + length]
+
+
+def chacha20_keystream(key, nonce, length, counter=0):
+    """ChaCha20 keystream, RFC 7539 with a 12-byte nonce or the original layout with an 8-byte nonce"""
+    def quarter(x, a, b, c, d):
+        x[a] = (x[a] + x[b]) & 0xffffffff
+        x[d] ^= x[a]
+        x[d] = (x[d] << 16 | x[d] >> 16) & 0xffffffff
+        x[c] = (x[c] + x[d]) & 0xffffffff
+        x[b] ^= x[c]
+        x[b] = (x[b] << 12 | x[b] >> 20) & 0xffffffff
+        x[a] = (x[a] + x[b]) & 0xffffffff
+        x[d] ^= x[a]
+        x[d] = (x[d] << 8 | x[d] >> 24) & 0xffffffff
+        x[c] = (x[c] + x[d]) & 0xffffffff
+        x[b] ^= x[c]
+        x[b] = (x[b] << 7 | x[b] >> 25) & 0xffffffff
+
+    if len(key) != 32 or len(nonce) not in (8, 12):
+        raise ValueError("chacha20 needs a 32-byte key and an 8 or 12-byte nonce")
+    stream = b""
+    while len(stream) < length:
+        if len(nonce) == 12:
+            block = struct.pack("<I", counter & 0xffffffff) + nonce
+        else:
+            block = struct.pack("<Q", counter) + nonce
+        state = list(struct.unpack("<16I", b"expand 32-byte k" + key + block))
+        x = list(state)
+        for _ in range(10):
+            quarter(x, 0, 4, 8, 12)
+            quarter(x, 1, 5, 9, 13)
+            quarter(x, 2, 6, 10, 14)
+            quarter(x, 3, 7, 11, 15)
+            quarter(x, 0, 5, 10, 15)
+            quarter(x, 1, 6, 11, 12)
+            quarter(x, 2, 7, 8, 13)
+            quarter(x, 3, 4, 9, 14)
+        stream += struct.pack("<16I", *((x[i] + state[i]) & 0xffffffff for i in range(16)))
+        counter += 1
+    return stream[:length]
+
+
+RABBIT_A = (0x4D34D34D, 0xD34D34D3, 0x34D34D34, 0x4D34D34D, 0xD34D34D3, 0x34D34D34, 0x4D34D34D, 0xD34D34D3)
+
+
+def rabbit_keystream(key, nonce, length):
+    """Rabbit keystream, RFC 4503 with the IV setup and byte order of the ECRYPT code (rabbit_* in linkcipher.h)"""
+    def rotl(v, n):
+        return (v << n | v >> (32 - n)) & 0xffffffff
+
+    def next_state(x, c, carry):
+        for i in range(8):
+            t = c[i] + RABBIT_A[i] + carry
+            c[i], carry = t & 0xffffffff, t >> 32
+        g = []
+        for i in range(8):
+            square = ((x[i] + c[i]) & 0xffffffff) ** 2
+            g.append((square ^ square >> 32) & 0xffffffff)
+        for i in range(8):
+            if i & 1:
+                x[i] = (g[i] + rotl(g[i - 1], 8) + g[i - 2]) & 0xffffffff
+            else:
+                x[i] = (g[i] + rotl(g[i - 1], 16) + rotl(g[i - 2], 16)) & 0xffffffff
+        return carry
+
+    if len(key) != 16 or len(nonce) != 8:
+        raise ValueError("rabbit needs a 16-byte key and an 8-byte nonce")
+    k = struct.unpack("<4I", key)
+    x = [k[0], (k[3] << 16 | k[2] >> 16) & 0xffffffff, k[1], (k[0] << 16 | k[3] >> 16) & 0xffffffff,
+         k[2], (k[1] << 16 | k[0] >> 16) & 0xffffffff, k[3], (k[2] << 16 | k[1] >> 16) & 0xffffffff]
+    c = [rotl(k[2], 16), k[0] & 0xffff0000 | k[1] & 0xffff, rotl(k[3], 16), k[1] & 0xffff0000 | k[2] & 0xffff,
+         rotl(k[0], 16), k[2] & 0xffff0000 | k[3] & 0xffff, rotl(k[1], 16), k[3] & 0xffff0000 | k[0] & 0xffff]
+    carry = 0
+    for _ in range(4):
+        carry = next_state(x, c, carry)
+    c = [c[i] ^ x[(i + 4) & 7] for i in range(8)]
+    i0, i2 = struct.unpack("<2I", nonce)
+    iv = (i0, i0 >> 16 | i2 & 0xffff0000, i2, (i2 << 16 | i0 & 0xffff) & 0xffffffff)
+    c = [c[i] ^ iv[i & 3] for i in range(8)]
+    for _ in range(4):
+        carry = next_state(x, c, carry)
+    stream = b""
+    while len(stream) < length:
+        carry = next_state(x, c, carry)
+        stream += struct.pack("<4I", *((x[i] ^ x[(i + 5) & 7] >> 16 ^ x[(i + 3) & 7] << 16) & 0xffffffff for i in (0, 2, 4, 6)))
+    return stream[:length]
+
+
+def trivium_keystream(key, nonce, length):
+    """Trivium keystream (eSTREAM): key and IV are 80-bit little-endian integers whose top bit is s1 and
+    s94, the keystream bits fill each byte from the least significant bit (trivium_* in linkcipher.h)"""
+    if len(key) != 10 or len(nonce) != 10:
+        raise ValueError("trivium needs a 10-byte key and a 10-byte nonce")
+    k, v = int.from_bytes(key, "little"), int.from_bytes(nonce, "little")
+    s = [0] + [k >> (80 - i) & 1 for i in range(1, 81)] + [0] * 13 + [v >> (80 - i) & 1 for i in range(1, 81)] + [0] * 112 + [1, 1, 1]
+    stream = bytearray(length)
+    for t in range(-4 * 288, 8 * length):
+        t1, t2, t3 = s[66] ^ s[93], s[162] ^ s[177], s[243] ^ s[288]
+        if t >= 0:
+            stream[t >> 3] |= (t1 ^ t2 ^ t3) << (t & 7)
+        t1 ^= s[91] & s[92] ^ s[171]
+        t2 ^= s[175] & s[176] ^ s[264]
+        t3 ^= s[286] & s[287] ^ s[69]
+        s[1:94], s[94:178], s[178:289] = [t3] + s[1:93], [t1] + s[94:177], [t2] + s[178:288]
+    return bytes(stream)
+
+
+# Simon and Speck variants: name -> (word bits, key words, rounds, Simon z sequence or None for Speck)
+SIMON_SPECK = {
+    "simon6496": (32, 3, 42, 0x7369f885192c0ef5),
+    "simon64128": (32, 4, 44, 0xfc2ce51207a635db),
+    "simon128128": (64, 2, 68, 0x7369f885192c0ef5),
+    "simon128192": (64, 3, 69, 0xfc2ce51207a635db),
+    "simon128256": (64, 4, 72, 0xfdc94c3a046d678b),
+    "speck6496": (32, 3, 26, None),
+    "speck64128": (32, 4, 27, None),
+    "speck128128": (64, 2, 32, None),
+    "speck128192": (64, 3, 33, None),
+    "speck128256": (64, 4, 34, None),
+}
+
+
+def simon_speck_ctr(variant):
+    """Keystream of a Simon or Speck variant in CTR mode: the nonce is the first counter block, a little-endian
+    integer incremented per block; key and block words are little-endian (simon*/speck* in linkcipher.h)"""
+    n, m, rounds, z = SIMON_SPECK[variant]
+    mask, word = (1 << n) - 1, "I" if n == 32 else "Q"
+
+    def rol(v, r):
+        return (v << r | v >> (n - r)) & mask
+
+    def keystream(key, nonce, length):
+        if len(key) != m * n // 8 or len(nonce) != n // 4:
+            raise ValueError(f"{variant} needs a {m * n // 8}-byte key and a {n // 4}-byte nonce")
+        k = list(struct.unpack(f"<{m}{word}", key))
+        if z is not None:
+            for i in range(m, rounds):
+                tmp = rol(k[i - 1], n - 3) ^ (k[i - 3] if m == 4 else 0)
+                k.append(mask ^ 3 ^ (z >> (i - m) % 62 & 1) ^ k[i - m] ^ tmp ^ rol(tmp, n - 1))
+        else:
+            l, a = k[1:], k[0]
+            k = [a]
+            for i in range(rounds - 1):
+                l.append((a + rol(l[i], n - 8)) & mask ^ i)
+                a = rol(a, 3) ^ l[-1]
+                k.append(a)
+        counter, stream = int.from_bytes(nonce, "little"), b""
+        while len(stream) < length:
+            y, x = counter & mask, counter >> n
+            for round_key in k:
+                if z is not None:
+                    x, y = y ^ (rol(x, 1) & rol(x, 8)) ^ rol(x, 2) ^ round_key, x
+                else:
+                    x = (rol(x, n - 8) + y) & mask ^ round_key
+                    y = rol(y, 3) ^ x
+            stream += struct.pack(f"<2{word}", y, x)
+            counter = (counter + 1) & ((1 << 2 * n) - 1)
+        return stream[:length]
+    return keystream
+
+
+# Link ciphers the analyzer can decrypt: name -> (key bytes, keystream(key, nonce, length)), the same
+# keystreams as link_ciphers in linkcipher.h. The names are the cipher strings given to KeySchedule_Derive
+CIPHERS = {
+    "chacha20": (32, chacha20_keystream),
+    "rabbit": (16, rabbit_keystream),
+    "trivium": (10, trivium_keystream),
+}
+CIPHERS.update({f"{variant}-ctr": (m * n // 8, simon_speck_ctr(variant)) for variant, (n, m, _, _) in SIMON_SPECK.items()})
+
+
+def traffic_key(prk, sender, cipher, epoch, length):
+    """Traffic key of one direction, HKDF-Expand as KeySchedule_Derive in kdf.h"""
+    info = b"uav traffic\x00" + cipher.encode() + b"\x00" + bytes([KDF_DIRECTION[sender]]) + struct.pack("<I", epoch)
+    key, block, i = b"", b"", 1
+    while len(key) < length:
+        block = hmac.new(prk, block + info + bytes([i]), hashlib.sha512).digest()
+        key += block
+        i += 1
+    return key[:length]
+
+
+def read_keylog(path, cipher):
+    """Keystreams of a capture by sender ("UAV", "GCS") from a key log; lines are
+
+        <cipher> UAV|GCS <key hex> <nonce hex>
+        <cipher> session <PRK hex> <nonce hex> [epoch]
+
+    the second form derives both traffic keys from the session PRK (handshake_t.session_key).
+    The log is a debugging aid written by the endpoint that holds the keys: mission_replay -K
+    writes the first form for the keys of each run (the last line of a cipher and sender wins),
+    a link endpoint has to log its traffic keys or handshake_t.session_key the same way"""
+    if cipher not in CIPHERS:
+        raise ValueError(f"no keystream for cipher {cipher}, known: {', '.join(sorted(CIPHERS))}")
+    key_bytes, keystream = CIPHERS[cipher]
+    keys = {}
+    with open(path) as keylog:
+        for number, line in enumerate(keylog, 1):
+            fields = line.split("#")[0].split()
+            if not fields or fields[0] != cipher:
+                continue
+            if len(fields) not in (4, 5) or fields[1] not in ("UAV", "GCS", "session"):
+                raise ValueError(f"{path}:{number}: malformed key log line")
+            secret, nonce = bytes.fromhex(fields[2]), bytes.fromhex(fields[3])
+            if fields[1] == "session":
+                epoch = int(fields[4]) if len(fields) == 5 else 0
+                for sender in KDF_DIRECTION:
+                    keys[sender] = (traffic_key(secret, sender, cipher, epoch, key_bytes), nonce)
+            else:
+                keys[fields[1]] = (secret, nonce)
+    # Every payload is encrypted from the start of the keystream, one prefix per direction is enough
+    return {sender: keystream(key, nonce, MAVLINK_MAX_PAYLOAD) for sender, (key, nonce) in keys.items()}
+
+
+def crc_table():
+    table = []
+    for byte in range(256):
+        tmp = byte
+        for _ in range(8):
+            tmp = (tmp >> 1) ^ 0x8408 if tmp & 1 else tmp >> 1
+        table.append(tmp)
+    return table
+
+
+X25_TABLE = crc_table()
+
+
+def x25crc(data, crc_extra):
+    """MAVLink checksum (CRC-16/MCRF4XX) of data followed by the CRC_EXTRA byte of the message"""
+    crc = 0xffff
+    for byte in data:
+        crc = (crc >> 8) ^ X25_TABLE[(crc ^ byte) & 0xff]
+    return (crc >> 8) ^ X25_TABLE[(crc ^ crc_extra) & 0xff]
+
+
+def decrypt_frames(data, keystream):
+    """Decrypt the payload of every MAVLink frame in a datagram. The checksum on the wire may cover
+    either the ciphertext or the plaintext; it is rewritten over the plaintext so the frames parse
+    as usual. Frames failing both checks are left untouched and rejected by the parser"""
+    out = bytearray(data)
+    pos = 0
+    while pos < len(out):
+        # The whole header must be in the datagram: 10 bytes for MAVLink 2, 6 for MAVLink 1
+        if out[pos] == 0xFD and pos + 10 <= len(out):
+            header, msgid, signature = 10, out[pos + 7] | out[pos + 8] << 8 | out[pos + 9] << 16, 13 if out[pos + 2] & 0x01 else 0
+        elif out[pos] == 0xFE and pos + 6 <= len(out):
+            header, msgid, signature = 6, out[pos + 5], 0
+        else:
+            break
+        length = out[pos + 1]
+        end = pos + header + length
+        message = mavlink2.mavlink_map.get(msgid)
+        if end + 2 > len(out) or message is None:
+            break
+        wire = out[end] | out[end + 1] << 8
+        cipher_crc = x25crc(out[pos + 1:end], message.crc_extra)
+        plain = int.from_bytes(out[pos + header:end], "little") ^ int.from_bytes(keystream[:length], "little")
+        out[pos + header:end] = plain.to_bytes(length, "little")
+        plain_crc = x25crc(out[pos + 1:end], message.crc_extra)
+        if wire in (cipher_crc, plain_crc):
+            out[end:end + 2] = struct.pack("<H", plain_crc)
+        else:
+            out[pos:end + 2] = data[pos:end + 2]
+        pos = end + 2 + signature
+    return out
+
+
+def direction(datagram, gcs, uav):
+    """(src, dst) of a MAVLink datagram between gcs and uav on port 14550, None for other traffic"""
+    if datagram is not None:
+        src, dst, sport, dport, _ = datagram
+        # Take packet from uav to gcs (only on port 14550)
+        if src == uav and dst == gcs and dport == 14550:
+            return ("UAV", "GCS")
+        # Take packet from gcs (only port 14550) to uav
+        elif src == gcs and dst == uav and sport == 14550:
+            return ("GCS", "UAV")
+    return None
+
+
+def mavlink_messages(gcs, uav, file, keys=None):
+    """Yield (capture time in microseconds, src, dst, message) for every MAVLink message between gcs and uav,
+    keys are the keystreams by sender of an encrypted capture (read_keylog)"""
+    mav = mavlink2.MAVLink(fifo())
+    pcap = PcapFile(file)
+    gcs, uav = socket.inet_aton(gcs), socket.inet_aton(uav)
+    for timestamp, frame in pcap.records():
+        datagram = udp_datagram(pcap.linktype, frame)
+        endpoints = direction(datagram, gcs, uav)
+        if endpoints is None:
+            continue
+        payload = decrypt_frames(datagram[4], keys[endpoints[0]]) if keys and endpoints[0] in keys else bytearray(datagram[4])
+        for msg in mav.parse_buffer(payload) or []:
+            yield timestamp, endpoints[0], endpoints[1], msg
+
+
+def latency(gcs, uav, captures, output_dir, keylog):
+    """Request/response latency histograms, one per capture (cipher) and request type"""
+    print("%-12s %-22s %8s %10s %10s %10s %10s %10s %8s" % ("cipher", "request", "count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "lost"))
+    for label, file in captures:
+        histograms, pending, lost, swept = {}, {}, {}, 0
+        keys = read_keylog(keylog, label) if keylog is not None else None
+        for timestamp, src, dst, msg in mavlink_messages(gcs, uav, file, keys):
+            msg_type = msg.get_type()
+            if src == "GCS" and msg_type in PAIRS:
+                for key in request_keys(msg):
+                    pending.setdefault((PAIRS[msg_type], key), []).append((timestamp, msg_type))
+            elif src == "UAV":
+                for key in response_keys(msg):
+                    waiting = pending.get((msg_type, key))
+                    if waiting:
+                        # The response answers the latest request, older ones are retries left unanswered
+                        sent, request = waiting.pop()
+                        histograms.setdefault(request, LatencyHistogram()).record(timestamp - sent)
+                        for sent, request in waiting:
+                            lost[request] = lost.get(request, 0) + 1
+                        del waiting[:]
+                        break
+            # Requests never answered are counted as lost, checked once per second of capture
+            if timestamp - swept > 1000000:
+                swept = timestamp
+                for waiting in pending.values():
+                    while waiting and timestamp - waiting[0][0] > PENDING_TIMEOUT_US:
+                        request = waiting.pop(0)[1]
+                        lost[request] = lost.get(request, 0) + 1
+        for waiting in pending.values():
+            for sent, request in waiting:
+                lost[request] = lost.get(request, 0) + 1
+
+        for request in sorted(set(histograms) | set(lost)):
+            histogram = histograms.get(request, LatencyHistogram())
+            print("%-12s %-22s %8d %10d %10d %10d %10d %10d %8d" % (label, request, histogram.total, histogram.value_at(50), histogram.value_at(90),
+                                                                    histogram.value_at(99), histogram.value_at(99.9), histogram.max, lost.get(request, 0)))
+            if output_dir is not None and histogram.total:
+                with open(os.path.join(output_dir, f"{label}-{request}.hgrm"), "w") as out:
+                    histogram.write_hgrm(out)
+
+
+def write_trace(gcs, uav, file, keys, output):
+    """Message trace for utils/mission_replay: time_us,sender,msgid,length relative to the first message"""
+    first, count = None, 0
+    with open(output, "w") as out:
+        out.write("time_us,sender,msgid,length\n")
+        for timestamp, src, dst, msg in mavlink_messages(gcs, uav, file, keys):
+            first = timestamp if first is None else first
+            out.write(f"{timestamp - first},{src},{msg.get_msgId()},{len(msg.get_payload() or b'')}\n")
+            count += 1
+    print(f"Write {output}: {count} messages")
+
+
+def convert_range(job):
+    """Convert the records in one range of file offsets to output, returns (packets, MAVLink messages)"""
+    gcs, uav, file, start, end, output, keys = job
+    mav = mavlink2.MAVLink(fifo())
+    pcap = PcapFile(file)
+    gcs, uav = socket.inet_aton(gcs), socket.inet_aton(uav)
+    packets, messages, second, timestamp = 0, 0, None, None
+
+    with open(output, "w") as outfile:
+        for captured, frame in pcap.records(pcap.sync(start), end):
+            packets += 1
+            datagram = udp_datagram(pcap.linktype, frame)
+            endpoints = direction(datagram, gcs, uav)
+            if endpoints is None:
+                continue
+            if captured // 1000000 != second:
+                second = captured // 1000000
+                timestamp = time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(second))
+            src, dst = endpoints
+            payload = decrypt_frames(datagram[4], keys[src]) if keys and src in keys else bytearray(datagram[4])
+            for msg in mav.parse_buffer(payload) or []:
+                param = ", ".join(f"{name} : {msg.format_attr(name)}" for name in msg.get_fieldnames())
+                outfile.write(f"{timestamp};{src};{dst};{msg.get_type()} ;{param}\n")
+                messages += 1
+    return packets, messages
+
+
+def convert(gcs, uav, file, jobs, keys=None):
     output = file.replace("pcap", "csv")
+    ranges = PcapFile(file).ranges(jobs)
+    parts = [(gcs, uav, file, start, end, f"{output}.{i}", keys) for i, (start, end) in enumerate(ranges)]
 
     print(f"Write {output}.\nStarting...")
+    begin = time.monotonic()
+    if len(parts) == 1:
+        results = [convert_range(parts[0])]
+    else:
+        with Pool(len(parts)) as pool:
+            results = pool.map(convert_range, parts)
     with open(output, "w") as outfile:
         outfile.write("Timestamp;Src;Dst;MavLinkMsg;MavLinkParam\n")
-        timestamp, dst, src, data = ("", "", "", "")
-        for packet in packets:
-            if packet.getlayer("ICMP") is None and packet.getlayer("IP") is not None and packet.version == 4:
-                timestamp = time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(int(packet.time)))
-		# Take packet from uav to gcs (only on port 14550)
-                if packet.getlayer("IP").src == uav and packet.getlayer("IP").dst == gcs and packet.getlayer("IP").dport == 14550:
-                    data = packet.getlayer("Raw").load
-                    src, dst = ("UAV", "GCS")
-                    # src, dst = (uav, gcs)              write ip
-		# Take packet from gcs (only port 14550) to uav
-                elif packet.getlayer("IP").src == gcs and packet.getlayer("IP").dst == uav and packet.getlayer("IP").sport == 14550:
-                    data = packet.getlayer("Raw").load
-                    src, dst = ("GCS", "UAV")
-                    # src, dst = (gcs, uav)              write ip
-                else:
-                    continue
-                    #print("Garbage: ", packet.getlayer("Raw").load)
-
-                type_msg, param = str(mav.decode(bytearray(data))).split('{')
-                outfile.write(f"{timestamp};{src};{dst};{type_msg};{param.split('}')[0]}\n")
+        for part in parts:
+            with open(part[5]) as infile:
+                shutil.copyfileobj(infile, outfile)
+            os.remove(part[5])
+    elapsed = time.monotonic() - begin
 
-    print("Conversion completed")
+    packets, messages = sum(r[0] for r in results), sum(r[1] for r in results)
+    print(f"Conversion completed: {packets} packets, {messages} MAVLink messages in {elapsed:.2f} s "
+          f"({packets / elapsed if elapsed > 0 else 0:.0f} packets/s, {len(parts)} processes)")
 
 
 def main():
@@ -77,11 +675,71 @@ def main():
         help="Path of pcap file"
     )
 
+    parser.add_argument(
+        "-l", "--latency",
+        type=str,
+        dest="latency",
+        action="append",
+        help="cipher=path of a pcap file, repeatable: request/response latency histograms per cipher"
+    )
+
+    parser.add_argument(
+        "-o", "--output-dir",
+        type=str,
+        dest="output_dir",
+        default=None,
+        help="directory for the .hgrm histograms of --latency"
+    )
+
+    parser.add_argument(
+        "-j", "--jobs",
+        type=int,
+        dest="jobs",
+        default=os.cpu_count() or 1,
+        help="processes converting parts of the capture in parallel"
+    )
+
+    parser.add_argument(
+        "-k", "--keylog",
+        type=str,
+        dest="keylog",
+        default=None,
+        help="key log of an encrypted capture: traffic keys or session PRK per cipher"
+    )
+
+    parser.add_argument(
+        "-c", "--cipher",
+        type=str,
+        dest="cipher",
+        default=None,
+        help="cipher of the --input-file capture, looked up in --keylog (--latency uses the capture label)"
+    )
+
+    parser.add_argument(
+        "-t", "--trace",
+        type=str,
+        dest="trace",
+        default=None,
+        help="write the message trace of the --input-file capture for utils/mission_replay instead of the CSV"
+    )
+
     args = parser.parse_args()
-    if args.gcs is None or args.uav is None or args.file is None:
+    if args.keylog is not None and args.file is not None and not args.latency and args.cipher is None:
+        parser.error("--keylog needs the --cipher of the capture")
+    if args.latency:
+        captures = []
+        for capture in args.latency:
+            label, _, file = capture.rpartition("=")
+            captures.append((label or os.path.splitext(os.path.basename(file))[0], file))
+        latency(args.gcs, args.uav, captures, args.output_dir, args.keylog)
+    elif args.gcs is None or args.uav is None or args.file is None:
         parser.print_help()
     else:
-        convert(args.gcs, args.uav, args.file)
+        keys = read_keylog(args.keylog, args.cipher) if args.keylog is not None else None
+        if args.trace is not None:
+            write_trace(args.gcs, args.uav, args.file, keys, args.trace)
+        else:
+            convert(args.gcs, args.uav, args.file, args.jobs, keys)
 
 
 if __name__ == '__main__':
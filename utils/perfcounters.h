@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+/***********************************************************************************
+ * Hardware performance counters of the calling thread (Linux perf_event_open)
+ *
+ * Counts user-space cycles, instructions, branch misses, L1D read misses and
+ * last-level cache misses, plus the task clock, around a measured region:
+ *
+ *   PerfCounters_Open(&pc);
+ *   PerfCounters_Start(&pc);  ... region ...  PerfCounters_Stop(&pc, values);
+ *
+ * The counters are opened as one group (cycles first, as the leader), so the
+ * kernel schedules them together and they all cover the same instructions:
+ * ratios such as the IPC stay exact even when the PMU is multiplexed, and the
+ * group is read with a single read(). A counter the PMU lacks (common in virtual
+ * machines) or perf_event_paranoid forbids is just marked unavailable; one that
+ * exists but cannot join the group is counted on its own. Counts are scaled by
+ * time_enabled / time_running when the kernel had to multiplex them.
+ ***********************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PERF_TASK_CLOCK 0 // Nanoseconds on CPU
+#define PERF_CYCLES 1
+#define PERF_INSTRUCTIONS 2
+#define PERF_BRANCH_MISSES 3
+#define PERF_L1D_MISSES 4
+#define PERF_LLC_MISSES 5
+#define PERF_COUNTERS 6
+
+static const char *perf_counter_names[PERF_COUNTERS] = {"task_clock_ns", "cycles", "instructions", "branch_misses", "l1d_read_misses", "llc_misses"};
+
+typedef struct
+{
+    int fd[PERF_COUNTERS];               // -1 when the counter is unavailable
+    int leader;                          // Group leader, -1 without a group
+    unsigned int group[PERF_COUNTERS];   // Counters of the group in read order, the leader first
+    unsigned int group_size;
+    bool grouped[PERF_COUNTERS];         // In the group, otherwise counted on its own
+    uint64_t times[PERF_COUNTERS][2];    // time_enabled, time_running at PerfCounters_Start (the group's in times[leader counter])
+} perf_counters_t;
+
+static int perf_open(uint32_t type, uint64_t config, int group_fd)
+{ // A group leader or a counter on its own starts disabled, a member follows its leader
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static int perf_open_group(uint32_t type, uint64_t config)
+{ // Leader of the group, read with PERF_FORMAT_GROUP
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t perf_scale(uint64_t value, const uint64_t *start, uint64_t enabled, uint64_t running)
+{ // Extrapolate a multiplexed count to the whole enabled time, a reset does not clear the times
+    enabled -= start[0];
+    running -= start[1];
+    if (running == 0)
+        return 0;
+    return running < enabled ? (uint64_t)((double)value * enabled / running) : value;
+}
+
+// Open the counters of the calling thread, returns the number of available counters
+unsigned int PerfCounters_Open(perf_counters_t *pc)
+{
+    static const uint32_t types[PERF_COUNTERS] = {PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+    static const uint64_t configs[PERF_COUNTERS] = {PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+                                                    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                                                    PERF_COUNT_HW_CACHE_MISSES};
+    static const unsigned int order[PERF_COUNTERS] = {PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_TASK_CLOCK};
+    unsigned int i, counter, available = 0;
+
+    memset(pc, 0, sizeof(perf_counters_t));
+    pc->leader = -1;
+    for (i = 0; i < PERF_COUNTERS; i++)
+    { // Hardware counters first, so the leader is one (a software leader would be moved to the PMU anyway)
+        counter = order[i];
+        if (pc->leader < 0)
+        {
+            pc->fd[counter] = perf_open_group(types[counter], configs[counter]);
+            pc->leader = pc->fd[counter];
+            pc->grouped[counter] = pc->fd[counter] >= 0;
+        }
+        else
+        {
+            pc->fd[counter] = perf_open(types[counter], configs[counter], pc->leader);
+            pc->grouped[counter] = pc->fd[counter] >= 0;
+            if (pc->fd[counter] < 0)
+                pc->fd[counter] = perf_open(types[counter], configs[counter], -1);
+        }
+        if (pc->grouped[counter])
+            pc->group[pc->group_size++] = counter;
+        if (pc->fd[counter] >= 0)
+            available++;
+    }
+    return available;
+}
+
+void PerfCounters_Close(perf_counters_t *pc)
+{
+    unsigned int i;
+
+    for (i = 0; i < PERF_COUNTERS; i++)
+    { // Members before the leader
+        if (pc->fd[i] >= 0 && pc->fd[i] != pc->leader)
+            close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+    if (pc->leader >= 0)
+        close(pc->leader);
+    pc->leader = -1;
+    pc->group_size = 0;
+}
+
+bool PerfCounters_Available(const perf_counters_t *pc, unsigned int counter)
+{
+    return pc->fd[counter] >= 0;
+}
+
+// Reset and enable every available counter, the group at once
+void PerfCounters_Start(perf_counters_t *pc)
+{
+    uint64_t data[3 + PERF_COUNTERS];
+    unsigned int i;
+
+    for (i = 0; i < PERF_COUNTERS; i++)
+    {
+        if (pc->fd[i] >= 0 && !pc->grouped[i])
+        {
+            ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+            if (read(pc->fd[i], data, 3 * sizeof(uint64_t)) == 3 * sizeof(uint64_t))
+                memcpy(pc->times[i], &data[1], sizeof(pc->times[i]));
+            ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    if (pc->leader >= 0)
+    {
+        ioctl(pc->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        if (read(pc->leader, data, (3 + pc->group_size) * sizeof(uint64_t)) == (ssize_t)((3 + pc->group_size) * sizeof(uint64_t)))
+            memcpy(pc->times[pc->group[0]], &data[1], sizeof(pc->times[0]));
+        ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+// Disable the counters and read them, values[i] is 0 for unavailable counters
+void PerfCounters_Stop(perf_counters_t *pc, uint64_t *values)
+{
+    uint64_t data[3 + PERF_COUNTERS]; // nr (group only), time_enabled, time_running, values
+    unsigned int i;
+
+    if (pc->leader >= 0)
+        ioctl(pc->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (i = 0; i < PERF_COUNTERS; i++)
+    {
+        if (pc->fd[i] >= 0 && !pc->grouped[i])
+            ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    memset(values, 0, PERF_COUNTERS * sizeof(uint64_t));
+    if (pc->leader >= 0 && read(pc->leader, data, (3 + pc->group_size) * sizeof(uint64_t)) == (ssize_t)((3 + pc->group_size) * sizeof(uint64_t)) &&
+        data[0] == pc->group_size)
+    {
+        for (i = 0; i < pc->group_size; i++)
+            values[pc->group[i]] = perf_scale(data[3 + i], pc->times[pc->group[0]], data[1], data[2]);
+    }
+    for (i = 0; i < PERF_COUNTERS; i++)
+    { // value, time_enabled, time_running
+        if (pc->fd[i] >= 0 && !pc->grouped[i] && read(pc->fd[i], data, 3 * sizeof(uint64_t)) == 3 * sizeof(uint64_t))
+            values[i] = perf_scale(data[0], pc->times[i], data[1], data[2]);
+    }
+}
+#endif
@@ -0,0 +1,204 @@
+#!/bin/python
+
+from builtins import object
+import argparse
+import json
+import math
+
+"""
+Synthetic MAVLink message trace of a QGroundControl plan, for utils/mission_replay.
+
+The flight is modelled, not simulated: the GCS downloads the parameters and uploads
+the mission, arms and starts it, the vehicle climbs to the takeoff altitude, flies
+the legs at the plan speed and returns to launch, while both sides stream telemetry
+at the rates QGroundControl requests. The same plan always gives the same trace.
+
+Trace format (also written by pcap2mavlink.py --trace), one message per line:
+time_us,sender,msgid,length
+"""
+
+# Telemetry of ArduPilot at the stream rates requested by QGroundControl:
+# (name, msgid, payload bytes, Hz) sent by the vehicle for the whole session
+UAV_STREAMS = [
+    ("HEARTBEAT", 0, 9, 1),
+    ("SYS_STATUS", 1, 31, 2),
+    ("POWER_STATUS", 125, 6, 2),
+    ("MEMINFO", 152, 4, 2),
+    ("MISSION_CURRENT", 42, 2, 2),
+    ("GPS_RAW_INT", 24, 30, 2),
+    ("NAV_CONTROLLER_OUTPUT", 62, 26, 2),
+    ("GLOBAL_POSITION_INT", 33, 28, 3),
+    ("LOCAL_POSITION_NED", 32, 28, 3),
+    ("RAW_IMU", 27, 26, 2),
+    ("SCALED_PRESSURE", 29, 14, 2),
+    ("SERVO_OUTPUT_RAW", 36, 21, 2),
+    ("RC_CHANNELS", 65, 42, 2),
+    ("ATTITUDE", 30, 28, 10),
+    ("VFR_HUD", 74, 20, 10),
+    ("SYSTEM_TIME", 2, 12, 3),
+    ("BATTERY_STATUS", 147, 36, 3),
+    ("VIBRATION", 241, 32, 3),
+    ("EKF_STATUS_REPORT", 193, 22, 3),
+]
+GCS_STREAMS = [
+    ("HEARTBEAT", 0, 9, 1),
+]
+
+# Messages of the connection and mission phases: name -> (msgid, payload bytes)
+MESSAGES = {
+    "PARAM_REQUEST_LIST": (21, 2),
+    "PARAM_VALUE": (22, 25),
+    "MISSION_COUNT": (44, 4),
+    "MISSION_REQUEST_INT": (51, 4),
+    "MISSION_ITEM_INT": (73, 37),
+    "MISSION_ACK": (47, 3),
+    "MISSION_ITEM_REACHED": (46, 2),
+    "COMMAND_LONG": (76, 33),
+    "COMMAND_ACK": (77, 3),
+}
+
+MAV_CMD_NAV_WAYPOINT = 16
+MAV_CMD_NAV_RETURN_TO_LAUNCH = 20
+MAV_CMD_NAV_TAKEOFF = 22
+MAV_TYPE_QUADROTOR = 2
+CLIMB_SPEED = 2.5  # m/s, WPNAV_SPEED_UP
+DESCENT_SPEED = 1.5  # m/s, WPNAV_SPEED_DN
+EARTH_RADIUS = 6371000.0
+ROUND_TRIP_US = 20000  # Request to response on the link
+PARAM_INTERVAL_US = 5000  # Parameter download pace
+
+
+class Trace(object):
+    def __init__(self):
+        self.messages = []
+
+    def add(self, time_us, sender, name):
+        msgid, length = MESSAGES[name]
+        self.messages.append((int(time_us), sender, msgid, length))
+
+    def stream(self, sender, streams, start_us, end_us):
+        for index, (name, msgid, length, rate) in enumerate(streams):
+            period = 1000000.0 / rate
+            # Fixed phase per stream so the streams do not all fire together
+            time_us = start_us + period * index / len(streams)
+            while time_us < end_us:
+                self.messages.append((int(time_us), sender, msgid, length))
+                time_us += period
+
+    def write(self, path):
+        with open(path, "w") as out:
+            out.write("time_us,sender,msgid,length\n")
+            for time_us, sender, msgid, length in sorted(self.messages):
+                out.write(f"{time_us},{sender},{msgid},{length}\n")
+
+
+def distance(a, b):
+    """Great-circle distance in metres between two (lat, lon) in degrees"""
+    lat1, lon1, lat2, lon2 = map(math.radians, (a[0], a[1], b[0], b[1]))
+    h = math.sin((lat2 - lat1) / 2) ** 2 + math.cos(lat1) * math.cos(lat2) * math.sin((lon2 - lon1) / 2) ** 2
+    return 2 * EARTH_RADIUS * math.asin(math.sqrt(h))
+
+
+def command(trace, time_us):
+    trace.add(time_us, "GCS", "COMMAND_LONG")
+    trace.add(time_us + ROUND_TRIP_US, "UAV", "COMMAND_ACK")
+    return time_us + 2 * ROUND_TRIP_US
+
+
+def plan_trace(plan_path, params, idle):
+    with open(plan_path) as f:
+        mission = json.load(f)["mission"]
+    home = mission["plannedHomePosition"]
+    speed = mission["hoverSpeed"] if mission.get("vehicleType") == MAV_TYPE_QUADROTOR else mission["cruiseSpeed"]
+    items = mission["items"]
+    trace = Trace()
+
+    # Parameter download and mission upload (home is item 0 on ArduPilot)
+    time_us = 1000000
+    trace.add(time_us, "GCS", "PARAM_REQUEST_LIST")
+    for _ in range(params):
+        time_us += PARAM_INTERVAL_US
+        trace.add(time_us, "UAV", "PARAM_VALUE")
+    time_us += 1000000
+    trace.add(time_us, "GCS", "MISSION_COUNT")
+    for _ in range(len(items) + 1):
+        time_us += ROUND_TRIP_US
+        trace.add(time_us, "UAV", "MISSION_REQUEST_INT")
+        time_us += ROUND_TRIP_US
+        trace.add(time_us, "GCS", "MISSION_ITEM_INT")
+    time_us += ROUND_TRIP_US
+    trace.add(time_us, "UAV", "MISSION_ACK")
+
+    # Arm, AUTO mode, mission start
+    time_us += idle * 1000000
+    for _ in range(3):
+        time_us = command(trace, time_us)
+
+    position, altitude = (home[0], home[1]), 0.0
+    for item in items:
+        values = item.get("params", [])
+        if item.get("command") == MAV_CMD_NAV_TAKEOFF:
+            target = values[6] or 0.0
+            time_us += abs(target - altitude) / CLIMB_SPEED * 1000000
+            altitude = target
+        elif item.get("command") == MAV_CMD_NAV_WAYPOINT and values[4] is not None and values[5] is not None:
+            target = (values[4], values[5])
+            time_us += distance(position, target) / speed * 1000000
+            position = target
+        elif item.get("command") == MAV_CMD_NAV_RETURN_TO_LAUNCH:
+            time_us += distance(position, (home[0], home[1])) / speed * 1000000
+            time_us += altitude / DESCENT_SPEED * 1000000
+            position, altitude = (home[0], home[1]), 0.0
+        trace.add(time_us, "UAV", "MISSION_ITEM_REACHED")
+
+    # Disarm after landing
+    time_us = command(trace, time_us + 5000000)
+    end_us = time_us + 1000000
+    trace.stream("UAV", UAV_STREAMS, 0, end_us)
+    trace.stream("GCS", GCS_STREAMS, 0, end_us)
+    return trace, end_us
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "-p", "--plan",
+        type=str,
+        dest="plan",
+        default="benchmark/benchmark.plan",
+        help="QGroundControl plan"
+    )
+
+    parser.add_argument(
+        "-o", "--output",
+        type=str,
+        dest="output",
+        default="benchmark.trace",
+        help="trace file"
+    )
+
+    parser.add_argument(
+        "-n", "--params",
+        type=int,
+        dest="params",
+        default=900,
+        help="parameters downloaded at connection"
+    )
+
+    parser.add_argument(
+        "-i", "--idle",
+        type=float,
+        dest="idle",
+        default=10,
+        help="seconds on the ground between mission upload and arming"
+    )
+
+    args = parser.parse_args()
+    trace, end_us = plan_trace(args.plan, args.params, args.idle)
+    trace.write(args.output)
+    print(f"Write {args.output}: {len(trace.messages)} messages, {end_us / 1000000.0:.1f} s "
+          f"({len(trace.messages) * 1000000.0 / end_us:.1f} messages/s)")
+
+
+if __name__ == '__main__':
+    main()
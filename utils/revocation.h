@@ -0,0 +1,409 @@
+#pragma once
+
+#ifndef _REVOCATION_H
+#define _REVOCATION_H
+/***********************************************************************************
+ * Certificate revocation list
+ *
+ * Revoked certificates are identified by (issuer, seq_number). The list is
+ * distributed as an xor filter with 8-bit fingerprints (about 1.23 bytes per
+ * entry, 1/256 false positive rate) followed by the exact entries sorted, so:
+ *
+ *   - a certificate that is not revoked is rejected by the filter with three
+ *     memory reads, which is the common case during the handshake;
+ *   - a filter hit is confirmed by a binary search in the exact table, so there
+ *     are no false positives.
+ *
+ * The list is built by the issuing tool (Revocation_Build, Revocation_Save) and
+ * loaded as it is on the vehicle (Revocation_Load), no construction work is done
+ * there. The file is signed by the authority that issued the revoked
+ * certificates: Revocation_Load checks the signature against the key the caller
+ * trusts and that the entries are strictly sorted before the list is used.
+ ***********************************************************************************/
+#include "certificate.h"
+
+#define REVOCATION_MAGIC "UAVREVOK"
+#define REVOCATION_VERSION 2
+#define REVOCATION_MAX_ATTEMPTS 64
+
+typedef struct
+{
+    char issuer[member_size(info_t, issuer)]; // Zero padded as in info_t
+    uint64_t seq_number;
+} revocation_entry_t;
+
+typedef struct
+{
+    uint64_t seed;
+    uint32_t block_length;       // The filter has 3 blocks of fingerprints
+    uint32_t count;              // Number of revoked certificates
+    uint8_t *fingerprints;       // 3 * block_length
+    revocation_entry_t *entries; // Sorted by issuer, then seq_number
+} revocation_filter_t;
+
+static uint64_t revocation_mix(uint64_t h)
+{ // MurmurHash3 finalizer
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t revocation_key(const char *issuer, uint64_t seq_number)
+{
+    uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a of the issuer
+    unsigned int i;
+
+    for (i = 0; i < member_size(info_t, issuer) && issuer[i] != 0; i++)
+    {
+        h ^= (uint8_t)issuer[i];
+        h *= 0x100000001b3ULL;
+    }
+    return revocation_mix(h + seq_number * 0x9E3779B97F4A7C15ULL);
+}
+
+static uint32_t revocation_reduce(uint32_t hash, uint32_t n)
+{ // Maps hash to [0, n) without a division
+    return (uint32_t)(((uint64_t)hash * n) >> 32);
+}
+
+static void revocation_cells(uint64_t hash, uint32_t block_length, uint32_t *cells)
+{
+    cells[0] = revocation_reduce((uint32_t)hash, block_length);
+    cells[1] = revocation_reduce((uint32_t)((hash << 21) | (hash >> 43)), block_length) + block_length;
+    cells[2] = revocation_reduce((uint32_t)((hash << 42) | (hash >> 22)), block_length) + 2 * block_length;
+}
+
+static uint8_t revocation_fingerprint(uint64_t hash)
+{
+    return (uint8_t)(hash ^ (hash >> 32));
+}
+
+static int revocation_compare_entries(const void *a, const void *b)
+{
+    const revocation_entry_t *x = (const revocation_entry_t *)a, *y = (const revocation_entry_t *)b;
+    int c = strncmp(x->issuer, y->issuer, sizeof(x->issuer));
+
+    if (c != 0)
+        return c;
+    return (x->seq_number > y->seq_number) - (x->seq_number < y->seq_number);
+}
+
+static int revocation_compare_keys(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static bool revocation_build_filter(revocation_filter_t *filter, const uint64_t *keys, uint32_t n, uint64_t *stack_hash, uint32_t *stack_cell, uint32_t *queue, uint8_t *counts, uint64_t *xors)
+{ // One attempt of the xor filter construction with the current seed
+    uint32_t size = 3 * filter->block_length, head = 0, tail = 0, peeled = 0, i, j, cells[3];
+
+    memset(counts, 0, size);
+    memset(xors, 0, size * sizeof(uint64_t));
+    for (i = 0; i < n; i++)
+    {
+        uint64_t hash = revocation_mix(keys[i] + filter->seed);
+
+        revocation_cells(hash, filter->block_length, cells);
+        for (j = 0; j < 3; j++)
+        {
+            counts[cells[j]]++;
+            xors[cells[j]] ^= hash;
+        }
+    }
+
+    for (i = 0; i < size; i++)
+    {
+        if (counts[i] == 1)
+            queue[tail++] = i;
+    }
+    while (head < tail)
+    { // Peel cells that hold a single key
+        uint32_t cell = queue[head++];
+        uint64_t hash;
+
+        if (counts[cell] != 1)
+            continue;
+        hash = xors[cell];
+        stack_hash[peeled] = hash;
+        stack_cell[peeled++] = cell;
+        revocation_cells(hash, filter->block_length, cells);
+        for (j = 0; j < 3; j++)
+        {
+            counts[cells[j]]--;
+            xors[cells[j]] ^= hash;
+            if (counts[cells[j]] == 1)
+                queue[tail++] = cells[j];
+        }
+    }
+    if (peeled != n)
+    {
+        return false;
+    }
+
+    memset(filter->fingerprints, 0, size);
+    while (peeled-- > 0)
+    {
+        revocation_cells(stack_hash[peeled], filter->block_length, cells);
+        filter->fingerprints[stack_cell[peeled]] = revocation_fingerprint(stack_hash[peeled]) ^ filter->fingerprints[cells[0]] ^ filter->fingerprints[cells[1]] ^ filter->fingerprints[cells[2]];
+    }
+    return true;
+}
+
+void Revocation_Free(revocation_filter_t *filter)
+{
+    free(filter->fingerprints);
+    free(filter->entries);
+    memset(filter, 0, sizeof(revocation_filter_t));
+}
+
+// Build the revocation list of "count" entries (duplicates are allowed)
+ECCRYPTO_STATUS Revocation_Build(revocation_filter_t *filter, const revocation_entry_t *entries, uint32_t count)
+{
+    uint64_t *keys = NULL, *stack_hash = NULL, *xors = NULL;
+    uint32_t *stack_cell = NULL, *queue = NULL, n = 0, i, attempt;
+    uint8_t *counts = NULL;
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_NO_MEMORY;
+
+    memset(filter, 0, sizeof(revocation_filter_t));
+    filter->entries = (revocation_entry_t *)malloc((count + 1) * sizeof(revocation_entry_t));
+    if (filter->entries == NULL)
+    {
+        goto cleanup;
+    }
+    memcpy(filter->entries, entries, count * sizeof(revocation_entry_t));
+    qsort(filter->entries, count, sizeof(revocation_entry_t), revocation_compare_entries);
+    for (i = 0; i < count; i++)
+    {
+        if (filter->count == 0 || revocation_compare_entries(&filter->entries[filter->count - 1], &filter->entries[i]) != 0)
+            filter->entries[filter->count++] = filter->entries[i];
+    }
+
+    keys = (uint64_t *)malloc((filter->count + 1) * sizeof(uint64_t));
+    if (keys == NULL)
+    {
+        goto cleanup;
+    }
+    for (i = 0; i < filter->count; i++)
+    {
+        keys[i] = revocation_key(filter->entries[i].issuer, filter->entries[i].seq_number);
+    }
+    qsort(keys, filter->count, sizeof(uint64_t), revocation_compare_keys);
+    for (i = 0; i < filter->count; i++)
+    { // Distinct entries with the same 64-bit key share their filter slot
+        if (n == 0 || keys[n - 1] != keys[i])
+            keys[n++] = keys[i];
+    }
+
+    filter->block_length = (uint32_t)((32 + 1.23 * n) / 3) + 1;
+    filter->fingerprints = (uint8_t *)malloc(3 * filter->block_length);
+    stack_hash = (uint64_t *)malloc((n + 1) * sizeof(uint64_t));
+    stack_cell = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+    queue = (uint32_t *)malloc(3 * (n + 1) * sizeof(uint32_t) + 3 * filter->block_length * sizeof(uint32_t));
+    counts = (uint8_t *)malloc(3 * filter->block_length);
+    xors = (uint64_t *)malloc(3 * filter->block_length * sizeof(uint64_t));
+    if (filter->fingerprints == NULL || stack_hash == NULL || stack_cell == NULL || queue == NULL || counts == NULL || xors == NULL)
+    {
+        goto cleanup;
+    }
+
+    Status = ECCRYPTO_ERROR;
+    for (attempt = 0; attempt < REVOCATION_MAX_ATTEMPTS; attempt++)
+    {
+        if (RandomBytesFunction((unsigned char *)&filter->seed, sizeof(filter->seed)) == false)
+        {
+            Status = ECCRYPTO_ERROR;
+            goto cleanup;
+        }
+        if (revocation_build_filter(filter, keys, n, stack_hash, stack_cell, queue, counts, xors))
+        {
+            Status = ECCRYPTO_SUCCESS;
+            break;
+        }
+    }
+
+cleanup:
+    free(keys);
+    free(stack_hash);
+    free(stack_cell);
+    free(queue);
+    free(counts);
+    free(xors);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        Revocation_Free(filter);
+    }
+    return Status;
+}
+
+// Check whether the certificate (issuer, seq_number) is revoked
+bool Revocation_Check(const revocation_filter_t *filter, const char *issuer, uint64_t seq_number)
+{
+    revocation_entry_t entry;
+    uint64_t hash;
+    uint32_t cells[3];
+
+    if (filter->count == 0)
+    {
+        return false;
+    }
+    hash = revocation_mix(revocation_key(issuer, seq_number) + filter->seed);
+    revocation_cells(hash, filter->block_length, cells);
+    if ((revocation_fingerprint(hash) ^ filter->fingerprints[cells[0]] ^ filter->fingerprints[cells[1]] ^ filter->fingerprints[cells[2]]) != 0)
+    {
+        return false;
+    }
+
+    // Filter hit, confirmed by the exact table
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.issuer, issuer, strnlen(issuer, sizeof(entry.issuer)));
+    entry.seq_number = seq_number;
+    return bsearch(&entry, filter->entries, filter->count, sizeof(revocation_entry_t), revocation_compare_entries) != NULL;
+}
+
+static size_t revocation_body_length(uint32_t block_length, uint32_t count)
+{ // Bytes covered by the signature: magic, header, seed, fingerprints and entries
+    return 8 + 3 * sizeof(uint32_t) + sizeof(uint64_t) + 3 * (size_t)block_length + (size_t)count * sizeof(revocation_entry_t);
+}
+
+// Write the revocation list for distribution, signed by the issuing authority
+ECCRYPTO_STATUS Revocation_Save(const revocation_filter_t *filter, const char *path, const unsigned char *SecretKey, const unsigned char *PublicKey)
+{
+    uint32_t header[3] = {REVOCATION_VERSION, filter->block_length, filter->count};
+    size_t length = revocation_body_length(filter->block_length, filter->count), offset = 0;
+    unsigned char *body, signature[64];
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR;
+    FILE *fp;
+
+    if (length > UINT32_MAX)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    body = (unsigned char *)malloc(length);
+    if (body == NULL)
+    {
+        return ECCRYPTO_ERROR_NO_MEMORY;
+    }
+    memcpy(body, REVOCATION_MAGIC, 8);
+    offset += 8;
+    memcpy(body + offset, header, sizeof(header));
+    offset += sizeof(header);
+    memcpy(body + offset, &filter->seed, sizeof(filter->seed));
+    offset += sizeof(filter->seed);
+    memcpy(body + offset, filter->fingerprints, 3 * filter->block_length);
+    offset += 3 * filter->block_length;
+    memcpy(body + offset, filter->entries, filter->count * sizeof(revocation_entry_t));
+
+    Status = SchnorrQ_Sign(SecretKey, PublicKey, body, (unsigned int)length, signature);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+    Status = ECCRYPTO_ERROR;
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        goto cleanup;
+    }
+    if (fwrite(body, length, 1, fp) == 1 && fwrite(signature, sizeof(signature), 1, fp) == 1)
+    {
+        Status = ECCRYPTO_SUCCESS;
+    }
+    if (fclose(fp) != 0)
+    {
+        Status = ECCRYPTO_ERROR;
+    }
+
+cleanup:
+    free(body);
+    return Status;
+}
+
+// Load a revocation list written by Revocation_Save, signed with PublicKey
+ECCRYPTO_STATUS Revocation_Load(revocation_filter_t *filter, const char *path, const unsigned char *PublicKey)
+{
+    unsigned char *body = NULL;
+    uint32_t header[3];
+    size_t offset = 8 + sizeof(header), length;
+    unsigned int valid = false, i;
+    long size;
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR;
+    FILE *fp;
+
+    memset(filter, 0, sizeof(revocation_filter_t));
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || (size_t)size < offset + sizeof(uint64_t) + 64 || (size_t)size > UINT32_MAX || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        goto cleanup;
+    }
+    body = (unsigned char *)malloc((size_t)size);
+    if (body == NULL)
+    {
+        Status = ECCRYPTO_ERROR_NO_MEMORY;
+        goto cleanup;
+    }
+    if (fread(body, (size_t)size, 1, fp) != 1)
+    {
+        goto cleanup;
+    }
+
+    // The whole file is checked before anything in it is used
+    memcpy(header, body + 8, sizeof(header));
+    if (memcmp(body, REVOCATION_MAGIC, 8) != 0 || header[0] != REVOCATION_VERSION || header[1] == 0 || header[1] > UINT32_MAX / 3)
+    {
+        goto cleanup;
+    }
+    length = revocation_body_length(header[1], header[2]);
+    if (length + 64 != (size_t)size)
+    {
+        goto cleanup;
+    }
+    Status = SchnorrQ_Verify(PublicKey, body, (unsigned int)length, body + length, &valid);
+    if (Status != ECCRYPTO_SUCCESS || valid == false)
+    {
+        Status = ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+        goto cleanup;
+    }
+    Status = ECCRYPTO_ERROR;
+
+    filter->block_length = header[1];
+    filter->count = header[2];
+    memcpy(&filter->seed, body + offset, sizeof(filter->seed));
+    offset += sizeof(filter->seed);
+    filter->fingerprints = (uint8_t *)malloc(3 * filter->block_length);
+    filter->entries = (revocation_entry_t *)malloc(((size_t)filter->count + 1) * sizeof(revocation_entry_t));
+    if (filter->fingerprints == NULL || filter->entries == NULL)
+    {
+        Status = ECCRYPTO_ERROR_NO_MEMORY;
+        goto cleanup;
+    }
+    memcpy(filter->fingerprints, body + offset, 3 * filter->block_length);
+    offset += 3 * filter->block_length;
+    memcpy(filter->entries, body + offset, filter->count * sizeof(revocation_entry_t));
+    for (i = 1; i < filter->count; i++)
+    { // Revocation_Check relies on a binary search
+        if (revocation_compare_entries(&filter->entries[i - 1], &filter->entries[i]) >= 0)
+        {
+            goto cleanup;
+        }
+    }
+    Status = ECCRYPTO_SUCCESS;
+
+cleanup:
+    fclose(fp);
+    free(body);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        Revocation_Free(filter);
+    }
+    return Status;
+}
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#ifndef _SEQALLOC_H
+#define _SEQALLOC_H
+/***********************************************************************************
+ * Certificate sequence number allocator
+ *
+ * The last issued sequence number is a 64-bit counter in a small file mapped
+ * MAP_SHARED by every issuer, so threads and processes allocate numbers with one
+ * atomic fetch-and-add on the same page and never take a lock. Workers reserve
+ * blocks of numbers (SeqAlloc_Reserve) and hand them out locally (SeqAlloc_Next),
+ * which keeps the shared cache line out of the issuance loop.
+ *
+ * A legacy text file (one decimal number) at the same path is converted on open.
+ ***********************************************************************************/
+#include "fourq.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SEQALLOC_MAGIC "UAVSEQNO"
+#define SEQALLOC_VERSION 1
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t last; // Last issued sequence number
+} seqalloc_header_t;
+
+typedef struct
+{
+    int fd;
+    seqalloc_header_t *header;
+} seqalloc_t;
+
+typedef struct
+{ // Block of sequence numbers owned by one worker, [next, end)
+    uint64_t next;
+    uint64_t end;
+} seqalloc_block_t;
+
+// Open (or create) the allocator backed by "path"
+ECCRYPTO_STATUS SeqAlloc_Open(seqalloc_t *alloc, const char *path)
+{
+    seqalloc_header_t header;
+    char legacy[32];
+    struct stat st;
+    ssize_t len;
+
+    alloc->header = NULL;
+    alloc->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (alloc->fd < 0)
+    {
+        return ECCRYPTO_ERROR;
+    }
+
+    // Concurrent issuers may open the file at the same time: only one initializes it
+    if (flock(alloc->fd, LOCK_EX) != 0 || fstat(alloc->fd, &st) != 0)
+    {
+        goto error;
+    }
+    if (st.st_size != sizeof(seqalloc_header_t) || pread(alloc->fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, SEQALLOC_MAGIC, sizeof(header.magic)) != 0)
+    {
+        memset(&header, 0, sizeof(header));
+        len = pread(alloc->fd, legacy, sizeof(legacy) - 1, 0);
+        if (len > 0)
+        { // Number written by the previous text-based counter
+            legacy[len] = 0;
+            header.last = strtoull(legacy, NULL, 10);
+        }
+        memcpy(header.magic, SEQALLOC_MAGIC, sizeof(header.magic));
+        header.version = SEQALLOC_VERSION;
+        if (ftruncate(alloc->fd, 0) != 0 || pwrite(alloc->fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            goto error;
+        }
+    }
+    else if (header.version != SEQALLOC_VERSION)
+    {
+        goto error;
+    }
+
+    alloc->header = (seqalloc_header_t *)mmap(NULL, sizeof(seqalloc_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, alloc->fd, 0);
+    if (alloc->header == MAP_FAILED)
+    {
+        alloc->header = NULL;
+        goto error;
+    }
+    flock(alloc->fd, LOCK_UN);
+    return ECCRYPTO_SUCCESS;
+
+error:
+    close(alloc->fd);
+    alloc->fd = -1;
+    return ECCRYPTO_ERROR;
+}
+
+void SeqAlloc_Close(seqalloc_t *alloc)
+{
+    if (alloc->header != NULL)
+    {
+        msync(alloc->header, sizeof(seqalloc_header_t), MS_SYNC);
+        munmap(alloc->header, sizeof(seqalloc_header_t));
+    }
+    if (alloc->fd >= 0)
+        close(alloc->fd);
+    alloc->header = NULL;
+    alloc->fd = -1;
+}
+
+// Restart the numbering, the next number issued is last + 1
+void SeqAlloc_Reset(seqalloc_t *alloc, uint64_t last)
+{
+    __atomic_store_n(&alloc->header->last, last, __ATOMIC_SEQ_CST);
+}
+
+// Reserve "count" consecutive sequence numbers, returns the first one
+uint64_t SeqAlloc_Reserve(seqalloc_t *alloc, uint64_t count)
+{
+    return __atomic_fetch_add(&alloc->header->last, count, __ATOMIC_RELAXED) + 1;
+}
+
+// Next sequence number of a worker, reserving a new block of "block_size" numbers when the current one is used up
+// The block must be zero-initialized before the first call
+uint64_t SeqAlloc_Next(seqalloc_t *alloc, seqalloc_block_t *block, uint64_t block_size)
+{
+    if (block->next == block->end)
+    {
+        block->next = SeqAlloc_Reserve(alloc, block_size);
+        block->end = block->next + block_size;
+    }
+    return block->next++;
+}
+#endif
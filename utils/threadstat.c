@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+// Per-thread resource sampler, a high-rate replacement for "pidstat -u -r"
+// Samples /proc/<pid>/task/<tid>/{stat,schedstat,status} at 100 Hz - 1 kHz and writes the CSV
+// schema of benchmark/data (as produced by csvcleaner.sh), one row per process and interval,
+// so bench.py reads it as it is. With -T it writes one row per thread and interval instead,
+// followed by the new columns TID, Timestamp (epoch seconds, microsecond resolution),
+// cswch/s and nvcswch/s.
+//
+// %CPU and %wait come from schedstat (nanosecond run time and run queue delay), because
+// the clock ticks of stat (10 ms) are too coarse for short intervals; %usr and %system
+// split %CPU in the ratio of the user/system ticks. The per-thread files stay open and are
+// re-read with pread, the task directory is rescanned every 100 ms.
+
+#define MAX_THREADS 256
+#define RESCAN_NS 100000000ULL
+
+typedef struct
+{
+    int tid;
+    int stat_fd, schedstat_fd, status_fd;
+    bool seen; // Still present in the last rescan
+    char comm[32];
+    uint64_t utime, stime, gtime, minflt, majflt; // Clock ticks, faults
+    uint64_t exec_ns, delay_ns;                   // schedstat
+    uint64_t nvcsw, nivcsw;                       // Voluntary, involuntary context switches
+    uint64_t vsz_kb, rss_kb;
+    int cpu;
+} thread_sample_t;
+
+typedef struct
+{
+    int pid;
+    unsigned int uid;
+    long ticks_per_second, page_kb;
+    uint64_t mem_total_kb;
+    thread_sample_t threads[MAX_THREADS];
+    unsigned int count;
+} sampler_t;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int signum)
+{
+    (void)signum;
+    stop = 1;
+}
+
+static uint64_t now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int read_file(int fd, char *buffer, size_t size)
+{ // Re-read a /proc file through its open descriptor
+    ssize_t len = pread(fd, buffer, size - 1, 0);
+
+    if (len <= 0)
+        return -1;
+    buffer[len] = 0;
+    return (int)len;
+}
+
+static uint64_t status_field(const char *status, const char *name)
+{
+    const char *p = strstr(status, name);
+
+    return p != NULL ? strtoull(p + strlen(name), NULL, 10) : 0;
+}
+
+static bool sample_thread(const sampler_t *sampler, thread_sample_t *t)
+{
+    char buffer[2048], *p;
+    unsigned long long field[52];
+    unsigned int i;
+
+    memset(field, 0, sizeof(field));
+    if (read_file(t->stat_fd, buffer, sizeof(buffer)) < 0)
+        return false;
+    // The command is between parentheses and may contain spaces, fields are numbered after it
+    p = strrchr(buffer, ')');
+    if (p == NULL)
+        return false;
+    p += 2;
+    for (i = 3; i < 52 && *p; i++)
+    {
+        while (*p == ' ')
+            p++;
+        field[i] = strtoull(p, &p, 10);
+        if (i == 3)
+            p++; // State character
+    }
+    t->minflt = field[10];
+    t->majflt = field[12];
+    t->utime = field[14];
+    t->stime = field[15];
+    t->vsz_kb = field[23] / 1024;
+    t->rss_kb = field[24] * sampler->page_kb;
+    t->cpu = (int)field[39];
+    t->gtime = field[43];
+
+    if (read_file(t->schedstat_fd, buffer, sizeof(buffer)) > 0)
+        sscanf(buffer, "%" SCNu64 " %" SCNu64, &t->exec_ns, &t->delay_ns);
+    if (read_file(t->status_fd, buffer, sizeof(buffer)) > 0)
+    {
+        t->nvcsw = status_field(buffer, "voluntary_ctxt_switches:");
+        t->nivcsw = status_field(buffer, "nonvoluntary_ctxt_switches:");
+    }
+    return true;
+}
+
+static int open_task_file(int pid, int tid, const char *name)
+{
+    char path[96];
+
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/%s", pid, tid, name);
+    return open(path, O_RDONLY);
+}
+
+static void close_thread(thread_sample_t *t)
+{
+    close(t->stat_fd);
+    close(t->schedstat_fd);
+    close(t->status_fd);
+}
+
+static void rescan(sampler_t *sampler)
+{ // Open the threads created since the last scan, drop the ones that exited
+    char path[64], comm_path[96];
+    struct dirent *entry;
+    unsigned int i;
+    DIR *dir;
+    FILE *fp;
+    int tid;
+
+    snprintf(path, sizeof(path), "/proc/%d/task", sampler->pid);
+    dir = opendir(path);
+    if (dir == NULL)
+        return;
+    for (i = 0; i < sampler->count; i++)
+        sampler->threads[i].seen = false;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        tid = atoi(entry->d_name);
+        if (tid <= 0)
+            continue;
+        for (i = 0; i < sampler->count && sampler->threads[i].tid != tid; i++)
+            ;
+        if (i < sampler->count)
+        {
+            sampler->threads[i].seen = true;
+            continue;
+        }
+        if (sampler->count == MAX_THREADS)
+            continue;
+
+        thread_sample_t *t = &sampler->threads[sampler->count];
+        memset(t, 0, sizeof(thread_sample_t));
+        t->tid = tid;
+        t->stat_fd = open_task_file(sampler->pid, tid, "stat");
+        t->schedstat_fd = open_task_file(sampler->pid, tid, "schedstat");
+        t->status_fd = open_task_file(sampler->pid, tid, "status");
+        if (t->stat_fd < 0 || t->schedstat_fd < 0 || t->status_fd < 0 || !sample_thread(sampler, t))
+        {
+            close_thread(t);
+            continue;
+        }
+        snprintf(comm_path, sizeof(comm_path), "/proc/%d/task/%d/comm", sampler->pid, tid);
+        fp = fopen(comm_path, "r");
+        if (fp != NULL)
+        {
+            if (fgets(t->comm, sizeof(t->comm), fp) != NULL)
+                t->comm[strcspn(t->comm, "\n")] = 0;
+            fclose(fp);
+        }
+        t->seen = true;
+        sampler->count++;
+    }
+    closedir(dir);
+
+    for (i = 0; i < sampler->count;)
+    {
+        if (!sampler->threads[i].seen)
+        {
+            close_thread(&sampler->threads[i]);
+            sampler->threads[i] = sampler->threads[--sampler->count];
+        }
+        else
+            i++;
+    }
+}
+
+static void write_row(FILE *out, const sampler_t *sampler, const thread_sample_t *now, const thread_sample_t *before, int tid, bool per_thread, double interval_s, uint64_t wall_ns)
+{ // The legacy pidstat columns, then the per-thread ones
+    double cpu = (now->exec_ns - before->exec_ns) / 1e9 / interval_s * 100.0;
+    double wait = (now->delay_ns - before->delay_ns) / 1e9 / interval_s * 100.0;
+    double guest = (double)(now->gtime - before->gtime) / sampler->ticks_per_second / interval_s * 100.0;
+    uint64_t user = now->utime - before->utime, system = now->stime - before->stime;
+    double usr, sys;
+    char clock[16];
+    time_t seconds = (time_t)(wall_ns / 1000000000ULL);
+    struct tm tm;
+
+    if (user + system == 0)
+    { // No tick in the interval: split with the totals so far
+        user = now->utime;
+        system = now->stime;
+    }
+    usr = user + system ? cpu * user / (user + system) : cpu;
+    sys = cpu - usr;
+    if (guest > usr)
+        guest = usr;
+
+    localtime_r(&seconds, &tm);
+    strftime(clock, sizeof(clock), "%H:%M:%S", &tm);
+    fprintf(out, "%s,%u,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%d,%.2f,%.2f,%" PRIu64 ",%" PRIu64 ",%.2f,%s",
+            clock, sampler->uid, sampler->pid, usr, sys, guest, wait, cpu, now->cpu,
+            (now->minflt - before->minflt) / interval_s, (now->majflt - before->majflt) / interval_s,
+            now->vsz_kb, now->rss_kb, sampler->mem_total_kb ? 100.0 * now->rss_kb / sampler->mem_total_kb : 0.0, now->comm);
+    if (per_thread)
+        fprintf(out, ",%d,%" PRIu64 ".%06" PRIu64 ",%.2f,%.2f", tid, (uint64_t)(wall_ns / 1000000000ULL), (uint64_t)((wall_ns / 1000) % 1000000),
+                (now->nvcsw - before->nvcsw) / interval_s, (now->nivcsw - before->nivcsw) / interval_s);
+    fprintf(out, "\n");
+}
+
+static void add_sample(thread_sample_t *total, const thread_sample_t *t)
+{
+    total->utime += t->utime;
+    total->stime += t->stime;
+    total->gtime += t->gtime;
+    total->minflt += t->minflt;
+    total->majflt += t->majflt;
+    total->exec_ns += t->exec_ns;
+    total->delay_ns += t->delay_ns;
+    total->nvcsw += t->nvcsw;
+    total->nivcsw += t->nivcsw;
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s -p pid [-r hz] [-d seconds] [-o file.csv] [-T]\n", name);
+    printf("  -r: samples per second (default: 100)\n");
+    printf("  -d: stop after the given time (default: until the process exits or SIGINT)\n");
+    printf("  -o: output file (default: stdout)\n");
+    printf("  -T: one row per thread instead of one per process, with the TID, Timestamp, cswch/s and nvcswch/s columns\n");
+}
+
+int main(int argc, char **argv)
+{
+    static sampler_t sampler;
+    static thread_sample_t previous[MAX_THREADS];
+    thread_sample_t total, total_before;
+    unsigned int rate = 100, previous_count = 0, i, j;
+    double duration = 0, interval_s;
+    uint64_t period_ns, next, start, last, last_scan, current, wall;
+    const char *output = NULL;
+    bool per_thread = false;
+    char path[64], buffer[4096];
+    struct timespec deadline;
+    struct stat st;
+    FILE *out = stdout, *fp;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:r:d:o:Th")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            sampler.pid = atoi(optarg);
+            break;
+        case 'r':
+            rate = (unsigned int)atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'T':
+            per_thread = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    snprintf(path, sizeof(path), "/proc/%d", sampler.pid);
+    if (sampler.pid <= 0 || rate == 0 || stat(path, &st) != 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    sampler.uid = st.st_uid;
+    sampler.ticks_per_second = sysconf(_SC_CLK_TCK);
+    sampler.page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    fp = fopen("/proc/meminfo", "r");
+    if (fp != NULL)
+    {
+        if (fgets(buffer, sizeof(buffer), fp) != NULL)
+            sampler.mem_total_kb = strtoull(buffer + strlen("MemTotal:"), NULL, 10);
+        fclose(fp);
+    }
+    if (output != NULL && (out = fopen(output, "w")) == NULL)
+    {
+        perror(output);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    fprintf(out, "Time,UID,PID,%%usr,%%system,%%guest,%%wait,%%CPU,CPU,minflt/s,majflt/s,VSZ,RSS,%%MEM,Command");
+    fprintf(out, per_thread ? ",TID,Timestamp,cswch/s,nvcswch/s\n" : "\n");
+
+    period_ns = 1000000000ULL / rate;
+    rescan(&sampler);
+    memcpy(previous, sampler.threads, sampler.count * sizeof(thread_sample_t));
+    previous_count = sampler.count;
+    start = last = last_scan = next = now_ns(CLOCK_MONOTONIC);
+
+    while (!stop && (duration <= 0 || last - start < (uint64_t)(duration * 1e9)))
+    {
+        next += period_ns;
+        deadline.tv_sec = (time_t)(next / 1000000000ULL);
+        deadline.tv_nsec = (long)(next % 1000000000ULL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && !stop)
+            ;
+
+        if (next - last_scan >= RESCAN_NS)
+        {
+            rescan(&sampler);
+            last_scan = next;
+            if (sampler.count == 0)
+                break; // The process exited
+        }
+        for (i = 0; i < sampler.count; i++)
+            sample_thread(&sampler, &sampler.threads[i]);
+        wall = now_ns(CLOCK_REALTIME);
+        current = now_ns(CLOCK_MONOTONIC);
+        interval_s = (current - last) / 1e9;
+        last = current;
+
+        memset(&total, 0, sizeof(total));
+        memset(&total_before, 0, sizeof(total_before));
+        for (i = 0; i < sampler.count; i++)
+        {
+            thread_sample_t *t = &sampler.threads[i];
+
+            for (j = 0; j < previous_count && previous[j].tid != t->tid; j++)
+                ;
+            if (j == previous_count)
+                continue; // New thread, its first interval starts now
+            if (!per_thread)
+            {
+                add_sample(&total, t);
+                add_sample(&total_before, &previous[j]);
+                if (t->tid == sampler.pid || total.comm[0] == 0)
+                {
+                    memcpy(total.comm, t->comm, sizeof(total.comm));
+                    total.cpu = t->cpu;
+                }
+                total.vsz_kb = t->vsz_kb; // Shared by all the threads
+                total.rss_kb = t->rss_kb;
+            }
+            else
+                write_row(out, &sampler, t, &previous[j], t->tid, true, interval_s, wall);
+        }
+        if (!per_thread && sampler.count > 0)
+            write_row(out, &sampler, &total, &total_before, sampler.pid, false, interval_s, wall);
+
+        memcpy(previous, sampler.threads, sampler.count * sizeof(thread_sample_t));
+        previous_count = sampler.count;
+    }
+
+    for (i = 0; i < sampler.count; i++)
+        close_thread(&sampler.threads[i]);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
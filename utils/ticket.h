@@ -0,0 +1,323 @@
+#pragma once
+
+#ifndef _TICKET_H
+#define _TICKET_H
+/***********************************************************************************
+ * Session resumption tickets
+ *
+ * After a full handshake the GCS hands the vehicle a ticket, sealed under a key
+ * only the GCS knows:
+ *
+ *   ticket = key_id | expiry | nonce | Enc(resumption secret | seq | device_id | issuer) | tag
+ *
+ * Enc xors a keystream KDF(enc_key, "ticket stream", nonce || counter), tag is
+ * KDF(mac_key, "ticket tag", everything before it) truncated to 32 bytes. The
+ * GCS keeps no per-vehicle state; both sides compute the resumption secret as
+ * KDF(session_key, "resumption").
+ *
+ * On reconnect (no certificate, no elliptic curve work):
+ *
+ *   vehicle -> GCS: 0x03 | ticket | N_v | binder = KDF(secret, "resume binder", 0x03 | ticket | N_v)
+ *   GCS -> vehicle: 0x04 | N_g | new ticket | confirm = KDF(key', "resume confirm", H(request) || 0x04 | N_g | new ticket)
+ *
+ *   key' = KDF(secret, "resume", N_v || N_g)
+ *
+ * The binder proves the vehicle holds the secret of the ticket, the confirmation
+ * that the GCS could open it. The new ticket carries KDF(key', "resumption") and
+ * the expiry of the first one, so a session can be resumed until the original
+ * ticket lifetime (capped by the certificate end_time) runs out.
+ ***********************************************************************************/
+#include "handshake.h"
+#include "kdf.h"
+
+#define TICKET_NONCE_BYTES 16
+#define TICKET_TAG_BYTES 32
+#define TICKET_SECRET_BYTES 64
+#define TICKET_PLAIN_BYTES (TICKET_SECRET_BYTES + 8 + 1 + member_size(info_t, issuer))
+#define TICKET_BYTES (4 + 8 + TICKET_NONCE_BYTES + TICKET_PLAIN_BYTES + TICKET_TAG_BYTES)
+#define TICKET_REQUEST_BYTES (1 + TICKET_BYTES + TICKET_NONCE_BYTES + 32)
+#define TICKET_RESPONSE_BYTES (1 + TICKET_NONCE_BYTES + TICKET_BYTES + 32)
+#define TICKET_REQUEST 0x03
+#define TICKET_RESPONSE 0x04
+
+typedef struct
+{ // Ticket sealing key of the GCS, rotate by issuing under a new key_id and accepting the previous one for a lifetime
+    uint32_t key_id;
+    unsigned char enc_key[32];
+    unsigned char mac_key[32];
+    hmac_sha512_key_t enc, mac; // Prepared enc_key and mac_key
+} ticket_key_t;
+
+typedef struct
+{ // Vehicle side
+    unsigned char ticket[TICKET_BYTES];
+    unsigned char secret[TICKET_SECRET_BYTES];
+    uint64_t expiry;
+    unsigned char request_hash[64]; // H(pending request)
+    unsigned char nonce[TICKET_NONCE_BYTES];
+} ticket_client_t;
+
+static void ticket_put_u64(unsigned char *out, uint64_t value)
+{
+    unsigned int i;
+
+    for (i = 0; i < 8; i++)
+        out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint64_t ticket_get_u64(const unsigned char *in)
+{
+    uint64_t value = 0;
+    unsigned int i;
+
+    for (i = 8; i-- > 0;)
+        value = (value << 8) | in[i];
+    return value;
+}
+
+static void ticket_crypt(const ticket_key_t *key, const unsigned char *nonce, unsigned char *data)
+{ // Xor the keystream over the ticket contents, encrypts and decrypts
+    unsigned char block[TICKET_NONCE_BYTES + 1], stream[64];
+    unsigned int i, j;
+
+    memcpy(block, nonce, TICKET_NONCE_BYTES);
+    for (i = 0; i < TICKET_PLAIN_BYTES; i += 64)
+    {
+        block[TICKET_NONCE_BYTES] = (unsigned char)(i / 64);
+        KDF_SHA512_Prepared(&key->enc, "ticket stream", block, sizeof(block), stream);
+        for (j = 0; j < 64 && i + j < TICKET_PLAIN_BYTES; j++)
+            data[i + j] ^= stream[j];
+    }
+    clear_words((unsigned int *)stream, sizeof(stream) / sizeof(unsigned int));
+}
+
+static ECCRYPTO_STATUS ticket_seal(const ticket_key_t *key, const unsigned char *secret, uint64_t expiry, const info_t *peer, unsigned char *ticket)
+{
+    unsigned char *plain = &ticket[4 + 8 + TICKET_NONCE_BYTES], tag[64];
+
+    ticket[0] = (unsigned char)key->key_id;
+    ticket[1] = (unsigned char)(key->key_id >> 8);
+    ticket[2] = (unsigned char)(key->key_id >> 16);
+    ticket[3] = (unsigned char)(key->key_id >> 24);
+    ticket_put_u64(&ticket[4], expiry);
+    if (RandomBytesFunction(&ticket[4 + 8], TICKET_NONCE_BYTES) == false)
+    {
+        return ECCRYPTO_ERROR;
+    }
+
+    memcpy(plain, secret, TICKET_SECRET_BYTES);
+    ticket_put_u64(&plain[TICKET_SECRET_BYTES], peer->seq_number);
+    plain[TICKET_SECRET_BYTES + 8] = peer->device_id;
+    memcpy(&plain[TICKET_SECRET_BYTES + 9], peer->issuer, member_size(info_t, issuer));
+    ticket_crypt(key, &ticket[4 + 8], plain);
+
+    KDF_SHA512_Prepared(&key->mac, "ticket tag", ticket, TICKET_BYTES - TICKET_TAG_BYTES, tag);
+    memcpy(&ticket[TICKET_BYTES - TICKET_TAG_BYTES], tag, TICKET_TAG_BYTES);
+    return ECCRYPTO_SUCCESS;
+}
+
+static bool ticket_open(const ticket_key_t *keys, unsigned int key_count, const unsigned char *ticket, uint64_t now, unsigned char *secret, uint64_t *expiry, info_t *peer)
+{ // Authenticate and decrypt a ticket, false if it is forged, sealed under an unknown key or expired
+    unsigned char plain[TICKET_PLAIN_BYTES], tag[64];
+    const ticket_key_t *key = NULL;
+    uint32_t key_id;
+    unsigned int i, diff = 0;
+
+    key_id = (uint32_t)ticket[0] | (uint32_t)ticket[1] << 8 | (uint32_t)ticket[2] << 16 | (uint32_t)ticket[3] << 24;
+    for (i = 0; i < key_count; i++)
+    {
+        if (keys[i].key_id == key_id)
+            key = &keys[i];
+    }
+    if (key == NULL)
+    {
+        return false;
+    }
+    KDF_SHA512_Prepared(&key->mac, "ticket tag", ticket, TICKET_BYTES - TICKET_TAG_BYTES, tag);
+    for (i = 0; i < TICKET_TAG_BYTES; i++)
+        diff |= tag[i] ^ ticket[TICKET_BYTES - TICKET_TAG_BYTES + i];
+    *expiry = ticket_get_u64(&ticket[4]);
+    if (diff != 0 || now >= *expiry)
+    {
+        return false;
+    }
+
+    memcpy(plain, &ticket[4 + 8 + TICKET_NONCE_BYTES], TICKET_PLAIN_BYTES);
+    ticket_crypt(key, &ticket[4 + 8], plain);
+    memcpy(secret, plain, TICKET_SECRET_BYTES);
+    memset(peer, 0, sizeof(info_t));
+    peer->seq_number = ticket_get_u64(&plain[TICKET_SECRET_BYTES]);
+    peer->device_id = plain[TICKET_SECRET_BYTES + 8];
+    memcpy(peer->issuer, &plain[TICKET_SECRET_BYTES + 9], member_size(info_t, issuer));
+    clear_words((unsigned int *)plain, sizeof(plain) / sizeof(unsigned int));
+    return true;
+}
+
+static bool ticket_equal(const unsigned char *a, const unsigned char *b, unsigned int length)
+{
+    unsigned int i, diff = 0;
+
+    for (i = 0; i < length; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+// Generate a random ticket sealing key
+ECCRYPTO_STATUS TicketKey_Generate(ticket_key_t *key, uint32_t key_id)
+{
+    key->key_id = key_id;
+    if (RandomBytesFunction(key->enc_key, sizeof(key->enc_key)) == false || RandomBytesFunction(key->mac_key, sizeof(key->mac_key)) == false)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    HMAC_SHA512_Init(&key->enc, key->enc_key, sizeof(key->enc_key));
+    HMAC_SHA512_Init(&key->mac, key->mac_key, sizeof(key->mac_key));
+    return ECCRYPTO_SUCCESS;
+}
+
+// GCS: ticket for the peer of a completed handshake
+// Inputs: sealing key, handshake in HANDSHAKE_DONE, current time "now" and ticket "lifetime" (seconds)
+// Output: TICKET_BYTES-byte ticket, to be sent to the vehicle
+ECCRYPTO_STATUS Ticket_Issue(const ticket_key_t *key, const handshake_t *hs, uint64_t now, uint64_t lifetime, unsigned char *ticket)
+{
+    unsigned char secret[64];
+    uint64_t expiry = now + lifetime;
+    ECCRYPTO_STATUS Status;
+
+    if (hs->state != HANDSHAKE_DONE)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    if (expiry > (uint64_t)hs->peer.end_time)
+    { // A ticket never outlives the certificate it stands for
+        expiry = (uint64_t)hs->peer.end_time;
+    }
+    KDF_SHA512(hs->session_key, sizeof(hs->session_key), "resumption", NULL, 0, secret);
+    Status = ticket_seal(key, secret, expiry, &hs->peer, ticket);
+    clear_words((unsigned int *)secret, sizeof(secret) / sizeof(unsigned int));
+
+    return Status;
+}
+
+// Vehicle: keep the ticket received after a completed handshake
+void TicketClient_Init(ticket_client_t *client, const handshake_t *hs, const unsigned char *ticket)
+{
+    memset(client, 0, sizeof(ticket_client_t));
+    memcpy(client->ticket, ticket, TICKET_BYTES);
+    client->expiry = ticket_get_u64(&ticket[4]);
+    KDF_SHA512(hs->session_key, sizeof(hs->session_key), "resumption", NULL, 0, client->secret);
+}
+
+// Vehicle: resumption request, fails if the ticket is known to be expired (a full handshake is needed)
+// Output: TICKET_REQUEST_BYTES-byte message
+ECCRYPTO_STATUS TicketClient_Request(ticket_client_t *client, uint64_t now, unsigned char *message)
+{
+    unsigned char binder[64];
+
+    if (now >= client->expiry)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    if (RandomBytesFunction(client->nonce, TICKET_NONCE_BYTES) == false)
+    {
+        return ECCRYPTO_ERROR;
+    }
+    message[0] = TICKET_REQUEST;
+    memcpy(&message[1], client->ticket, TICKET_BYTES);
+    memcpy(&message[1 + TICKET_BYTES], client->nonce, TICKET_NONCE_BYTES);
+    KDF_SHA512(client->secret, TICKET_SECRET_BYTES, "resume binder", message, TICKET_REQUEST_BYTES - 32, binder);
+    memcpy(&message[TICKET_REQUEST_BYTES - 32], binder, 32);
+    crypto_sha512(message, TICKET_REQUEST_BYTES, client->request_hash);
+
+    return ECCRYPTO_SUCCESS;
+}
+
+// GCS: answer a resumption request
+// Inputs: accepted sealing keys, optional revocation filter (NULL), request, current time "now"
+// Outputs: TICKET_RESPONSE_BYTES-byte response, 64-byte session_key, peer (seq_number, device_id and issuer of its certificate)
+ECCRYPTO_STATUS Ticket_Accept(const ticket_key_t *keys, unsigned int key_count, const revocation_filter_t *revoked, const unsigned char *message, unsigned int length, uint64_t now,
+                              unsigned char *response, unsigned char *session_key, info_t *peer)
+{
+    unsigned char secret[TICKET_SECRET_BYTES], binder[64], context[64 + TICKET_RESPONSE_BYTES];
+    const unsigned char *nonce = &message[1 + TICKET_BYTES];
+    ECCRYPTO_STATUS Status = ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+    uint64_t expiry;
+
+    if (length != TICKET_REQUEST_BYTES || message[0] != TICKET_REQUEST || key_count == 0)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    if (!ticket_open(keys, key_count, &message[1], now, secret, &expiry, peer))
+    {
+        return ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+    }
+    KDF_SHA512(secret, sizeof(secret), "resume binder", message, TICKET_REQUEST_BYTES - 32, binder);
+    if (!ticket_equal(binder, &message[TICKET_REQUEST_BYTES - 32], 32))
+    {
+        goto cleanup;
+    }
+    if (revoked != NULL && Revocation_Check(revoked, peer->issuer, peer->seq_number))
+    {
+        goto cleanup;
+    }
+
+    response[0] = TICKET_RESPONSE;
+    if (RandomBytesFunction(&response[1], TICKET_NONCE_BYTES) == false)
+    {
+        Status = ECCRYPTO_ERROR;
+        goto cleanup;
+    }
+    memcpy(context, nonce, TICKET_NONCE_BYTES);
+    memcpy(&context[TICKET_NONCE_BYTES], &response[1], TICKET_NONCE_BYTES);
+    KDF_SHA512(secret, sizeof(secret), "resume", context, 2 * TICKET_NONCE_BYTES, session_key);
+
+    // The next ticket: secret of the new session, same expiry, sealed under the first (current) key
+    KDF_SHA512(session_key, 64, "resumption", NULL, 0, secret);
+    Status = ticket_seal(&keys[0], secret, expiry, peer, &response[1 + TICKET_NONCE_BYTES]);
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        goto cleanup;
+    }
+
+    crypto_sha512(message, length, context);
+    memcpy(&context[64], response, TICKET_RESPONSE_BYTES - 32);
+    KDF_SHA512(session_key, 64, "resume confirm", context, 64 + TICKET_RESPONSE_BYTES - 32, binder);
+    memcpy(&response[TICKET_RESPONSE_BYTES - 32], binder, 32);
+
+cleanup:
+    clear_words((unsigned int *)secret, sizeof(secret) / sizeof(unsigned int));
+    if (Status != ECCRYPTO_SUCCESS)
+    {
+        clear_words((unsigned int *)session_key, 64 / sizeof(unsigned int));
+    }
+    return Status;
+}
+
+// Vehicle: check the response of the GCS and switch to the new ticket
+// Output: 64-byte session_key
+ECCRYPTO_STATUS TicketClient_Finish(ticket_client_t *client, const unsigned char *message, unsigned int length, unsigned char *session_key)
+{
+    unsigned char context[64 + TICKET_RESPONSE_BYTES], confirm[64];
+
+    if (length != TICKET_RESPONSE_BYTES || message[0] != TICKET_RESPONSE)
+    {
+        return ECCRYPTO_ERROR_INVALID_PARAMETER;
+    }
+    memcpy(context, client->nonce, TICKET_NONCE_BYTES);
+    memcpy(&context[TICKET_NONCE_BYTES], &message[1], TICKET_NONCE_BYTES);
+    KDF_SHA512(client->secret, TICKET_SECRET_BYTES, "resume", context, 2 * TICKET_NONCE_BYTES, session_key);
+
+    memcpy(context, client->request_hash, 64);
+    memcpy(&context[64], message, TICKET_RESPONSE_BYTES - 32);
+    KDF_SHA512(session_key, 64, "resume confirm", context, 64 + TICKET_RESPONSE_BYTES - 32, confirm);
+    if (!ticket_equal(confirm, &message[TICKET_RESPONSE_BYTES - 32], 32))
+    {
+        clear_words((unsigned int *)session_key, 64 / sizeof(unsigned int));
+        return ECCRYPTO_ERROR_SIGNATURE_VERIFICATION;
+    }
+
+    memcpy(client->ticket, &message[1 + TICKET_NONCE_BYTES], TICKET_BYTES);
+    KDF_SHA512(session_key, 64, "resumption", NULL, 0, client->secret);
+    return ECCRYPTO_SUCCESS;
+}
+#endif